@@ -0,0 +1,171 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/bench/parser.cpp
+ * First submitted: 2026-10-19
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-19 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     compared against the former regex based parser
+ *     RTSP request parser microbenchmark
+ *
+ **/
+
+
+#include "rtsp/message.h"
+#include "rtsp/header.h"
+#include "rtsp/method.h"
+#include "lib/clock.h"
+#include "lib/urlencode.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace KGD;
+
+namespace
+{
+	//! typical requests of a session, and one with many headers
+	const char * REQUESTS[] =
+	{
+		"OPTIONS rtsp://127.0.0.1:8554/movie.mkv RTSP/1.0\r\n"
+		"CSeq: 1\r\n"
+		"User-Agent: LibVLC/2.0.0 (LIVE555 Streaming Media v2011.12.23)\r\n"
+		"\r\n",
+
+		"SETUP rtsp://127.0.0.1:8554/movie.mkv/track1 RTSP/1.0\r\n"
+		"CSeq: 3\r\n"
+		"User-Agent: LibVLC/2.0.0 (LIVE555 Streaming Media v2011.12.23)\r\n"
+		"Transport: RTP/AVP;unicast;client_port=51000-51001\r\n"
+		"\r\n",
+
+		"PLAY rtsp://127.0.0.1:8554/movie.mkv RTSP/1.0\r\n"
+		"CSeq: 5\r\n"
+		"User-Agent: LibVLC/2.0.0 (LIVE555 Streaming Media v2011.12.23)\r\n"
+		"Session: 1234567890\r\n"
+		"Range: npt=0.000-\r\n"
+		"\r\n",
+
+		"GET_PARAMETER rtsp://127.0.0.1:8554/movie.mkv RTSP/1.0\r\n"
+		"X-A: 1\r\nX-B: 2\r\nX-C: 3\r\nX-D: 4\r\nX-E: 5\r\nX-F: 6\r\nX-G: 7\r\nX-H: 8\r\n"
+		"X-I: 1\r\nX-J: 2\r\nX-K: 3\r\nX-L: 4\r\nX-M: 5\r\nX-N: 6\r\nX-O: 7\r\nX-P: 8\r\n"
+		"X-Q: 1\r\nX-R: 2\r\nX-S: 3\r\nX-T: 4\r\nX-U: 5\r\nX-V: 6\r\nX-W: 7\r\nX-X: 8\r\n"
+		"X-Y: 1\r\nX-Z: 2\r\nY-A: 3\r\nY-B: 4\r\nY-C: 5\r\nY-D: 6\r\nY-E: 7\r\nY-F: 8\r\n"
+		"CSeq: 7\r\n"
+		"Session: 1234567890\r\n"
+		"\r\n"
+	};
+	const size_t N_REQUESTS = sizeof( REQUESTS ) / sizeof( REQUESTS[ 0 ] );
+
+	//! the former request parser: a regex per field over a copy of the message
+	namespace Regex
+	{
+		vector< string > extractData( const string & data, const string & rx ) throw( KGD::Exception::NotFound )
+		{
+			boost::regex rxSearch( rx );
+			boost::match_results< string::const_iterator > match;
+			if ( boost::regex_search( data.begin(), data.end(), match, rxSearch ) )
+			{
+				vector< string > rt;
+				for( size_t i = 1; i < match.size(); ++i )
+					rt.push_back( match.str(i) );
+				return rt;
+			}
+			else
+				throw KGD::Exception::NotFound( rx );
+		}
+
+		//! start line, CSeq and url, as the request constructor did
+		RTSP::TCseq parse( const char * data, size_t sz ) throw( KGD::Exception::NotFound )
+		{
+			const string msg( data, sz );
+			vector< string > requestData = extractData( msg, "^\\s*(\\w+) (.+) RTSP/(\\d+\\.\\d+)" + RTSP::EOL );
+			RTSP::Method::getIDfromName( requestData[0] );
+			RTSP::TCseq cseq = fromString< RTSP::TCseq >( extractData( msg, RTSP::EOL + RTSP::Header::Cseq + ": (\\d+)" + RTSP::EOL ).at(0) );
+
+			const string url = Url::decode( requestData[1] );
+			if ( url.find( "rtsp://" ) == 0 )
+			{
+				vector< string > urlParts = split( "/", url.substr( 7 ) ), pathParts;
+				split2( ":", urlParts[0] );
+				for( size_t i = 1; i < urlParts.size(); ++i )
+				{
+					if ( urlParts[i].size() )
+					{
+						const string & part = urlParts[i];
+						boost::regex rxTrack( "^tk=(\\d+)$" );
+						boost::match_results< string::const_iterator > match;
+						if ( ! boost::regex_search( part.begin(), part.end(), match, rxTrack ) )
+							pathParts.push_back( urlParts[i] );
+					}
+				}
+				join( "/", pathParts );
+			}
+			return cseq;
+		}
+	}
+
+	//! runs a parser over a request, returns ns per parse
+	template< class F >
+	double measure( F parse, const char * req, size_t len, size_t iterations )
+	{
+		uint64_t cseq = 0;
+		const double start = Clock::getSec();
+		for( size_t i = 0; i < iterations; ++i )
+			cseq += parse( req, len );
+		const double elapsed = Clock::getSec() - start;
+
+		if ( ! cseq )
+			cout << "(no cseq !) ";
+		return elapsed / iterations * 1e9;
+	}
+
+	RTSP::TCseq parseCurrent( const char * data, size_t sz )
+	{
+		return RTSP::Message::Request( data, sz, "127.0.0.1" ).getCseq();
+	}
+}
+
+//! parses the sample requests over and over: kgd_bench_parser [iterations]
+int main( int argc, char ** argv )
+{
+	const size_t iterations = ( argc > 1 ? strtoul( argv[ 1 ], 0, 10 ) : 200000 );
+
+	for( size_t r = 0; r < N_REQUESTS; ++r )
+	{
+		const size_t len = strlen( REQUESTS[ r ] );
+		const double current = measure( parseCurrent, REQUESTS[ r ], len, iterations );
+		const double former = measure( Regex::parse, REQUESTS[ r ], len, iterations );
+
+		cout << "request " << r << ": " << len << " bytes, "
+			<< current << " ns / parse, "
+			<< 1e9 / current << " parses / s, "
+			<< "regex parser " << former << " ns / parse, "
+			<< "speedup " << former / current << "x" << endl;
+	}
+
+	return 0;
+}
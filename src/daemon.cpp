@@ -25,6 +25,17 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     shared-sockets parameter
+ *     rtcp-mux parameter
+ *     RTCP poll interval dropped
+ *     backlog and not sent low watermark parameters
+ *     output queue size for slow interleaved peers
+ *     control plane loops and workers
+ *     hibernation of long paused sessions
+ *     key frame trick play
+ *     vod batching window
+ *     disk io parameters
+ *     failed description loads ttl
  *     added param for tcp socket send buffer
  *     english comments; removed leak with connection serving threads
  *     removed magic numbers in favor of constants / ini parameters
@@ -36,12 +47,18 @@
 
 #include "daemon.h"
 #include "rtsp/ports.h"
+#include "rtsp/egress.h"
 #include "rtsp/server.h"
 #include "sdp/sdp.h"
 #include "lib/ini.h"
 #include "lib/clock.h"
+#include "lib/arena.h"
+#include "lib/diskio.h"
+#include "lib/poller.h"
 #include "lib/log.h"
 #include "rtp/buffer.h"
+#include "rtp/batch.h"
+#include "rtp/session.h"
 #include "rtsp/connection.h"
 
 #include <cstdlib>
@@ -91,10 +108,17 @@ namespace KGD
 
 		RTP::Buffer::Base::SIZE_LOW = fromString< double >( (*_ini)( "RTP", "buf-empty" ) );
 		RTP::Buffer::Base::SIZE_FULL = fromString< double >( (*_ini)( "RTP", "buf-full" ) );
+		RTP::Buffer::Base::SCALE_LIMIT = fromString< double >( (*_ini)( "RTP", "trick-limit", "1.0" ) );
+		RTP::Buffer::Base::SCALE_STEP = fromString< double >( (*_ini)( "RTP", "trick-step", "0.25" ) );
 		RTP::Packet::MTU = fromString< size_t >( (*_ini)("RTP", "net-mtu") );
+		RTP::Batch::Pool::JOIN_WINDOW = fromString< double >( (*_ini)( "RTP", "batch-window", "0" ) );
+		RTP::Session::HIBERNATE_AFTER = fromString< double >( (*_ini)( "RTP", "hibernate-after", "0" ) );
+		RTP::Session::MAX_BACKLOG = fromString< double >( (*_ini)( "RTP", "max-backlog", "1.0" ) );
 
 		RTSP::Port::Udp::FIRST = fromString< TPort >( (*_ini)("RTP", "udp-first", "30000") );
 		RTSP::Port::Udp::LAST = fromString< TPort >( (*_ini)("RTP", "udp-last", "40000") );
+		RTSP::Port::Udp::RTCP_MUX = ( "1" == (*_ini)( "RTP", "rtcp-mux", "1" ) );
+		RTSP::Egress::Service::SOCKETS = fromString< size_t >( (*_ini)( "RTP", "shared-sockets", "0" ) );
 		RTSP::Port::Udp::getInstance()->reset( RTSP::Port::Udp::FIRST, RTSP::Port::Udp::LAST );
 
 		SDP::Container::BASE_DIR = (*_ini)( "SDP", "base-dir");
@@ -102,26 +126,43 @@ namespace KGD
 		SDP::Container::SIZE_LOW = RTP::Buffer::Base::SIZE_FULL;
 		SDP::Container::SIZE_FULL = 2 * RTP::Buffer::Base::SIZE_FULL;
 
-		RTSP::Connection::SHARE_DESCRIPTORS = ( "1" == (*_ini)( "SDP", "share-descriptors", "0" ) );
+		Arena::CHUNK_SIZE = 1024 * fromString< size_t >( (*_ini)( "SDP", "arena-chunk", "4096" ) );
+		Arena::HUGE_PAGES = ( "1" == (*_ini)( "SDP", "huge-pages", "0" ) );
+		DiskIO::READAHEAD = 1024 * fromString< size_t >( (*_ini)( "SDP", "readahead", "1024" ) );
+		DiskIO::QUEUE_DEPTH = max( size_t( 1 ), fromString< size_t >( (*_ini)( "SDP", "io-depth", "4" ) ) );
+		DiskIO::DIRECT = ( "1" == (*_ini)( "SDP", "direct-io", "0" ) );
+
+		RTSP::Connection::SHARE_DESCRIPTORS = ( "1" == (*_ini)( "SDP", "share-descriptors", "1" ) );
+		SDP::Descriptions::FAILURE_TTL = fromString< double >( (*_ini)( "SDP", "failure-ttl", "2.0" ) );
 
 		RTSP::Method::SUPPORT_SEEK = ( "1" == (*_ini)( "RTSP", "supp-seek", "1" ) );
 
 		RTCP::Sender::SR_INTERVAL = fromString< double >( (*_ini)( "RTCP", "send-every", "5.0" ) );
-		RTCP::Receiver::POLL_INTERVAL = fromString< double >( (*_ini)( "RTCP", "poll-every", "5.0" ) );
 
 		Socket::READ_TIMEOUT = fromString< double >( (*_ini)( "SERVER", "read-to", "0.1" ) );
 		Socket::WRITE_TIMEOUT = fromString< double >( (*_ini)( "SERVER", "write-to", "0.1" ) );
 		Socket::WRITE_BUFFER_SIZE = fromString< size_t >( (*_ini)( "SERVER", "write-buf", "1024" ) );
+		Socket::NOTSENT_LOWAT = 1024 * fromString< size_t >( (*_ini)( "SERVER", "notsent-lowat", "64" ) );
+		Poller::LOOPS = max( size_t( 1 ), fromString< size_t >( (*_ini)( "SERVER", "loops", "1" ) ) );
+		Poller::WORKERS = max( size_t( 1 ), fromString< size_t >( (*_ini)( "SERVER", "workers", "8" ) ) );
+		RTSP::Socket::OUTPUT_QUEUE = 1024 * fromString< size_t >( (*_ini)( "SERVER", "out-queue", "512" ) );
 		
 		ostringstream s;
 		s << "KGD: Parameters: Buffer [" << RTP::Buffer::Base::SIZE_LOW << "-" << RTP::Buffer::Base::SIZE_FULL
+			<< "] | trick play [>" << RTP::Buffer::Base::SCALE_LIMIT << "x every " << RTP::Buffer::Base::SCALE_STEP << " s"
 			<< "] | MTU " << RTP::Packet::MTU
-			<< " | RTP [" << RTSP::Port::Udp::FIRST << "-" << RTSP::Port::Udp::LAST << "]"
-			<< " | RCTP [S=" << setprecision( 2 ) << RTCP::Sender::SR_INTERVAL << " R=" << setprecision( 2 ) << RTCP::Receiver::POLL_INTERVAL << "]"
+			<< " | batch window " << RTP::Batch::Pool::JOIN_WINDOW
+			<< " | hibernate after " << RTP::Session::HIBERNATE_AFTER
+			<< " | max backlog " << RTP::Session::MAX_BACKLOG << " s"
+			<< " | RTP [" << RTSP::Port::Udp::FIRST << "-" << RTSP::Port::Udp::LAST << ( RTSP::Port::Udp::RTCP_MUX ? " rtcp-mux" : "" ) << " shared x" << RTSP::Egress::Service::SOCKETS << "]"
+			<< " | RCTP [S=" << setprecision( 2 ) << RTCP::Sender::SR_INTERVAL << "]"
 			<< " | SDP shared descriptors " << RTSP::Connection::SHARE_DESCRIPTORS
 			<< " | SDP aggregate control " << SDP::Container::AGGREGATE_CONTROL
+			<< " | SDP arena [" << Arena::CHUNK_SIZE / 1024 << "K" << ( Arena::HUGE_PAGES ? " huge" : "" ) << "]"
+			<< " | disk io [" << DiskIO::READAHEAD / 1024 << "K x" << DiskIO::QUEUE_DEPTH << ( DiskIO::DIRECT ? " direct" : "" ) << "]"
 			<< " | RTSP seek support " << RTSP::Method::SUPPORT_SEEK
-			<< " | socket [R=" << setprecision( 2 ) << Socket::READ_TIMEOUT << " W=" << setprecision( 2 ) << Socket::WRITE_TIMEOUT << " B=" << Socket::WRITE_BUFFER_SIZE << "]"
+			<< " | socket [R=" << setprecision( 2 ) << Socket::READ_TIMEOUT << " W=" << setprecision( 2 ) << Socket::WRITE_TIMEOUT << " B=" << Socket::WRITE_BUFFER_SIZE << " L=" << Socket::NOTSENT_LOWAT / 1024 << "K]"
+			<< " | control [" << Poller::LOOPS << " loops, " << Poller::WORKERS << " workers, " << RTSP::Socket::OUTPUT_QUEUE / 1024 << "K queue]"
 		;
 		Log::debug( "%s", s.str().c_str() );
 	}
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     payload lookup without exceptions
  *     boosted
  *     fixed bug related to AAC sample rate
  *     Added AAC support
@@ -116,7 +117,10 @@ namespace KGD
 
 					auto_ptr< Packet::List > rt( new Packet::List );
 
-					const ByteArray & myData = this->getData();
+					const Arena::Slice * data = this->findData();
+					if ( ! data )
+						return rt;
+					const Arena::Slice & myData = *data;
 
 					size_t payloadSize = Packet::MTU - Header::SIZE - 4;
 					size_t packetized = 0, tot = myData.size();
@@ -154,7 +158,8 @@ namespace KGD
 						rt->push_back( pkt );
 					}
 
-					rt->back().isLastOfSequence = true;
+					if ( ! rt->empty() )
+						rt->back().isLastOfSequence = true;
 					return rt;
 				}
 			}
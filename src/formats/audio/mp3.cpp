@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     payload lookup without exceptions
  *     Lockables in timers and medium; refactorized iterator release
  *     boosted
  *     Some cosmetics about enums and RTCP library
@@ -91,7 +92,7 @@ namespace KGD
 					{
 						ByteArray prevADU( _prev.header );
 						prevADU.append( _prev.payload );
-						Base::addFrame( new Frame::MediaFile( prevADU, _prev.t ) );
+						Base::addFrame( new Frame::MediaFile( prevADU, _prev.t, _arena ) );
 					}
 				}
 
@@ -190,7 +191,10 @@ namespace KGD
 
 					auto_ptr< Packet::List > rt( new Packet::List );
 
-					const ByteArray & myData = this->getData();
+					const Arena::Slice * data = this->findData();
+					if ( ! data )
+						return rt;
+					const Arena::Slice & myData = *data;
 
 					size_t payloadSize = Packet::MTU - Header::SIZE - 2;
 					size_t packetized = 0, tot = myData.size();
@@ -225,7 +229,8 @@ namespace KGD
 						rt->push_back( pkt );
 					}
 
-					rt->back().isLastOfSequence = true;
+					if ( ! rt->empty() )
+						rt->back().isLastOfSequence = true;
 					return rt;
 				}
 			}
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     payload lookup without exceptions
  *     boosted
  *     Some cosmetics about enums and RTCP library
  *     source import
@@ -111,7 +112,10 @@ namespace KGD
 
 					auto_ptr< Packet::List > rt( new Packet::List );
 
-					const ByteArray & myData = this->getData();
+					const Arena::Slice * data = this->findData();
+					if ( ! data )
+						return rt;
+					const Arena::Slice & myData = *data;
 
 					size_t payloadSize = Packet::MTU - Header::SIZE;
 					size_t packetized = 0, tot = myData.size();
@@ -136,7 +140,8 @@ namespace KGD
 						rt->push_back( pkt );
 					}
 
-					rt->back().isLastOfSequence = true;
+					if ( ! rt->empty() )
+						rt->back().isLastOfSequence = true;
 					return rt;
 				}
 			}
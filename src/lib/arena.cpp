@@ -0,0 +1,208 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/arena.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     intrusive chunk references instead of a shared_ptr per slice
+ *     payload arena for frame data
+ *
+ **/
+
+
+#include "lib/arena.h"
+#include "lib/log.h"
+#include "lib/utils/safe.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+extern "C"
+{
+#include <sys/mman.h>
+}
+
+using namespace std;
+
+namespace KGD
+{
+	namespace
+	{
+		//! transparent huge page size on x86
+		const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+	}
+
+	size_t Arena::CHUNK_SIZE = 4 * 1024 * 1024;
+	bool Arena::HUGE_PAGES = false;
+
+	Arena::Chunk::Chunk( size_t sz ) throw( KGD::Exception::Generic )
+	: _ptr( 0 )
+	, _size( sz )
+	, _used( 0 )
+	, _refs( 1 )
+	{
+		void * p = 0;
+		int err = posix_memalign( &p, Arena::HUGE_PAGES ? HUGE_PAGE_SIZE : sizeof( void * ), _size );
+		if ( err )
+			throw KGD::Exception::Generic( "arena chunk allocation", err );
+
+		_ptr = reinterpret_cast< unsigned char * >( p );
+
+#ifdef MADV_HUGEPAGE
+		if ( Arena::HUGE_PAGES && _size >= HUGE_PAGE_SIZE && madvise( _ptr, _size, MADV_HUGEPAGE ) != 0 )
+			Log::debug( "arena: huge pages not available: %s", strerror( errno ) );
+#endif
+	}
+
+	Arena::Chunk::~Chunk() throw()
+	{
+		free( _ptr );
+	}
+
+	void Arena::Chunk::addRef() throw()
+	{
+		Safe::Atomic::add( _refs, uint32_t( 1 ) );
+	}
+
+	void Arena::Chunk::unRef( Chunk * c ) throw()
+	{
+		if ( c && Safe::Atomic::add( c->_refs, uint32_t( -1 ) ) == 0 )
+			delete c;
+	}
+
+	size_t Arena::Chunk::available() const throw()
+	{
+		return _size - _used;
+	}
+
+	unsigned char * Arena::Chunk::store( void const * data, size_t sz ) throw()
+	{
+		BOOST_ASSERT( sz <= this->available() );
+		unsigned char * rt = &_ptr[ _used ];
+		memcpy( rt, data, sz );
+		_used += sz;
+		return rt;
+	}
+
+	// ***********************************************************************************************
+
+	Arena::Slice::Slice()
+	: _chunk( 0 )
+	, _ptr( 0 )
+	, _size( 0 )
+	{
+	}
+
+	Arena::Slice::Slice( Chunk & c, unsigned char const * p, size_t sz )
+	: _chunk( &c )
+	, _ptr( p )
+	, _size( sz )
+	{
+		c.addRef();
+	}
+
+	Arena::Slice::Slice( const Slice & s )
+	: _chunk( s._chunk )
+	, _ptr( s._ptr )
+	, _size( s._size )
+	{
+		if ( _chunk )
+			_chunk->addRef();
+	}
+
+	Arena::Slice::~Slice()
+	{
+		Chunk::unRef( _chunk );
+	}
+
+	Arena::Slice & Arena::Slice::operator=( const Slice & s )
+	{
+		if ( s._chunk )
+			s._chunk->addRef();
+		Chunk::unRef( _chunk );
+		_chunk = s._chunk;
+		_ptr = s._ptr;
+		_size = s._size;
+		return *this;
+	}
+
+	size_t Arena::Slice::size() const throw()
+	{
+		return _size;
+	}
+
+	bool Arena::Slice::empty() const throw()
+	{
+		return _size == 0;
+	}
+
+	unsigned char const * Arena::Slice::get() const throw()
+	{
+		return _ptr;
+	}
+
+	const unsigned char & Arena::Slice::operator[]( size_t i ) const throw( KGD::Exception::OutOfBounds )
+	{
+		if ( i >= _size )
+			throw KGD::Exception::OutOfBounds( i, 0, _size - 1 );
+		return _ptr[ i ];
+	}
+
+	// ***********************************************************************************************
+
+	Arena::Arena()
+	: _current( 0 )
+	{
+	}
+
+	Arena::~Arena()
+	{
+		Chunk::unRef( _current );
+	}
+
+	Arena::Slice Arena::store( void const * data, size_t sz ) throw( KGD::Exception::Generic )
+	{
+		Lock lk( _mux );
+
+		// big payloads don't waste the current chunk
+		if ( sz > CHUNK_SIZE / 2 )
+		{
+			Chunk * own = new Chunk( sz );
+			Slice rt( *own, own->store( data, sz ), sz );
+			Chunk::unRef( own );
+			return rt;
+		}
+
+		// when a chunk is full, it stays alive as long as some slice points to it
+		if ( ! _current || _current->available() < sz )
+		{
+			Chunk * c = new Chunk( CHUNK_SIZE );
+			Chunk::unRef( _current );
+			_current = c;
+		}
+
+		return Slice( *_current, _current->store( data, sz ), sz );
+	}
+}
@@ -0,0 +1,131 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/arena.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     intrusive chunk references instead of a shared_ptr per slice
+ *     payload arena for frame data
+ *
+ **/
+
+
+#ifndef __KGD_ARENA_H
+#define __KGD_ARENA_H
+
+#include "lib/common.h"
+#include "lib/exceptions.h"
+
+#include <stdint.h>
+
+using namespace std;
+
+namespace KGD
+{
+	//! append only memory area, handing out slices of big chunks
+	class Arena
+	: public boost::noncopyable
+	{
+	public:
+		//! a big, contiguous memory block
+		class Chunk
+		: public boost::noncopyable
+		{
+		private:
+			//! allocated memory
+			unsigned char * _ptr;
+			//! allocated size
+			size_t _size;
+			//! used size
+			size_t _used;
+			//! references held by the arena and by slices
+			uint32_t volatile _refs;
+			//! free
+			~Chunk() throw();
+		public:
+			//! allocate, with a reference for the caller
+			Chunk( size_t ) throw( KGD::Exception::Generic );
+			//! take a reference
+			void addRef() throw();
+			//! drop a reference, freeing the chunk with the last one
+			static void unRef( Chunk * ) throw();
+			//! returns space left
+			size_t available() const throw();
+			//! copy data at the end of the used area, returning its address
+			unsigned char * store( void const *, size_t ) throw();
+		};
+
+		//! a read only payload living into a chunk; keeps its chunk alive with an intrusive reference, no control block
+		class Slice
+		{
+		private:
+			//! owning chunk
+			Chunk * _chunk;
+			//! data ptr
+			unsigned char const * _ptr;
+			//! data size
+			size_t _size;
+		public:
+			//! empty slice
+			Slice();
+			//! slice into a chunk
+			Slice( Chunk &, unsigned char const *, size_t );
+			//! copy, referencing the same chunk
+			Slice( const Slice & );
+			//! release chunk
+			~Slice();
+			//! assign, referencing the other chunk
+			Slice & operator=( const Slice & );
+
+			//! returns size
+			size_t size() const throw();
+			//! tells if there is some data
+			bool empty() const throw();
+			//! returns inner ptr
+			unsigned char const * get() const throw();
+			//! returns element at position i
+			const unsigned char & operator[]( size_t i ) const throw( KGD::Exception::OutOfBounds );
+		};
+
+	private:
+		//! chunk being filled, referenced by the arena
+		Chunk * _current;
+		//! protects current chunk
+		Mutex _mux;
+	public:
+		//! size of each chunk in bytes
+		static size_t CHUNK_SIZE;
+		//! advise the kernel to back chunks with transparent huge pages
+		static bool HUGE_PAGES;
+
+		//! build empty
+		Arena();
+		//! release current chunk
+		~Arena();
+		//! copy data into the arena; payloads bigger than a chunk get a chunk of their own
+		Slice store( void const *, size_t ) throw( KGD::Exception::Generic );
+	};
+}
+
+#endif
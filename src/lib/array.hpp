@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     fixed chopFront direction
  *     fixed RTSP buffer enqueue
  *     boosted
  *     source import
@@ -290,7 +291,7 @@ namespace KGD
 		else
 		{
 			size_t sz = this->_size - n;
-			memmove( &this->_ptr[ n ], this->_ptr, sz );
+			memmove( this->_ptr, &this->_ptr[ n ], sz );
 			this->resize( sz );
 		}
 	}
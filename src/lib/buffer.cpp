@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     dequeue skips bytes instead of erasing them
  *     fixed RTSP buffer enqueue
  *     boosted
  *     source import
@@ -46,6 +47,7 @@ namespace KGD
 	}
 	
 	Buffer::Buffer()
+	: _head( 0 )
 	{
 		_data.reserve( BLOCK_SIZE );
 		// ensure string termination for later uses
@@ -58,20 +60,24 @@ namespace KGD
 
 	const char * Buffer::getDataBegin( size_t pos ) const throw( KGD::Exception::OutOfBounds )
 	{
-		if ( pos > _data.size() - 2 )
-			throw KGD::Exception::OutOfBounds( pos, 0, _data.size() - 2 );
-		return &_data[pos];
+		if ( pos > this->getDataLength() - 1 )
+			throw KGD::Exception::OutOfBounds( pos, 0, this->getDataLength() - 1 );
+		return &_data[_head + pos];
 	}
 
 	size_t Buffer::getDataLength() const throw()
 	{
-		return _data.size() - 1;
+		return _data.size() - 1 - _head;
 	}
 
 	void Buffer::enqueue( const void * s, uint16_t len ) throw( KGD::Exception::Generic )
 	{
-		while( _data.size() + len > _data.capacity() )
-			_data.reserve( _data.capacity() + BLOCK_SIZE );
+		// move data to front once at least as much has been dequeued, or before growing
+		if ( _head && ( _head >= this->getDataLength() || _data.size() + len > _data.capacity() ) )
+		{
+			_data.erase( _data.begin(), _data.begin() + _head );
+			_head = 0;
+		}
 
 		const char * c = reinterpret_cast< const char * >( s );		
 		_data.insert( _data.end() - 1, c, c + len );
@@ -89,11 +95,18 @@ namespace KGD
 
 	void Buffer::dequeue( uint16_t len ) throw( KGD::Exception::Generic )
 	{
-		if (len > 0 && _data.size() > len)
+		if ( len > 0 && len <= this->getDataLength() )
 		{
-			_data.erase( _data.begin(), _data.begin() + len );
+			_head += len;
+			// empty: start over, keeping capacity
+			if ( _head == _data.size() - 1 )
+			{
+				_data.resize( 1 );
+				_data[0] = 0;
+				_head = 0;
+			}
 		}
 		else if ( len > 0 )
-			throw KGD::Exception::Generic( "buffer underrun " + toString( len ) + " on " + toString( _data.size() - 1 ) );
+			throw KGD::Exception::Generic( "buffer underrun " + toString( len ) + " on " + toString( this->getDataLength() ) );
 	}
 }
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     dequeue skips bytes instead of erasing them
  *     boosted
  *     source import
  *
@@ -42,13 +43,15 @@ using namespace std;
 
 namespace KGD
 {
-	//! generic buffer
+	//! generic buffer: dequeued bytes are skipped, and reclaimed when new data comes
 	class Buffer
 	: public boost::noncopyable
 	{
 	private:
-		//! data as char
+		//! data as char, null terminated
 		vector< char > _data;
+		//! offset of the first byte not dequeued yet
+		size_t _head;
 	public:
 		//! build empty
 		Buffer();
@@ -65,7 +68,7 @@ namespace KGD
 		//! enqueues data
 		void enqueue( const string & s ) throw( KGD::Exception::Generic );
 		//! dequeues data
-		void dequeue( uint16_t len ) throw( KGD::Exception::Generic );
+		virtual void dequeue( uint16_t len ) throw( KGD::Exception::Generic );
 	};
 }
 
@@ -0,0 +1,299 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/diskio.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     readahead file reads through a shared disk scheduler
+ *
+ **/
+
+
+#include "lib/diskio.h"
+#include "lib/log.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+extern "C"
+{
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+}
+
+using namespace std;
+
+namespace KGD
+{
+	namespace
+	{
+		//! read until len bytes, end of file or error
+		ssize_t readFully( int fd, unsigned char * p, size_t len, int64_t off ) throw()
+		{
+			size_t done = 0;
+			while( done < len )
+			{
+				ssize_t rd = pread( fd, p + done, len - done, off + done );
+				if ( rd < 0 && errno == EINTR )
+					continue;
+				else if ( rd < 0 )
+					return ( done ? ssize_t( done ) : rd );
+				else if ( rd == 0 )
+					break;
+				done += rd;
+			}
+			return done;
+		}
+
+		//! window size: readahead rounded to alignment
+		size_t windowSize() throw()
+		{
+			return max( DiskIO::ALIGN, ( DiskIO::READAHEAD + DiskIO::ALIGN - 1 ) / DiskIO::ALIGN * DiskIO::ALIGN );
+		}
+	}
+
+	size_t DiskIO::READAHEAD = 1024 * 1024;
+	size_t DiskIO::QUEUE_DEPTH = 4;
+	bool DiskIO::DIRECT = false;
+
+	DiskIO::Window::Window( int64_t off, size_t sz ) throw( KGD::Exception::Generic )
+	: data( 0 )
+	, offset( off )
+	, length( 0 )
+	{
+		void * p = 0;
+		int err = posix_memalign( &p, DiskIO::ALIGN, sz );
+		if ( err )
+			throw KGD::Exception::Generic( "disk read buffer allocation", err );
+
+		data = reinterpret_cast< unsigned char * >( p );
+	}
+
+	DiskIO::Window::~Window() throw()
+	{
+		free( data );
+	}
+
+	// ***********************************************************************************************
+
+	DiskIO::File::File( const string & path ) throw( KGD::Exception::Generic )
+	: _io( DiskIO::getInstance() )
+	, _fd( -1 )
+	, _pos( 0 )
+	{
+#ifdef O_DIRECT
+		if ( DiskIO::DIRECT && ( _fd = ::open( path.c_str(), O_RDONLY | O_DIRECT ) ) < 0 )
+			Log::debug( "disk io: direct io not available for %s: %s", path.c_str(), strerror( errno ) );
+#endif
+		if ( _fd < 0 && ( _fd = ::open( path.c_str(), O_RDONLY ) ) < 0 )
+			throw KGD::Exception::Generic( "open " + path, errno );
+
+		struct stat st;
+		if ( fstat( _fd, &st ) != 0 )
+		{
+			int err = errno;
+			::close( _fd );
+			throw KGD::Exception::Generic( "stat " + path, err );
+		}
+		_dev = st.st_dev;
+		_ino = st.st_ino;
+		_size = st.st_size;
+
+		posix_fadvise( _fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+	}
+
+	DiskIO::File::~File() throw()
+	{
+		_win.reset();
+		::close( _fd );
+	}
+
+	int DiskIO::File::read( unsigned char * buf, int n ) throw()
+	{
+		int done = 0;
+		while( done < n && _pos < _size )
+		{
+			if ( !_win || _pos < _win->offset || _pos >= _win->offset + _win->length )
+			{
+				// windows start on multiples of their own size, so streams share them
+				int64_t off = _pos - _pos % windowSize();
+				try
+				{
+					_win = _io->fetch( _fd, _dev, _ino, off );
+				}
+				catch( const KGD::Exception::Generic & e )
+				{
+					Log::error( "disk io: %s", e.what() );
+					_win.reset();
+					return ( done ? done : -1 );
+				}
+
+				// short file or read error
+				if ( _pos >= _win->offset + _win->length )
+				{
+					int rt = ( done ? done : ( _win->length < 0 ? -1 : 0 ) );
+					_win.reset();
+					return rt;
+				}
+
+				// let the kernel start on the next window meanwhile
+				if ( ! DiskIO::DIRECT )
+					posix_fadvise( _fd, off + _win->length, _win->length, POSIX_FADV_WILLNEED );
+			}
+
+			size_t from = _pos - _win->offset;
+			size_t cp = min( size_t( n - done ), size_t( _win->length ) - from );
+			memcpy( buf + done, _win->data + from, cp );
+			done += cp;
+			_pos += cp;
+		}
+		return done;
+	}
+
+	int64_t DiskIO::File::seek( int64_t off, int whence ) throw()
+	{
+		int64_t p;
+		switch( whence )
+		{
+		case SEEK_SET:
+			p = off;
+			break;
+		case SEEK_CUR:
+			p = _pos + off;
+			break;
+		case SEEK_END:
+			p = _size + off;
+			break;
+		default:
+			return -1;
+		}
+
+		if ( p < 0 )
+			return -1;
+		else
+			return ( _pos = p );
+	}
+
+	int64_t DiskIO::File::size() const throw()
+	{
+		return _size;
+	}
+
+	// ***********************************************************************************************
+
+	bool DiskIO::Key::operator<( const Key & k ) const throw()
+	{
+		if ( dev != k.dev )
+			return dev < k.dev;
+		else if ( ino != k.ino )
+			return ino < k.ino;
+		else
+			return offset < k.offset;
+	}
+
+	DiskIO::DiskIO()
+	: _inflight( 0 )
+	{
+		_head.dev = 0;
+		_head.ino = 0;
+		_head.offset = 0;
+	}
+
+	DiskIO::RequestMap::iterator DiskIO::next() throw()
+	{
+		// elevator: first queued read past the head, then wrap
+		for( RequestMap::iterator it = _pending.lower_bound( _head ); it != _pending.end(); ++it )
+			if ( ! it->second->issued )
+				return it;
+
+		for( RequestMap::iterator it = _pending.begin(); it != _pending.end(); ++it )
+			if ( ! it->second->issued )
+				return it;
+
+		return _pending.end();
+	}
+
+	boost::shared_ptr< const DiskIO::Window > DiskIO::fetch( int fd, dev_t dev, ino_t ino, int64_t off ) throw( KGD::Exception::Generic )
+	{
+		Key k;
+		k.dev = dev;
+		k.ino = ino;
+		k.offset = off;
+
+		KGD::Lock lk( _mux );
+
+		// readers of the same region share a single read
+		boost::shared_ptr< Request > r;
+		RequestMap::iterator it = _pending.find( k );
+		if ( it != _pending.end() )
+			r = it->second;
+		else
+		{
+			r.reset( new Request );
+			r->fd = fd;
+			r->length = windowSize();
+			r->issued = false;
+			r->done = false;
+			r->win.reset( new Window( off, r->length ) );
+			_pending.insert( make_pair( k, r ) );
+		}
+
+		while( ! r->done )
+		{
+			RequestMap::iterator n;
+			if ( _inflight < QUEUE_DEPTH && ( n = this->next() ) != _pending.end() )
+			{
+				// serve the queue in disk order, maybe on behalf of another reader
+				// still waiting on it, so its descriptor is open
+				Key qk = n->first;
+				boost::shared_ptr< Request > q = n->second;
+				q->issued = true;
+				++ _inflight;
+				_head = qk;
+
+				ssize_t rd;
+				int err;
+				{
+					Safe::UnLock ulk( lk );
+					rd = readFully( q->fd, q->win->data, q->length, qk.offset );
+					err = errno;
+				}
+				if ( rd < 0 )
+					Log::warning( "disk io: read error at %lld: %s", (long long)qk.offset, strerror( err ) );
+
+				q->win->length = rd;
+				q->done = true;
+				-- _inflight;
+				_pending.erase( qk );
+				_changed.notify_all();
+			}
+			else
+				_changed.wait( lk );
+		}
+
+		return r->win;
+	}
+}
@@ -0,0 +1,165 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/diskio.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     readahead file reads through a shared disk scheduler
+ *
+ **/
+
+
+#ifndef __KGD_DISKIO_H
+#define __KGD_DISKIO_H
+
+#include "lib/common.h"
+#include "lib/exceptions.h"
+#include "lib/utils/singleton.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <map>
+
+extern "C"
+{
+#include <sys/types.h>
+}
+
+using namespace std;
+
+namespace KGD
+{
+	//! disk reads scheduler: large aligned reads, served in disk order, shared between readers of the same file
+	class DiskIO
+	: public Singleton::Class< DiskIO >
+	{
+	public:
+		//! readahead window size in bytes
+		static size_t READAHEAD;
+		//! max concurrent disk reads
+		static size_t QUEUE_DEPTH;
+		//! open files bypassing the page cache
+		static bool DIRECT;
+		//! offset, size and memory alignment of reads
+		static const size_t ALIGN = 4096;
+
+		//! a completed or pending disk read
+		class Window
+		: public boost::noncopyable
+		{
+		public:
+			//! aligned buffer
+			unsigned char * data;
+			//! file offset
+			int64_t offset;
+			//! bytes read, negative on error
+			ssize_t length;
+
+			//! allocate
+			Window( int64_t, size_t ) throw( KGD::Exception::Generic );
+			//! free
+			~Window() throw();
+		};
+
+		//! a file read through readahead windows
+		class File
+		: public boost::noncopyable
+		{
+		private:
+			//! scheduler
+			Singleton::Class< DiskIO >::Reference _io;
+			//! descriptor
+			int _fd;
+			//! device
+			dev_t _dev;
+			//! inode
+			ino_t _ino;
+			//! file size
+			int64_t _size;
+			//! read position
+			int64_t _pos;
+			//! current window
+			boost::shared_ptr< const Window > _win;
+		public:
+			//! open for reading
+			File( const string & ) throw( KGD::Exception::Generic );
+			//! close
+			~File() throw();
+			//! read up to n bytes at current position; returns bytes read, 0 at end, negative on error
+			int read( unsigned char *, int ) throw();
+			//! move position as lseek does; returns the new one, negative on error
+			int64_t seek( int64_t, int ) throw();
+			//! returns file size
+			int64_t size() const throw();
+		};
+
+	private:
+		//! request key, disk order
+		struct Key
+		{
+			dev_t dev;
+			ino_t ino;
+			int64_t offset;
+			bool operator<( const Key & ) const throw();
+		};
+		//! a queued read
+		struct Request
+		{
+			//! descriptor of the first requester
+			int fd;
+			//! read size
+			size_t length;
+			//! issued to disk
+			bool issued;
+			//! read completed
+			bool done;
+			//! read result
+			boost::shared_ptr< Window > win;
+		};
+		typedef map< Key, boost::shared_ptr< Request > > RequestMap;
+
+		//! queued and in flight reads
+		RequestMap _pending;
+		//! last issued key, the elevator position
+		Key _head;
+		//! reads in flight
+		size_t _inflight;
+		//! protects the queue
+		KGD::Mutex _mux;
+		//! signals a read started or completed
+		Condition _changed;
+
+		//! returns the next read to issue, in disk order from the head
+		RequestMap::iterator next() throw();
+		//! read a window of a file, sharing it with concurrent readers of the same region
+		boost::shared_ptr< const Window > fetch( int, dev_t, ino_t, int64_t ) throw( KGD::Exception::Generic );
+
+		//! ctor
+		DiskIO();
+		friend class Singleton::Class< DiskIO >;
+	};
+}
+
+#endif
@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     channel timeline anchored to the play list time, channels always shared
+ *     channel play lists
  *     boosted
  *     source import
  *
@@ -33,6 +35,11 @@
 
 #include <fstream>
 
+extern "C"
+{
+#include <sys/stat.h>
+}
+
 #include <boost/regex.hpp>
 
 #include "lib/pls.h"
@@ -43,6 +50,7 @@ namespace KGD
 
 	PlayList::PlayList( const string & fileName ) throw( Exception::NotFound )
 		: _loops( 0 )
+		, _channel( false )
 		, _fileName( fileName )
 	{
 		this->reload();
@@ -58,8 +66,8 @@ namespace KGD
 			throw Exception::NotFound( _fileName );
 
 		// search regular expressions
-		boost::regex rxHeader1("^loop\\s*$");
-		boost::regex rxHeader2("^loop\\s+(\\d{1,3})\\s*$");
+		boost::regex rxHeader1("^loop(\\s+channel)?\\s*$");
+		boost::regex rxHeader2("^loop\\s+(\\d{1,3})(\\s+channel)?\\s*$");
 		boost::regex rxFile("^([^\\s]+)\\s*$");
 		boost::match_results< string::const_iterator > match;
 		// for every line
@@ -78,7 +86,10 @@ namespace KGD
 				if ( lineNo > 0 )
 					Log::warning( "%s: invalid loop declaration at line %u", _fileName.c_str(), lineNo );
 				else
+				{
 					_loops = 0;
+					_channel = match[1].matched;
+				}
 			}
 			// check finite loop
 			else if (boost::regex_search(bg, ed, match, rxHeader2))
@@ -86,7 +97,10 @@ namespace KGD
 				if ( lineNo > 0 )
 					Log::warning( "%s: invalid loop declaration at line %u", _fileName.c_str(), lineNo );
 				else
+				{
 					_loops = fromString< uint16_t >( match.str(1) );
+					_channel = match[2].matched;
+				}
 			}
 			else if (boost::regex_search(bg, ed, match, rxFile))
 				_media.push_back( match.str(1) );
@@ -105,6 +119,17 @@ namespace KGD
 		return _loops;
 	}
 
+	bool PlayList::isChannel() const throw()
+	{
+		return _channel;
+	}
+
+	time_t PlayList::getModificationTime() const throw()
+	{
+		struct stat st;
+		return ( stat( _fileName.c_str(), &st ) == 0 ? st.st_mtime : 0 );
+	}
+
 	const list< string > & PlayList::getMediaList() const throw()
 	{
 		return _media;
@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     channel timeline anchored to the play list time, channels always shared
+ *     channel play lists
  *     boosted
  *     source import
  *
@@ -38,6 +40,7 @@
 
 #include "lib/exceptions.h"
 #include <stdint.h>
+#include <ctime>
 
 namespace KGD
 {
@@ -53,11 +56,17 @@ namespace KGD
 		const string& getFileName() const throw();
 		//! get number of loops
 		const uint16_t & getLoops() const throw();
+		//! tells if every viewer plays the same wall clock timeline
+		bool isChannel() const throw();
+		//! returns the last modification time of the play list file, 0 if unknown
+		time_t getModificationTime() const throw();
 		//! get ordered list of media containers to play
 		const list< string > & getMediaList() const throw();
 	protected:
 		//! numer of loops; 0 means infinte
 		uint16_t _loops;
+		//! channel mode
+		bool _channel;
 		//! media containers
 		list< string > _media;
 		//! ini file name
@@ -0,0 +1,287 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/poller.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     output drained while input is paused for a slow request
+ *     optional write interest
+ *     epoll event loops and worker pool for control connections
+ *
+ **/
+
+
+#include "lib/poller.h"
+#include "lib/log.h"
+#include "lib/utils/safe.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+extern "C"
+{
+#include <sys/epoll.h>
+#include <unistd.h>
+}
+
+namespace KGD
+{
+	size_t Poller::LOOPS = 1;
+	size_t Poller::WORKERS = 8;
+
+	Poller::Handler::Handler() throw()
+	: _pollId( 0 )
+	, _pollLoop( 0 )
+	, _pollArmed( false )
+	, _pollOut( false )
+	, _pollIn( true )
+	{
+	}
+
+	Poller::Handler::~Handler()
+	{
+	}
+
+	void Poller::Handler::onWritable() throw()
+	{
+	}
+
+	// ***********************************************************************************************
+
+	Poller::Poller() throw( KGD::Exception::Generic )
+	: _nextId( 0 )
+	, _nextLoop( 0 )
+	, _idle( 0 )
+	, _running( true )
+	{
+		for( size_t i = 0; i < max( size_t( 1 ), LOOPS ); ++i )
+		{
+			int fd = epoll_create( 256 );
+			if ( fd < 0 )
+				throw KGD::Exception::Generic( "epoll_create", errno );
+			_epoll.push_back( fd );
+		}
+
+		for( size_t i = 0; i < _epoll.size(); ++i )
+			_loops.push_back( new boost::thread( boost::bind( &Poller::loop, this, i ) ) );
+
+		Log::debug( "poller: %u event loops, up to %u workers", _epoll.size(), WORKERS );
+	}
+
+	Poller::~Poller()
+	{
+		{
+			KGD::Lock lk( _mux );
+			_running = false;
+		}
+		_queued.notify_all();
+
+		BOOST_FOREACH( boost::thread & th, _loops )
+			th.join();
+		BOOST_FOREACH( boost::thread & th, _workers )
+			th.join();
+
+		BOOST_FOREACH( int fd, _epoll )
+			::close( fd );
+
+		Log::debug( "poller: stopped" );
+	}
+
+	int Poller::control( int op, Handler & h ) throw()
+	{
+		epoll_event ev;
+		memset( &ev, 0, sizeof( ev ) );
+		// one event at a time: the handler rearms when done with it
+		ev.events = EPOLLONESHOT | ( h._pollIn ? uint32_t( EPOLLIN ) : 0 ) | ( h._pollOut ? uint32_t( EPOLLOUT ) : 0 );
+		ev.data.u64 = h._pollId;
+
+		if ( epoll_ctl( _epoll[ h._pollLoop ], op, h.getPollDescriptor(), &ev ) == 0 )
+		{
+			h._pollArmed = ( op != EPOLL_CTL_DEL );
+			return 0;
+		}
+		else
+		{
+			int err = errno;
+			Log::error( "poller: epoll_ctl on %d: %s", h.getPollDescriptor(), strerror( err ) );
+			return err;
+		}
+	}
+
+	void Poller::add( Handler & h ) throw( KGD::Exception::Generic )
+	{
+		KGD::Lock lk( _mux );
+		BOOST_ASSERT( h._pollId == 0 );
+
+		h._pollId = ++ _nextId;
+		h._pollLoop = _nextLoop ++ % _epoll.size();
+
+		int err = this->control( EPOLL_CTL_ADD, h );
+		if ( err )
+		{
+			h._pollId = 0;
+			throw KGD::Exception::Generic( "epoll_ctl", err );
+		}
+		_handlers[ h._pollId ] = &h;
+	}
+
+	void Poller::rearm( Handler & h ) throw()
+	{
+		KGD::Lock lk( _mux );
+		h._pollIn = true;
+		if ( h._pollId )
+			this->control( EPOLL_CTL_MOD, h );
+	}
+
+	void Poller::pauseRead( Handler & h ) throw()
+	{
+		KGD::Lock lk( _mux );
+		h._pollIn = false;
+		if ( h._pollId )
+			this->control( EPOLL_CTL_MOD, h );
+	}
+
+	void Poller::watchWrite( Handler & h, bool out ) throw()
+	{
+		KGD::Lock lk( _mux );
+		if ( h._pollOut == out )
+			return;
+
+		h._pollOut = out;
+		// a disarmed handler gets the new interest when rearmed, unless its input is paused: then nobody else would rearm it
+		if ( h._pollId && ( h._pollArmed || ! h._pollIn ) )
+			this->control( EPOLL_CTL_MOD, h );
+	}
+
+	void Poller::remove( Handler & h ) throw()
+	{
+		KGD::Lock lk( _mux );
+		if ( ! h._pollId )
+			return;
+
+		uint64_t id = h._pollId;
+		this->control( EPOLL_CTL_DEL, h );
+		_handlers.erase( id );
+		h._pollId = 0;
+
+		// a handler may remove itself from its callback
+		map< uint64_t, boost::thread::id >::iterator b;
+		while( ( b = _busy.find( id ) ) != _busy.end() && b->second != boost::this_thread::get_id() )
+			_calledBack.wait( lk );
+	}
+
+	void Poller::dispatch( uint64_t id, uint32_t events ) throw()
+	{
+		Handler * h;
+		bool in;
+		{
+			KGD::Lock lk( _mux );
+			map< uint64_t, Handler * >::iterator it = _handlers.find( id );
+			// removed after the event was collected, or stale: a watch change rearmed it while the event was collected
+			if ( it == _handlers.end() || ! it->second->_pollArmed )
+				return;
+
+			h = it->second;
+			h->_pollArmed = false;
+			in = h->_pollIn;
+			_busy[ id ] = boost::this_thread::get_id();
+		}
+
+		if ( events & EPOLLOUT )
+			h->onWritable();
+		// with input paused, a hang up waits for the handler to resume
+		if ( in && ( events & ~EPOLLOUT ) )
+			h->onReadable();
+
+		{
+			KGD::Lock lk( _mux );
+			_busy.erase( id );
+			// just writable: keep watching on behalf of the handler
+			if ( ! ( events & ~EPOLLOUT ) && _handlers.count( id ) && ! h->_pollArmed )
+				this->control( EPOLL_CTL_MOD, *h );
+		}
+		_calledBack.notify_all();
+	}
+
+	void Poller::loop( size_t i ) throw()
+	{
+		const int MAX_EVENTS = 64;
+		epoll_event ev[ MAX_EVENTS ];
+
+		for(;;)
+		{
+			{
+				KGD::Lock lk( _mux );
+				if ( ! _running )
+					break;
+			}
+
+			// timeout so that shutdown is noticed
+			int n = epoll_wait( _epoll[ i ], ev, MAX_EVENTS, 500 );
+			if ( n < 0 && errno != EINTR )
+			{
+				Log::error( "poller: loop %u: %s", i, strerror( errno ) );
+				break;
+			}
+
+			for( int k = 0; k < n; ++k )
+				this->dispatch( ev[ k ].data.u64, ev[ k ].events );
+		}
+	}
+
+	void Poller::offload( const Job & j ) throw()
+	{
+		{
+			KGD::Lock lk( _mux );
+			_jobs.push_back( j );
+			if ( _idle < _jobs.size() && _workers.size() < max( size_t( 1 ), WORKERS ) )
+				_workers.push_back( new boost::thread( boost::bind( &Poller::work, this ) ) );
+		}
+		_queued.notify_one();
+	}
+
+	void Poller::work() throw()
+	{
+		KGD::Lock lk( _mux );
+		for(;;)
+		{
+			while( _running && _jobs.empty() )
+			{
+				++ _idle;
+				_queued.wait( lk );
+				-- _idle;
+			}
+
+			if ( ! _running )
+				break;
+
+			Job j = _jobs.front();
+			_jobs.pop_front();
+			{
+				Safe::UnLock ulk( lk );
+				j();
+			}
+		}
+	}
+}
@@ -0,0 +1,153 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/lib/poller.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     output drained while input is paused for a slow request
+ *     optional write interest
+ *     epoll event loops and worker pool for control connections
+ *
+ **/
+
+
+#ifndef __KGD_POLLER_H
+#define __KGD_POLLER_H
+
+#include "lib/common.h"
+#include "lib/exceptions.h"
+#include "lib/utils/singleton.hpp"
+
+#include <boost/function.hpp>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+namespace KGD
+{
+	//! a few epoll loops watching many descriptors, plus a worker pool for slow jobs
+	class Poller
+	: public Singleton::Class< Poller >
+	{
+	public:
+		//! number of event loops
+		static size_t LOOPS;
+		//! max worker threads
+		static size_t WORKERS;
+
+		//! a descriptor watched for input
+		class Handler
+		{
+		private:
+			//! registration id, 0 when not registered
+			uint64_t _pollId;
+			//! event loop index
+			size_t _pollLoop;
+			//! watched for the next event
+			bool _pollArmed;
+			//! watched for writability too
+			bool _pollOut;
+			//! watched for input; off while input is paused, the handler staying armed for output only
+			bool _pollIn;
+			friend class Poller;
+		protected:
+			//! ctor
+			Handler() throw();
+		public:
+			//! dtor
+			virtual ~Handler();
+			//! descriptor to watch
+			virtual int getPollDescriptor() const throw() = 0;
+			//! input is available or the peer hung up; not called again until rearmed
+			virtual void onReadable() throw() = 0;
+			//! output can be written, called before onReadable when both happened; the poller rearms if nothing was read
+			virtual void onWritable() throw();
+		};
+
+		//! a job for the workers
+		typedef boost::function< void () > Job;
+
+	private:
+		//! epoll descriptor by loop
+		vector< int > _epoll;
+		//! registered handlers by id
+		map< uint64_t, Handler * > _handlers;
+		//! handlers being called back, and the calling thread
+		map< uint64_t, boost::thread::id > _busy;
+		//! next registration id
+		uint64_t _nextId;
+		//! next loop to assign
+		size_t _nextLoop;
+		//! event loop threads
+		boost::ptr_vector< boost::thread > _loops;
+		//! worker threads
+		boost::ptr_vector< boost::thread > _workers;
+		//! queued jobs
+		deque< Job > _jobs;
+		//! idle workers
+		size_t _idle;
+		//! loops and workers keep running
+		bool _running;
+		//! protects registrations and jobs
+		KGD::Mutex _mux;
+		//! signals a callback done
+		Condition _calledBack;
+		//! signals a job queued or shutdown
+		Condition _queued;
+
+		//! event loop
+		void loop( size_t ) throw();
+		//! calls back a handler by id for the events happened
+		void dispatch( uint64_t, uint32_t ) throw();
+		//! worker loop
+		void work() throw();
+		//! changes a registration, returning 0 or the error; lock must be held
+		int control( int op, Handler & ) throw();
+
+		//! ctor, starts the loops
+		Poller() throw( KGD::Exception::Generic );
+		friend class Singleton::Class< Poller >;
+	public:
+		//! stops loops and workers
+		~Poller();
+
+		//! starts watching a handler for one input event
+		void add( Handler & ) throw( KGD::Exception::Generic );
+		//! watches a registered handler for the next input event, resuming input if paused
+		void rearm( Handler & ) throw();
+		//! stops watching a handler for input until rearmed, keeping it armed for output meanwhile
+		void pauseRead( Handler & ) throw();
+		//! watches a registered handler for writability too, or stops doing so; arms it only if input is paused
+		void watchWrite( Handler &, bool ) throw();
+		//! stops watching a handler, waiting for a callback in progress on another thread; call before closing its descriptor
+		void remove( Handler & ) throw();
+		//! runs a job on a worker
+		void offload( const Job & ) throw();
+	};
+}
+
+#endif
@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     pooled ports in channel descriptions
+ *     rtcp-mux in channel descriptions
+ *     read descriptor and data sinks for input channels
+ *     channel backlog, TCP_NOTSENT_LOWAT
+ *     droppable packet writes, single shot vectored send
+ *     vectored packet writes with MSG_MORE
+ *     descriptor getter for event polling
  *     "would block" cleanup
  *     added param for tcp socket send buffer
  *     english comments; removed leak with connection serving threads
@@ -53,6 +60,8 @@ extern "C" {
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 }
 
 namespace KGD
@@ -70,6 +79,40 @@ namespace KGD
 			Safe::UnRLock ulk( lk );
 			return this->readSome( data, sz );
 		}
+
+		int In::getReadDescriptor() const throw()
+		{
+			return -1;
+		}
+
+		bool In::setSink( Sink * ) throw()
+		{
+			return false;
+		}
+
+		void Out::writePackets( const iovec * v, size_t n, bool, bool ) throw( KGD::Exception::Generic )
+		{
+			for( size_t i = 0; i < n; ++i )
+			{
+				uint8_t const * data = reinterpret_cast< uint8_t const * >( v[i].iov_base );
+				size_t rem = v[i].iov_len;
+				while( rem > 0 )
+				{
+					size_t wrote = this->writeSome( data, rem );
+					data += wrote;
+					rem -= wrote;
+				}
+			}
+		}
+
+		void Out::flush() throw()
+		{
+		}
+
+		size_t Out::getBacklog() throw()
+		{
+			return 0;
+		}
 	}
 
 	namespace Socket
@@ -77,6 +120,7 @@ namespace KGD
 		double READ_TIMEOUT = 0.1;
 		double WRITE_TIMEOUT = 0.1;
 		size_t WRITE_BUFFER_SIZE = 2048;
+		size_t NOTSENT_LOWAT = 0;
 		
 		Exception::Exception() throw()
 		: KGD::Exception::Generic( errno )
@@ -175,6 +219,11 @@ namespace KGD
 			}
 		}
 
+		int Abstract::getFileDescriptor() const throw()
+		{
+			return _fileDescriptor;
+		}
+
 		sockaddr_in Abstract::getAddress( const TPort port, const string& host ) const throw( Socket::Exception )
 		{
 			sockaddr_in addr;
@@ -257,6 +306,10 @@ namespace KGD
 		{
 			return _rdBlock;
 		}
+		int Reader::getReadDescriptor() const throw()
+		{
+			return _fileDescriptor;
+		}
 
 		ssize_t Reader::recvFromSocket( void* data, size_t len, sockaddr_in* peerAddress ) throw()
 		{
@@ -442,6 +495,33 @@ namespace KGD
 			return this->writeSome( data, len );
 		}
 
+		size_t Writer::writeVector( const iovec * v, size_t n, bool more ) throw( Socket::Exception )
+		{
+			if ( ! _connected )
+				throw Socket::Exception( "writeVector", "socket is not connected to an end-point");
+
+			int flags = 0;
+			if ( !_wrBlock )
+				flags |= MSG_DONTWAIT;
+			if ( more )
+				flags |= MSG_MORE;
+
+			msghdr msg;
+			memset( &msg, 0, sizeof( msghdr ) );
+			msg.msg_iov = const_cast< iovec * >( v );
+			msg.msg_iovlen = n;
+
+			ssize_t wroteBytes;
+			do
+				wroteBytes = ::sendmsg( _fileDescriptor, &msg, flags );
+			while( wroteBytes < 0 && errno == EINTR );
+
+			if ( wroteBytes < 0 )
+				throw Socket::Exception( "writeVector" );
+			else
+				return wroteBytes;
+		}
+
 		size_t Writer::writeAll( void const * data, size_t len ) throw( Socket::Exception )
 		{
 			size_t sent = 0;
@@ -470,6 +550,8 @@ namespace KGD
 			Channel::Description rt;
 			rt.type = Channel::Owned;
 			rt.ports = make_pair( this->getLocalPort(), this->getRemotePort() );
+			rt.mux = false;
+			rt.pooled = false;
 
 			return rt;
 		}
@@ -525,6 +607,38 @@ namespace KGD
 			_connected = true;
 		}
 
+		void Tcp::flush() throw()
+		{
+			// uncorking pushes pending frames
+			int flag = 0;
+			if (::setsockopt(_fileDescriptor, SOL_TCP, TCP_CORK, &flag, sizeof(int)) < 0)
+				Log::debug( "socket %d: setsockopt - TCP_CORK: %s", _fileDescriptor, strerror( errno ) );
+		}
+
+		size_t Tcp::getBacklog() throw()
+		{
+			int unsent = 0;
+#ifdef SIOCOUTQNSD
+			if ( ::ioctl( _fileDescriptor, SIOCOUTQNSD, &unsent ) < 0 )
+#else
+			// includes sent bytes not yet acknowledged
+			if ( ::ioctl( _fileDescriptor, SIOCOUTQ, &unsent ) < 0 )
+#endif
+				return 0;
+			return unsent;
+		}
+
+		void Tcp::setNotSentLowat( size_t sz ) throw( Socket::Exception )
+		{
+#ifdef TCP_NOTSENT_LOWAT
+			int param = sz;
+			if (::setsockopt(_fileDescriptor, SOL_TCP, TCP_NOTSENT_LOWAT, &param, sizeof(int)) < 0)
+				throw Socket::Exception( "setsockopt - TCP_NOTSENT_LOWAT" );
+#else
+			Log::debug( "socket %d: TCP_NOTSENT_LOWAT not available", _fileDescriptor );
+#endif
+		}
+
 		void Tcp::setKeepAlive( bool set ) throw( Socket::Exception )
 		{
 			int flag = ( set ? 1 : 0 );
@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     pooled ports in channel descriptions
+ *     rtcp-mux in channel descriptions
+ *     read descriptor and data sinks for input channels
+ *     channel backlog, TCP_NOTSENT_LOWAT
+ *     droppable packet writes, single shot vectored send
+ *     vectored packet writes with MSG_MORE
+ *     descriptor getter for event polling
  *     "would block" cleanup
  *     added param for tcp socket send buffer
  *     minor cleanup and more robust Range / Scale support during PLAY
@@ -40,6 +47,7 @@
 extern "C" {
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 }
@@ -69,6 +77,10 @@ namespace KGD
 			Channel::type type;
 			//! local / remote ports
 			TPortPair ports;
+			//! RTP and RTCP share the channel, RFC 5761
+			bool mux;
+			//! local port belongs to a server socket, not to the channel
+			bool pooled;
 		};
 		
 		//! output, writable channel
@@ -87,6 +99,12 @@ namespace KGD
 			//! is able to write an array as last packet
 			template< class T >
 			size_t writeLast( const Array< T > & ) throw( KGD::Exception::Generic );
+			//! writes whole packets, a buffer each; more tells that other packets follow shortly, droppable that the channel may discard them all when congested
+			virtual void writePackets( const iovec *, size_t, bool more = false, bool droppable = false ) throw( KGD::Exception::Generic );
+			//! sends out packets held back by writes with more packets following
+			virtual void flush() throw();
+			//! bytes written but not yet on the wire, 0 if unknown
+			virtual size_t getBacklog() throw();
 
 			//! sets write buffer size
 			virtual void setWriteBufferSize( size_t ) = 0;
@@ -104,6 +122,15 @@ namespace KGD
 			virtual Description getDescription() const = 0;
 		};
 
+		//! takes inbound data as it comes
+		class Sink
+		{
+		public:
+			virtual ~Sink() {}
+			//! inbound data
+			virtual void onData( void const *, size_t ) throw() = 0;
+		};
+
 		//! input, readable channel
 		class In
 		{
@@ -127,6 +154,11 @@ namespace KGD
 			//! tells if socket is in read-blocking mode
 			virtual bool isReadBlock( ) const = 0;
 
+			//! descriptor to poll for input, -1 if none
+			virtual int getReadDescriptor() const throw();
+			//! hands inbound data to a sink as it comes instead of buffering it, 0 to stop; false if not supported
+			virtual bool setSink( Sink * ) throw();
+
 			//! an In channel can describe itself
 			virtual Description getDescription() const = 0;
 		};
@@ -152,6 +184,8 @@ namespace KGD
 		extern double WRITE_TIMEOUT;
 		//! common global value for write timeout
 		extern size_t WRITE_BUFFER_SIZE;
+		//! unsent bytes a tcp socket keeps in kernel before telling it's writable, 0 for no limit
+		extern size_t NOTSENT_LOWAT;
 
 		//! socket exceptions
 		class Exception:
@@ -224,6 +258,8 @@ namespace KGD
 			//! closes the socket
 			virtual void close() throw( );
 
+			//! returns the descriptor, -1 once closed
+			int getFileDescriptor() const throw();
 			//! returns local bind port
 			TPort getLocalPort() const throw();
 			//! returns local bind IP / hostname
@@ -269,6 +305,8 @@ namespace KGD
 			virtual void setReadBlock( bool );
 			//! tells if socket is in read-blocking mode
 			virtual bool isReadBlock( ) const;
+			//! returns the socket descriptor
+			virtual int getReadDescriptor() const throw();
 		};
 
 
@@ -308,6 +346,8 @@ namespace KGD
 			virtual size_t writeLast(void const *, size_t) throw( Socket::Exception );
 			//! sends generic data to the connected end-point, all of them
 			virtual size_t writeAll( void const * , size_t ) throw( Socket::Exception );
+			//! 'sendmsg' wrapper
+			size_t writeVector( const iovec *, size_t, bool more = false ) throw( Socket::Exception );
 
 			//! send a whole byte array
 			template< class T >
@@ -370,6 +410,12 @@ namespace KGD
 			virtual ~Tcp() throw();
 
 			void setKeepAlive( bool ) throw( Socket::Exception );
+			//! pushes out data held back by MSG_MORE
+			virtual void flush() throw();
+			//! bytes in kernel not yet sent
+			virtual size_t getBacklog() throw();
+			//! unsent bytes beyond which the socket isn't writable
+			void setNotSentLowat( size_t ) throw( Socket::Exception );
 		};
 		
 		//! UDP Socket
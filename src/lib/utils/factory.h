@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     registration test
  *     boosted
  *     source import
  *
@@ -158,6 +159,8 @@ namespace KGD
 
 			//! returns registered class ids
 			static list< ClassID::type > getRegisteredClassIDs( ) throw();
+			//! tells if a factory is bound to the typeID
+			static bool isRegistered( ClassID::type typeID ) throw();
 			//! returns a reference to the factory for the given typeID
 			static const Abstract< AbstractType > & getFactory( ClassID::type typeID ) throw( Exception::NotFound );
 
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     registration test
  *     boosted
  *     source import
  *
@@ -164,6 +165,13 @@ namespace KGD
 			return rt;
 		}
 
+		template< class AbstractType >
+		bool Registry< AbstractType >::isRegistered( ClassID::type typeID ) throw()
+		{
+			FactoryMap & f = Registry< AbstractType >::getFactoryMappings( );
+			return f.find( typeID ) != f.end();
+		}
+
 		template< class AbstractType >
 		AbstractType Registry< AbstractType >::newInstance ( ClassID::type typeID ) throw( Exception::NotFound )
 		{
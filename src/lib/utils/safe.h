@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     acquire / release primitives
+ *     lock-free primitives
  *     boosted
  *     boosted
  *     source import
@@ -86,6 +88,39 @@ namespace KGD
 			Thread( unsigned int count = 2 ) 			: ThreadBarrier( count ) { }
 		};
 
+		//! lock-free primitives on integral and pointer variables; unless named otherwise, they act as full barriers
+		namespace Atomic
+		{
+			//! reads a value published by another thread
+			template< class T >
+			T load( T const volatile & );
+			//! publishes a value to other threads
+			template< class T >
+			void store( T volatile &, T );
+			//! adds and returns the new value
+			template< class T >
+			T add( T volatile &, T );
+			//! sets the new value if the current one is the expected one; returns the previous value
+			template< class T >
+			T cas( T volatile &, T expected, T );
+			//! reads atomically; later accesses are not moved before it, pairs with storeRelease
+			template< class T >
+			T loadAcquire( T const volatile & );
+			//! writes atomically; earlier accesses are not moved after it
+			template< class T >
+			void storeRelease( T volatile &, T );
+			//! reads atomically, with no ordering
+			template< class T >
+			T loadRelaxed( T const volatile & );
+			//! writes atomically, with no ordering
+			template< class T >
+			void storeRelaxed( T volatile &, T );
+			//! earlier loads are not moved after later accesses
+			void fenceAcquire();
+			//! earlier accesses are not moved after later stores
+			void fenceRelease();
+		}
+
 		//! thread-safe boolean
 		typedef Flag<> Bool;
 		//! unlocker for unique lock
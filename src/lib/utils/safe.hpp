@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     acquire / release primitives
+ *     lock-free primitives
  *     boosted
  *     boosted
  *     source import
@@ -59,6 +61,73 @@ namespace KGD
 			_bit = b;
 			return *this;
 		}
+
+		// ********************************************************************************
+
+		namespace Atomic
+		{
+			template< class T >
+			inline T load( T const volatile & v )
+			{
+				T rt = v;
+				__sync_synchronize();
+				return rt;
+			}
+
+			template< class T >
+			inline void store( T volatile & v, T x )
+			{
+				__sync_synchronize();
+				v = x;
+				__sync_synchronize();
+			}
+
+			template< class T >
+			inline T add( T volatile & v, T x )
+			{
+				return __sync_add_and_fetch( &v, x );
+			}
+
+			template< class T >
+			inline T cas( T volatile & v, T expected, T x )
+			{
+				return __sync_val_compare_and_swap( &v, expected, x );
+			}
+
+			template< class T >
+			inline T loadAcquire( T const volatile & v )
+			{
+				return __atomic_load_n( &v, __ATOMIC_ACQUIRE );
+			}
+
+			template< class T >
+			inline void storeRelease( T volatile & v, T x )
+			{
+				__atomic_store_n( &v, x, __ATOMIC_RELEASE );
+			}
+
+			template< class T >
+			inline T loadRelaxed( T const volatile & v )
+			{
+				return __atomic_load_n( &v, __ATOMIC_RELAXED );
+			}
+
+			template< class T >
+			inline void storeRelaxed( T volatile & v, T x )
+			{
+				__atomic_store_n( &v, x, __ATOMIC_RELAXED );
+			}
+
+			inline void fenceAcquire()
+			{
+				__atomic_thread_fence( __ATOMIC_ACQUIRE );
+			}
+
+			inline void fenceRelease()
+			{
+				__atomic_thread_fence( __ATOMIC_RELEASE );
+			}
+		}
 	}
 }
 
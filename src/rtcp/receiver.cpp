@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     RTP dropped from muxed sockets
+ *     sockets watched by the shared poller instead of an own thread
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     break loop when received END in SDES
  *     "would block" cleanup
@@ -45,8 +47,6 @@ namespace KGD
 {
 	namespace RTCP
 	{
-		double Receiver::POLL_INTERVAL = 5.0;
-
 		namespace
 		{
 			const size_t HEADER_SIZE = sizeof( Header );
@@ -59,14 +59,15 @@ namespace KGD
 		}
 
 		Receiver::Receiver( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & chan )
-		: Thread( s, chan, "Receiver" )
-		, _poll( POLL_INTERVAL )
+		: Agent( s, chan, "Receiver" )
+		, _poller( Poller::getInstance() )
+		, _watch( NONE )
 		{
-			
 		}
 
 		Receiver::~Receiver()
 		{
+			this->stop();
 			Log::verbose( "%s: destroying", getLogName() );
 		}
 
@@ -263,7 +264,10 @@ namespace KGD
 					case PacketType::Bye:
 						Log::message( "%s: BYE", getLogName() );
 						i += size;
-						_flags.bag[ Status::RUNNING ] = false;
+						{
+							Lock lk( _mux );
+							_flags.bag[ Status::RUNNING ] = false;
+						}
 						break;
 					// APP, ignore
 					case PacketType::Application:
@@ -295,76 +299,135 @@ namespace KGD
 			_buffer.dequeue(i);
 		}
 
-		void Receiver::waitMore() throw()
+		void Receiver::attach() throw()
 		{
-			if ( ! _flags.bag[ Status::PAUSED ] )
+			Watch w = NONE;
+			if ( _sock->setSink( this ) )
+				w = SINKED;
+			else if ( _sock->getReadDescriptor() >= 0 )
 			{
-				Log::warning( "%s: increment read timeout to %lf", getLogName(), _poll * 1.2 );
-				_poll *= 1.2;
-				_sock->setReadTimeout( _poll );
+				try
+				{
+					_poller->add( *this );
+					w = POLLED;
+				}
+				catch( const KGD::Exception::Generic & e )
+				{
+					Log::error( "%s: %s", getLogName(), e.what() );
+				}
 			}
+			else
+				Log::warning( "%s: channel can't be watched", getLogName() );
+
+			Lock lk( _mux );
+			_watch = w;
 		}
 
-		void Receiver::waitLess() throw()
+		void Receiver::detach( Watch w ) throw()
 		{
-			Log::warning( "%s: decrement read timeout to %lf", getLogName(), _poll / 1.2 );
-			_poll /= 1.2;
-			_sock->setReadTimeout( _poll );
+			// the channel or the poller may be calling back, so no lock held
+			if ( w == SINKED )
+				_sock->setSink( 0 );
+			else if ( w == POLLED )
+				_poller->remove( *this );
 		}
 
-		void Receiver::run()
+		void Receiver::start()
 		{
+			{
+				Lock lk( _mux );
+				_flags.bag[ Status::SUSPENDED ] = false;
+				_flags.bag[ Status::PAUSED ] = false;
+				_flags.bag[ Status::RUNNING ] = true;
+				if ( _watch != NONE )
+					return;
+			}
 			Log::debug( "%s: started", getLogName() );
-			CharArray buffer( 1024 );
+			this->attach();
+		}
 
+		void Receiver::stop()
+		{
+			Watch w;
 			{
-				OwnThread::Lock lk( _th );
+				Lock lk( _mux );
+				_flags.bag[ Status::RUNNING ] = false;
+				_flags.bag[ Status::PAUSED ] = false;
+				w = _watch;
+				_watch = NONE;
+			}
 
-				while( _flags.bag[ Status::RUNNING ] )
-				{
-					this->doPause( lk );
+			if ( w != NONE )
+			{
+				this->detach( w );
+				Log::debug( "%s: stopped", getLogName() );
+				this->getStats().log( "Receiver" );
+			}
+		}
 
-					if ( _flags.bag[ Status::RUNNING ] )
-					{
-						try
-						{
-							ssize_t read = 0;
-							Log::verbose( "%s waiting message", getLogName() );
-							OwnThread::Interruptible intr( _th );
-							read = _sock->readSome( lk, buffer.get(), buffer.size() ) ;
-							if ( read > 0 )
-							{
-								this->push( buffer.get(), read );
-								this->waitLess();
-							}
-							else
-								Log::warning( "%s: no data read", getLogName() );
-							
-						}
-						catch( const Socket::Exception & e )
-						{
-							if ( e.wouldBlock() )
-							{
-								Log::warning( "%s: %s", getLogName(), e.what() );
-								this->waitMore();
-							}
-							else
-							{
-								Log::error( "%s: %s, stopping", getLogName(), e.what() );
-								_flags.bag[ Status::RUNNING ] = false;
-							}
-						}
-					}
-				}
+		void Receiver::pause()
+		{
+			Lock lk( _mux );
+			if ( _flags.bag[ Status::RUNNING ] )
+				_flags.bag[ Status::PAUSED ] = true;
+		}
 
-				Log::debug( "%s: loop terminated", getLogName() );
+		void Receiver::unpause()
+		{
+			Lock lk( _mux );
+			_flags.bag[ Status::PAUSED ] = false;
+		}
 
-				_flags.bag[ Status::PAUSED ] = false;
+		int Receiver::getPollDescriptor() const throw()
+		{
+			return _sock->getReadDescriptor();
+		}
 
-				this->getStats().log( "Receiver" );
+		void Receiver::onData( void const * data, size_t sz ) throw()
+		{
+			{
+				Lock lk( _mux );
+				if ( ! _flags.bag[ Status::RUNNING ] || _flags.bag[ Status::PAUSED ] )
+					return;
+			}
+			this->push( reinterpret_cast< char const * >( data ), sz );
+		}
+
+		void Receiver::onReadable() throw()
+		{
+			CharArray buffer( 1024 );
+			bool more = true;
+
+			// nonblocking socket: take every queued datagram
+			while( more )
+			{
+				try
+				{
+					size_t read = _sock->readSome( buffer.get(), buffer.size() );
+					// RTP on a muxed socket: RTCP packet types are 192-223, RFC 5761 4
+					uint8_t type = ( read > 1 ? uint8_t( buffer.get()[ 1 ] ) : 0 );
+					if ( type >= 192 && type <= 223 )
+						this->onData( buffer.get(), read );
+					else
+						Log::verbose( "%s: not RTCP, %u bytes dropped", getLogName(), read );
+				}
+				catch( const Socket::Exception & e )
+				{
+					more = false;
+					if ( ! e.wouldBlock() )
+					{
+						Log::error( "%s: %s, stopping", getLogName(), e.what() );
+						Lock lk( _mux );
+						_flags.bag[ Status::RUNNING ] = false;
+					}
+				}
 			}
 
-			_th.wait();
+			Lock lk( _mux );
+			if ( _flags.bag[ Status::RUNNING ] )
+				_poller->rearm( *this );
+			else
+				Log::debug( "%s: no more reads", getLogName() );
 		}
 
 	}
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     sockets watched by the shared poller instead of an own thread
  *     RTCP poll times in ini file; adaptive RTCP receiver poll interval; uniform EAGAIN handling, also thrown by Interleave
  *     boosted
  *     boosted
@@ -46,6 +47,8 @@
 #include "rtcp/header.h"
 #include "rtcp/stats.h"
 
+#include "lib/poller.h"
+
 namespace KGD
 {
 	namespace RTP
@@ -57,22 +60,20 @@ namespace KGD
 	{
 		//! RTCP receiver - receives client stats
 		class Receiver
-		: public RTCP::Thread
+		: public RTCP::Agent
+		, public Poller::Handler
+		, public Channel::Sink
 		{
 		private:
 			//! data buffer
 			Buffer _buffer;
 
-			//! poll interval / socket adaptive read timeout
-			double _poll;
+			//! event loops watching socket channels
+			Singleton::Class< Poller >::Reference _poller;
 
-			//! main loop
-			virtual void run();
+			//! how the channel is watched
+			enum Watch { NONE, POLLED, SINKED } _watch;
 
-			//! increase read timeout
-			void waitMore() throw();
-			//! decrease read timeout
-			void waitLess() throw();
 			//! update stats from received packets
 			void updateStats( const ReceiverReport::Payload & );
 
@@ -84,14 +85,32 @@ namespace KGD
 			bool handleSourceDescription( char const * const data, size_t size );
 			//! adds received data to local buffer
 			void push( char const * const buffer, ssize_t len );
+
+			//! starts watching the channel
+			void attach() throw();
+			//! stops watching the channel
+			void detach( Watch ) throw();
 		public:
 			//! ctor
 			Receiver( RTP::Session &, const boost::shared_ptr< Channel::Bi > & );
 			//! dtor
 			~Receiver();
 
-			//! maximum time waiting data
-			static double POLL_INTERVAL;
+			//! start receiving
+			virtual void start();
+			//! stop receiving
+			virtual void stop();
+			//! discard received data
+			virtual void pause();
+			//! handle received data again
+			virtual void unpause();
+
+			//! socket descriptor
+			virtual int getPollDescriptor() const throw();
+			//! reads what the socket has
+			virtual void onReadable() throw();
+			//! data from a channel without descriptor
+			virtual void onData( void const *, size_t ) throw();
 		};
 	}
 }
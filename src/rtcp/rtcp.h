@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     RTCP report scheduler
  *     source import
  *
  **/
@@ -37,5 +38,6 @@
 #include "rtcp/stats.h"
 #include "rtcp/sender.h"
 #include "rtcp/receiver.h"
+#include "rtcp/service.h"
 
 #endif
@@ -25,6 +25,9 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     reports timed by the shared RTCP scheduler, lock free packet counters
+ *     hibernation of long paused sessions
+ *     optional rtp sync on restart
  *     "would block" cleanup
  *     testing against a "speed crash"
  *     testing interrupted connections
@@ -57,148 +60,140 @@ namespace KGD
 	namespace RTCP
 	{
 
-		long Sender::SR_INTERVAL = 5;
+		double Sender::SR_INTERVAL = 5;
 
-		Sender::RTPSync::RTPSync()
-		: _doSync( false )
-		, _sync( 2 )
-		{
-		};
-
-		Sender::RTPSync& Sender::RTPSync::operator=( bool b )
-		{
-			_doSync = b;
-			return *this;
-		}
-
-		Sender::RTPSync::operator bool() const
-		{
-			return _doSync;
-		}
-
-		void Sender::RTPSync::wait()
-		{
-			_sync.wait();
-		}
-
-
-		
-		
 		Sender::Sender( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & sock )
-		: Thread( s, sock, "Sender" )
+		: Agent( s, sock, "Sender" )
+		, _pktCount( 0 )
+		, _octetCount( 0 )
+		, _pktLost( 0 )
+		, _octetLost( 0 )
+		, _service( Service::getInstance() )
 		{
 		}
 
 		Sender::~Sender()
 		{
+			this->stop();
 			Log::verbose( "%s: destroying", getLogName() );
 		}
 
 		void Sender::registerPacketSent( size_t sz ) throw()
 		{
-			SafeStats::Lock lk( _stats );
-			(*_stats).pktCount ++;
-			(*_stats).octetCount += sz;
+			Safe::Atomic::add( _pktCount, uint32_t( 1 ) );
+			Safe::Atomic::add( _octetCount, uint32_t( sz ) );
 		}
 		void Sender::registerPacketLost( size_t sz ) throw()
 		{
-			SafeStats::Lock lk( _stats );
-			(*_stats).pktLost ++;
+			Safe::Atomic::add( _pktLost, uint32_t( 1 ) );
+			Safe::Atomic::add( _octetLost, uint32_t( sz ) );
 		}
 
-		void Sender::wait()
+		Stats Sender::getStats() const throw()
 		{
-			_syncRTP.wait();
+			Stats rt = Agent::getStats();
+			rt.pktCount = Safe::Atomic::load( _pktCount );
+			rt.octetCount = Safe::Atomic::load( _octetCount );
+			rt.pktLost = Safe::Atomic::load( _pktLost );
+			rt.octetLost = Safe::Atomic::load( _octetLost );
+			return rt;
 		}
 
-		void Sender::_start()
+		void Sender::start()
 		{
-			_syncRTP = true;
+			Log::debug( "%s: starting", getLogName() );
+			{
+				Lock lk( _mux );
+				_flags.bag[ Status::SUSPENDED ] = false;
+				_flags.bag[ Status::RUNNING ] = true;
+				_flags.bag[ Status::PAUSED ] = false;
+			}
+			_service->schedule( *this, 0 );
 		}
 
-		void Sender::releaseRTP( OwnThread::Lock & lk )
+		void Sender::pause()
 		{
-			if ( _syncRTP )
 			{
-				Log::verbose( "%s: release barrier", getLogName() );
-				{
-					OwnThread::UnLock ulk( lk );
-					bool done = false;
-					do
-						NO_INTERRUPT( _syncRTP.wait(); done = true; )
-					while( ! done );
-				}
-				_syncRTP = false;
+				Lock lk( _mux );
+				if ( ! _flags.bag[ Status::RUNNING ] || _flags.bag[ Status::PAUSED ] )
+					return;
+				_flags.bag[ Status::PAUSED ] = true;
 			}
+			_service->cancel( *this );
 		}
 
-		void Sender::run()
+		void Sender::unpause()
 		{
 			{
-				OwnThread::Lock lk( _th );
+				Lock lk( _mux );
+				if ( ! _flags.bag[ Status::RUNNING ] )
+					return;
+				_flags.bag[ Status::PAUSED ] = false;
+			}
+			_service->schedule( *this, 0 );
+		}
 
-				Log::verbose( "%s: loop started", getLogName() );
+		void Sender::stop()
+		{
+			bool bye;
+			{
+				Lock lk( _mux );
+				if ( ! _flags.bag[ Status::RUNNING ] )
+					return;
+				_flags.bag[ Status::RUNNING ] = false;
+				_flags.bag[ Status::PAUSED ] = false;
+				bye = ! _flags.bag[ Status::SUSPENDED ];
+			}
+			_service->cancel( *this );
 
+			// send BYE, unless we'll be back
+			if ( bye )
+			{
 				try
 				{
-					while( _flags.bag[ Status::RUNNING ] )
-					{
-						this->doPause( lk );
-
-						if ( _flags.bag[ Status::RUNNING ] )
-						{
-							// send SR and SDES
-							try
-							{
-								*_sock << enqueueReport().enqueueDescription();
-								// give RTP way if needed
-								this->releaseRTP( lk );
-							}
-							catch( Socket::Exception const & e )
-							{
-								if ( e.wouldBlock() )
-									Log::warning( "%s: packet lost: %s", getLogName(), e.what() );
-								else
-									throw;
-							}
-
-							// sleep
-							{
-								OwnThread::Interruptible intr( _th );
-								try
-								{
-									Log::verbose("%s sleeping", getLogName());
-									_th.sleepSec( lk, SR_INTERVAL );
-								}
-								catch( boost::thread_interrupted )
-								{
-									Log::verbose("%s was awakened", getLogName());
-								}
-							}
-						}
-					}
-
-					// send BYE
 					*_sock << enqueueReport().enqueueBye();
 					Log::debug( "%s: sent BYE", getLogName() );
 				}
 				catch( const KGD::Socket::Exception & e )
 				{
-					Log::error( "%s: closing socket: %s", getLogName(), e.what() );
-					_sock->close();
+					_buffer.dequeue( _buffer.getDataLength() );
+					Log::warning( "%s: BYE lost: %s", getLogName(), e.what() );
 				}
+			}
 
-				this->releaseRTP( lk );
-
-				_flags.bag[ Status::RUNNING ] = false;
-				_flags.bag[ Status::PAUSED ] = false;
-
-				Log::debug( "%s: loop terminated", getLogName() );
+			Log::debug( "%s: stopped", getLogName() );
+			this->getStats().log( "Sender" );
+		}
 
-				RTCP::Thread::getStats().log( "Sender" );
+		bool Sender::report() throw()
+		{
+			{
+				Lock lk( _mux );
+				if ( ! _flags.bag[ Status::RUNNING ] || _flags.bag[ Status::PAUSED ] )
+					return false;
 			}
 
-			_th.wait();
+			// send SR and SDES
+			try
+			{
+				*_sock << enqueueReport().enqueueDescription();
+				return true;
+			}
+			catch( const KGD::Socket::Exception & e )
+			{
+				_buffer.dequeue( _buffer.getDataLength() );
+				if ( e.wouldBlock() )
+				{
+					Log::warning( "%s: packet lost: %s", getLogName(), e.what() );
+					return true;
+				}
+				else
+				{
+					Log::error( "%s: closing socket: %s", getLogName(), e.what() );
+					_sock->close();
+					return false;
+				}
+			}
 		}
 
 		void Sender::reset()
@@ -208,25 +203,6 @@ namespace KGD
 			(*_stats).SRcount = 0;
 		}
 
-		void Sender::restart()
-		{
-			Log::debug( "%s: restarting", getLogName() );
-
-			_th.lock();
-			_syncRTP = true;
-
-			if ( _flags.bag[ Status::RUNNING ] )
-			{
-				_th.unlock();
-				this->unpause();
-			}
-			else
-			{
-				_th.unlock();
-				this->start();
-			}				
-		}
-
 		Sender& Sender::enqueueReport()
 		{
 			//TODO keep to calc fract lost
@@ -254,9 +230,9 @@ namespace KGD
 			{
 				SafeStats::Lock lk( _stats );
 				++ (*_stats).SRcount;
-				h.pktCount   = htonl( (*_stats).pktCount );
-				h.octetCount = htonl( (*_stats).octetCount );
 			}
+			h.pktCount   = htonl( Safe::Atomic::load( _pktCount ) );
+			h.octetCount = htonl( Safe::Atomic::load( _octetCount ) );
 			h.ssrc = htonl( _rtp.getSsrc() );
 
 			Header hh( PacketType::SenderReport, sizeof(h) );
@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     reports timed by the shared RTCP scheduler, lock free packet counters
+ *     optional rtp sync on restart
  *     testing interrupted connections
  *     boosted
  *     boosted
@@ -45,6 +47,7 @@
 
 #include "rtcp/header.h"
 #include "rtcp/stats.h"
+#include "rtcp/service.h"
 
 namespace KGD
 {
@@ -64,27 +67,23 @@ namespace KGD
 	{
 		//! RTCP sender - delivers sender stats
 		class Sender
-		: public RTCP::Thread
+		: public RTCP::Agent
 		{
 		private:
-			//! sync barrier with RTP session
-			class RTPSync
-			{
-			private:
-				bool _doSync;
-				Barrier _sync;
-			public:
-				RTPSync();
-				RTPSync & operator=( bool );
-				operator bool() const;
-				void wait();
-			} _syncRTP;
-
 			//! buffer of data to send
 			Buffer _buffer;
 
-			//! main loop
-			virtual void run();
+			//! packets sent, updated by the RTP session without locks
+			volatile uint32_t _pktCount;
+			//! octets sent
+			volatile uint32_t _octetCount;
+			//! packets lost
+			volatile uint32_t _pktLost;
+			//! octets lost
+			volatile uint32_t _octetLost;
+
+			//! shared report scheduler
+			Singleton::Class< Service >::Reference _service;
 
 			//! enque SR packet in local buffer
 			Sender& enqueueReport();
@@ -92,11 +91,6 @@ namespace KGD
 			Sender& enqueueDescription();
 			//! enque BYE packet in local buffer
 			Sender& enqueueBye();
-
-			//! release sync barrier with RTP session
-			void releaseRTP( OwnThread::Lock & );
-			//! advice to sync with rtp
-			virtual void _start();
 		public:
 			//! ctor
 			Sender( RTP::Session &, const boost::shared_ptr< Channel::Bi > & );
@@ -105,20 +99,31 @@ namespace KGD
 
 			//! reset packet and octect count
 			void reset();
-			//! restart the sender requesting rtp sync
-			void restart();
-			//! calling thread (RTP session) will wait for sync on a 2-input barrier
-			void wait();
+
+			//! start reporting, first report right away
+			virtual void start();
+			//! stop reporting, sending BYE unless suspended
+			virtual void stop();
+			//! hold reports
+			virtual void pause();
+			//! resume reports, first one right away
+			virtual void unpause();
+
+			//! sends SR and SDES, called by the scheduler; false if reports should stop
+			bool report() throw();
 
 			//! add a sent packet to sender stats
 			void registerPacketSent( size_t sz ) throw();
 			//! add a lost packet to sender stats
 			void registerPacketLost( size_t sz ) throw();
 
+			//! return sender stats
+			virtual Stats getStats() const throw();
+
 			friend Channel::Out & KGD::operator<<( Channel::Out &, RTCP::Sender & ) throw( KGD::Socket::Exception );
 
-			//! seconds between two deliveries of the sender stats
-			static long SR_INTERVAL;
+			//! mean seconds between two deliveries of the sender stats
+			static double SR_INTERVAL;
 		};
 	}
 
@@ -0,0 +1,139 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtcp/service.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     shared RTCP report scheduler
+ *
+ **/
+
+
+#include "rtcp/service.h"
+#include "rtcp/sender.h"
+#include "lib/clock.h"
+#include "lib/log.h"
+
+#include <cstdlib>
+
+namespace KGD
+{
+	namespace RTCP
+	{
+		Service::Service()
+		: _busy( 0 )
+		, _running( true )
+		{
+			_th.reset( new boost::thread( boost::bind( &Service::run, this ) ) );
+			Log::debug( "rtcp: report scheduler started" );
+		}
+
+		Service::~Service()
+		{
+			{
+				KGD::Lock lk( _mux );
+				_running = false;
+			}
+			_changed.notify_all();
+			_th->join();
+
+			Log::debug( "rtcp: report scheduler stopped" );
+		}
+
+		double Service::getInterval() throw()
+		{
+			// spread reports of sessions started together
+			return Sender::SR_INTERVAL * ( 0.5 + double( random() ) / RAND_MAX );
+		}
+
+		void Service::unschedule( Sender & s ) throw()
+		{
+			map< Sender *, Schedule::iterator >::iterator it = _senders.find( &s );
+			if ( it != _senders.end() )
+			{
+				if ( it->second != _due.end() )
+					_due.erase( it->second );
+				_senders.erase( it );
+			}
+		}
+
+		void Service::schedule( Sender & s, double delay ) throw()
+		{
+			{
+				KGD::Lock lk( _mux );
+				this->unschedule( s );
+				_senders[ &s ] = _due.insert( make_pair( Clock::getSec() + delay, &s ) );
+			}
+			_changed.notify_all();
+		}
+
+		void Service::cancel( Sender & s ) throw()
+		{
+			KGD::Lock lk( _mux );
+			this->unschedule( s );
+
+			// a sender may cancel itself from its report
+			while( _busy == &s && _th->get_id() != boost::this_thread::get_id() )
+				_calledBack.wait( lk );
+		}
+
+		void Service::run() throw()
+		{
+			KGD::Lock lk( _mux );
+			while( _running )
+			{
+				double now = Clock::getSec();
+				if ( _due.empty() )
+					_changed.wait( lk );
+				else if ( _due.begin()->first > now )
+					_changed.timed_wait( lk, boost::get_system_time() + boost::posix_time::microseconds( long( ( _due.begin()->first - now ) * 1e6 ) + 1 ) );
+				else
+				{
+					Sender * s = _due.begin()->second;
+					_due.erase( _due.begin() );
+					_senders[ s ] = _due.end();
+					_busy = s;
+
+					bool again;
+					{
+						Safe::UnLock ulk( lk );
+						again = s->report();
+					}
+					_busy = 0;
+
+					// unless cancelled or scheduled anew meanwhile
+					map< Sender *, Schedule::iterator >::iterator it = _senders.find( s );
+					if ( it != _senders.end() && it->second == _due.end() )
+					{
+						if ( again )
+							it->second = _due.insert( make_pair( Clock::getSec() + getInterval(), s ) );
+						else
+							_senders.erase( it );
+					}
+					_calledBack.notify_all();
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtcp/service.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     shared RTCP report scheduler
+ *
+ **/
+
+
+#ifndef __KGD_RTCP_SERVICE_H
+#define __KGD_RTCP_SERVICE_H
+
+#include "lib/common.h"
+#include "lib/utils/singleton.hpp"
+
+#include <map>
+
+using namespace std;
+
+namespace KGD
+{
+	namespace RTCP
+	{
+		class Sender;
+
+		//! a single timer thread delivering sender reports for every session
+		class Service
+		: public Singleton::Class< Service >
+		{
+		private:
+			typedef multimap< double, Sender * > Schedule;
+			//! senders by due time
+			Schedule _due;
+			//! scheduled senders, with their entry in the schedule; end() while reporting
+			map< Sender *, Schedule::iterator > _senders;
+			//! sender being called back
+			Sender * _busy;
+			//! timer keeps running
+			bool _running;
+			//! timer thread
+			boost::scoped_ptr< boost::thread > _th;
+			//! protects the schedule
+			KGD::Mutex _mux;
+			//! signals a schedule change or shutdown
+			Condition _changed;
+			//! signals a report done
+			Condition _calledBack;
+
+			//! timer loop
+			void run() throw();
+			//! removes a sender from the schedule; lock must be held
+			void unschedule( Sender & ) throw();
+
+			//! ctor, starts the timer
+			Service();
+			friend class Singleton::Class< Service >;
+		public:
+			//! stops the timer
+			~Service();
+
+			//! next report of a sender within some seconds, then every SR interval
+			void schedule( Sender &, double ) throw();
+			//! no more reports for a sender, waiting for one in progress on another thread
+			void cancel( Sender & ) throw();
+
+			//! a randomized report interval, RFC 3550 6.3.1
+			static double getInterval() throw();
+		};
+	}
+}
+
+#endif
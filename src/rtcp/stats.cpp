@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     RTCP agents served by a shared scheduler and the poller instead of own threads
+ *     hibernation of long paused sessions
  *     threads terminate with wait + join
  *     testing against a "speed crash"
  *     testing against a "speed crash"
@@ -48,6 +50,7 @@ namespace KGD
 		, pktCount(0)
 		, octetCount(0)
 		, pktLost(0)
+		, octetLost(0)
 		, fractLost(0)
 		, highestSeqNo(0)
 		, jitter(0)
@@ -58,127 +61,47 @@ namespace KGD
 
 		void Stats::log( const string & lbl ) const
 		{
-			Log::message("RTCP %s Stats: %d RR, %d SR, %u packets, %u packets lost, %u fraction lost, %u jitter"
+			Log::message("RTCP %s Stats: %d RR, %d SR, %u packets, %u packets lost, %u octets lost, %u fraction lost, %u jitter"
 				, lbl.c_str()
 				, RRcount
 				, SRcount
 				, pktCount
 				, pktLost
+				, octetLost
 				, fractLost
 				, jitter);
 		}
 
 
-		Thread::Thread( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & sock, const char * name )
+		Agent::Agent( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & sock, const char * name )
 		: _rtp( s )
 		, _sock( sock )
 		, _logName( s.getLogName() + string(" RTCP ") + name )
 		{
 			_flags.bag[ Status::RUNNING ] = false;
 			_flags.bag[ Status::PAUSED ] = false;
+			_flags.bag[ Status::SUSPENDED ] = false;
 		}
 
-		const char * Thread::getLogName() const throw()
+		const char * Agent::getLogName() const throw()
 		{
 			return _logName.c_str();
 		}
 
-		Thread::~Thread()
+		Agent::~Agent()
 		{
-			this->stop();
-		}
-
-		void Thread::start()
-		{
-			_th.lock();
-
-			this->_start();
-
-			if ( !_flags.bag[ Status::RUNNING ] )
-			{
-				_flags.bag[ Status::RUNNING ] = true;
-				_flags.bag[ Status::PAUSED ] = false;
-				_th.unlock();
-				_th.reset( new boost::thread(boost::bind(&Thread::run,this)) );
-			}
-			else if ( _flags.bag[ Status::PAUSED ] )
-			{
-				_flags.bag[ Status::PAUSED ] = false;
-				_th.unlock();
-				_wakeup.notify_all();
-			}
 		}
 
-		void Thread::doPause( OwnThread::Lock &lk )
+		void Agent::suspend()
 		{
-			while( _flags.bag[ Status::PAUSED ] )
-				NO_INTERRUPT( _wakeup.wait( lk ) )
-		}
-
-		void Thread::pause()
-		{
-			_th.lock();
-			if ( _flags.bag[ Status::RUNNING ] && ! _flags.bag[ Status::PAUSED ] )
 			{
-				_flags.bag[ Status::PAUSED ] = true;
-				_th.unlock();
-				_th.interrupt();
-			}
-			else
-				_th.unlock();
-		}
-
-		void Thread::unpause()
-		{
-			_th.lock();
-			if ( _flags.bag[ Status::RUNNING ] )
-			{
-				if ( _flags.bag[ Status::PAUSED ] )
-				{
-					_flags.bag[ Status::PAUSED ] = false;
-					_th.unlock();
-					_wakeup.notify_all();
-				}
-				else
-				{
-					_th.unlock();
-					_th.interrupt();
-				}
-			}
-			else
-				_th.unlock();
-		}
-
-		void Thread::stop()
-		{
-			if ( _th )
-			{
-				_th.lock();
-				if ( _flags.bag[ Status::RUNNING ] )
-				{
-					_flags.bag[ Status::RUNNING ] = false;
-
-					if ( _flags.bag[ Status::PAUSED ] )
-					{
-						_flags.bag[ Status::PAUSED ] = false;
-						_th.unlock();
-						_wakeup.notify_all();
-					}
-					else
-					{
-						_th.unlock();
-						_th.interrupt();
-					}
-				}
-				else
-					_th.unlock();
-
-				_th.reset();
+				Lock lk( _mux );
+				_flags.bag[ Status::SUSPENDED ] = true;
 			}
+			this->stop();
 		}
 
-
-		Stats Thread::getStats() const throw()
+		Stats Agent::getStats() const throw()
 		{
 			SafeStats::Lock lk( _stats );
 			return *_stats;
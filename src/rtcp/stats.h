@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     RTCP agents served by a shared scheduler and the poller instead of own threads
+ *     hibernation of long paused sessions
  *     testing against a "speed crash"
  *     testing against a "speed crash"
  *     introduced keep alive on control socket (me dumb)
@@ -41,8 +43,6 @@
 #include "lib/socket.h"
 #include "lib/utils/safe.hpp"
 
-#define NO_INTERRUPT( x ) 	{try { x; } catch( boost::thread_interrupted ) { Log::debug( "%s: interrupt !", getLogName() ); }}
-
 namespace KGD
 {
 	namespace RTP
@@ -61,6 +61,7 @@ namespace KGD
 			uint pktCount;
 			uint octetCount;
 			uint pktLost;
+			uint octetLost;
 			uint8_t fractLost;
 			uint highestSeqNo;
 			uint jitter;
@@ -74,8 +75,8 @@ namespace KGD
 		//! stats with own lock
 		typedef Safe::Lockable< Stats > SafeStats;
 
-		//! base RTCP thread (sender, receiver)
-		class Thread
+		//! base RTCP agent (sender, receiver), served by shared loops instead of an own thread
+		class Agent
 		: public boost::noncopyable
 		{
 		protected:
@@ -84,53 +85,41 @@ namespace KGD
 			//! socket abstraction
 			boost::shared_ptr< Channel::Bi > _sock;
 
-			typedef Safe::Thread< Mutex > OwnThread;
-			//! thread
-			OwnThread _th;
-
-			//! pause condition
-			Condition _wakeup;
-			
 			//! status flags
 			struct Status
 			{
-				enum Flags { RUNNING, PAUSED };
-				bitset< 2 > bag;
+				enum Flags { RUNNING, PAUSED, SUSPENDED };
+				bitset< 3 > bag;
 			} _flags;
+			//! protects flags
+			mutable Mutex _mux;
 
 			//! stats
 			SafeStats _stats;
 			//! log identifier
 			const string _logName;
 
-			
-			//! thread loop to implement
-			virtual void run() = 0;
-			//! additional actions to perform when starting
-			virtual void _start() {};
-			//! pause loop
-			void doPause( OwnThread::Lock &lk );
-
-
-			Thread( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & sock, const char * name );
+			Agent( RTP::Session & s, const boost::shared_ptr< Channel::Bi > & sock, const char * name );
 
 		public:
-			virtual ~Thread();
+			virtual ~Agent();
 
 			//! get log identifier
 			const char * getLogName() const throw();
 
-			//! start the thread
-			void start();
-			//! stop the thread
-			void stop();
-			//! pause the loop
-			void pause();
-			//! restart the loop
-			void unpause();
-
-			//! return sender stats
-			Stats getStats() const throw();
+			//! start
+			virtual void start() = 0;
+			//! stop
+			virtual void stop() = 0;
+			//! stop quietly, to be started again later
+			void suspend();
+			//! pause
+			virtual void pause() = 0;
+			//! restart after a pause
+			virtual void unpause() = 0;
+
+			//! return stats
+			virtual Stats getStats() const throw();
 		};
 
 		
@@ -0,0 +1,235 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtp/batch.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     channel feeds
+ *     shared frame feeds for sessions playing a medium together
+ *
+ **/
+
+
+#include "rtp/batch.h"
+#include "rtp/header.h"
+#include "rtsp/common.h"
+#include "lib/clock.h"
+#include "lib/log.h"
+
+namespace KGD
+{
+	namespace RTP
+	{
+		namespace Batch
+		{
+			auto_ptr< Packet::List > copyPackets( const Packet::List & packets, RTP::TTimestamp rtp, TSSrc ssrc, TCseq & seq ) throw()
+			{
+				auto_ptr< Packet::List > rt( new Packet::List );
+				BOOST_FOREACH( const Packet & p, packets )
+				{
+					auto_ptr< Packet > pkt( new Packet( p ) );
+					Header * h = reinterpret_cast< Header * >( pkt->data.get() );
+					h->seqNo = htons( ++ seq );
+					h->timestamp = htonl( rtp );
+					h->ssrc = htonl( ssrc );
+					rt->push_back( pkt );
+				}
+				return rt;
+			}
+
+			// ***********************************************************************************************
+
+			Feed::Feed( SDP::Medium::Base & m, double from ) throw( KGD::Exception::NotFound, KGD::Exception::OutOfBounds )
+			: _first( 0 )
+			, _nextMember( 0 )
+			, _created( Clock::getSec() )
+			, _fetching( false )
+			, _eof( false )
+			, _channel( m.isChannel() )
+			, _logName( ( _channel ? "CHANNEL " : "BATCH " ) + m.getTrackName() )
+			{
+				_buf.reset( Factory::ClassRegistry< Buffer::Base >::newInstance( m.getPayloadType() ) );
+				_buf->setMediumDescriptor( m );
+				_buf->setParentLogName( _logName );
+				_buf->seek( from, RTSP::PlayRequest::LINEAR_SCALE );
+				Log::debug( "%s: created at %lf", getLogName(), from );
+			}
+
+			Feed::~Feed()
+			{
+				_buf->stop();
+				Log::debug( "%s: %u frames fetched", getLogName(), _first + _entries.size() );
+			}
+
+			const char * Feed::getLogName() const throw()
+			{
+				return _logName.c_str();
+			}
+
+			bool Feed::isJoinable() throw()
+			{
+				KGD::Lock lk( _mux );
+				if ( _channel )
+					return !_eof;
+				else
+					return !_eof && _first == 0 && Clock::getSec() - _created <= Pool::JOIN_WINDOW;
+			}
+
+			size_t Feed::join( double from ) throw()
+			{
+				KGD::Lock lk( _mux );
+				size_t id = _nextMember ++;
+
+				// channel members start at the first frame not yet due, batch ones from the start
+				size_t pos = _first;
+				if ( _channel )
+					while( pos < _first + _entries.size() && _entries[ pos - _first ].frame->getTime() < from )
+						++ pos;
+
+				_members[ id ] = pos;
+				Log::debug( "%s: member %u joined, %u members", getLogName(), id, _members.size() );
+				return id;
+			}
+
+			void Feed::leave( size_t id ) throw()
+			{
+				{
+					KGD::Lock lk( _mux );
+					_members.erase( id );
+					Log::debug( "%s: member %u left, %u members", getLogName(), id, _members.size() );
+					this->trim();
+				}
+				_changed.notify_all();
+			}
+
+			void Feed::trim() throw()
+			{
+				// late comers start from the first frame, but in channels
+				if ( _members.empty() || ( !_channel && Clock::getSec() - _created <= Pool::JOIN_WINDOW ) )
+					return;
+
+				size_t slowest = _members.begin()->second;
+				for( map< size_t, size_t >::const_iterator it = _members.begin(); it != _members.end(); ++it )
+					slowest = min( slowest, it->second );
+
+				// the frame before the next one may be being sent
+				while( !_entries.empty() && _first + 1 < slowest )
+				{
+					_entries.front().frame->release();
+					_entries.pop_front();
+					++ _first;
+				}
+			}
+
+			Feed::Result Feed::next( size_t id, Entry & e ) throw()
+			{
+				KGD::Lock lk( _mux );
+				for(;;)
+				{
+					map< size_t, size_t >::iterator m = _members.find( id );
+					if ( m == _members.end() )
+						return LEFT;
+
+					if ( m->second < _first + _entries.size() )
+					{
+						e = _entries[ m->second - _first ];
+						++ m->second;
+						this->trim();
+						return FRAME;
+					}
+					else if ( _eof )
+						return END;
+					else if ( _fetching )
+						_changed.wait( lk );
+					else
+					{
+						// fetch and packetize once for everyone
+						_fetching = true;
+						Entry fetched;
+						{
+							Safe::UnLock ulk( lk );
+							fetched.frame.reset( _buf->tryNextFrame() );
+							if ( fetched.frame )
+							{
+								TCseq seq = 0;
+								try
+								{
+									fetched.packets.reset( fetched.frame->getPackets( 0, 0, seq ).release() );
+								}
+								catch( const KGD::Exception::Generic & ex )
+								{
+									Log::error( "%s: %s", getLogName(), ex.what() );
+									fetched.packets.reset( new Packet::List );
+								}
+							}
+						}
+						_fetching = false;
+
+						if ( fetched.frame )
+							_entries.push_back( fetched );
+						else
+							_eof = true;
+
+						Safe::UnLock ulk( lk );
+						_changed.notify_all();
+					}
+				}
+			}
+
+			// ***********************************************************************************************
+
+			double Pool::JOIN_WINDOW = 0;
+
+			Pool::Pool()
+			{
+			}
+
+			boost::shared_ptr< Feed > Pool::join( SDP::Medium::Base & m, double from, size_t & member ) throw( KGD::Exception::NotFound, KGD::Exception::OutOfBounds )
+			{
+				KGD::Lock lk( _mux );
+
+				// forget dead feeds
+				for( FeedMap::iterator it = _feeds.begin(); it != _feeds.end(); )
+					if ( it->second.expired() )
+						_feeds.erase( it ++ );
+					else
+						++ it;
+
+				boost::shared_ptr< Feed > feed;
+				FeedMap::iterator it = _feeds.find( &m );
+				if ( it != _feeds.end() )
+					feed = it->second.lock();
+
+				if ( !feed || !feed->isJoinable() )
+				{
+					feed.reset( new Feed( m, from ) );
+					_feeds[ &m ] = feed;
+				}
+
+				member = feed->join( from );
+				return feed;
+			}
+		}
+	}
+}
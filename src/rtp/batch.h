@@ -0,0 +1,143 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtp/batch.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     channel feeds
+ *     shared frame feeds for sessions playing a medium together
+ *
+ **/
+
+
+#ifndef __KGD_RTP_BATCH
+#define __KGD_RTP_BATCH
+
+#include "rtp/buffer.h"
+#include "rtp/packet.h"
+#include "lib/utils/singleton.hpp"
+
+#include <boost/weak_ptr.hpp>
+
+#include <deque>
+#include <map>
+
+namespace KGD
+{
+	namespace RTP
+	{
+		//! sessions starting the same medium close in time share fetched and packetized frames
+		namespace Batch
+		{
+			//! a frame with its packets, built once for every session
+			struct Entry
+			{
+				//! the frame
+				boost::shared_ptr< RTP::Frame::Base > frame;
+				//! packets with blank sequence number, timestamp and ssrc
+				boost::shared_ptr< const Packet::List > packets;
+			};
+
+			//! copies the packets of an entry setting session timestamp, ssrc and sequence numbers
+			auto_ptr< Packet::List > copyPackets( const Packet::List &, RTP::TTimestamp, TSSrc, TCseq & ) throw();
+
+			//! frames fetched from the start of a medium, or from the channel time, by a single buffer, read by many sessions
+			class Feed
+			: public boost::noncopyable
+			{
+			public:
+				//! outcome of a read
+				enum Result { FRAME, END, LEFT };
+			private:
+				//! the shared buffer
+				boost::scoped_ptr< Buffer::Base > _buf;
+				//! fetched frames not yet read by every member
+				deque< Entry > _entries;
+				//! position of the first entry
+				size_t _first;
+				//! next position to read, by member
+				map< size_t, size_t > _members;
+				//! next member identifier
+				size_t _nextMember;
+				//! creation time
+				double _created;
+				//! a member is fetching from the buffer
+				bool _fetching;
+				//! buffer has no more frames
+				bool _eof;
+				//! channel feed: members join at the current time, whenever they come
+				bool _channel;
+				//! protects the feed
+				KGD::Mutex _mux;
+				//! signals a new entry or a member leaving
+				Condition _changed;
+				//! log identifier
+				string _logName;
+
+				//! drops the entries every member has gone past; lock must be held
+				void trim() throw();
+			public:
+				//! start fetching a medium from a given time
+				Feed( SDP::Medium::Base &, double ) throw( KGD::Exception::NotFound, KGD::Exception::OutOfBounds );
+				//! stops fetching
+				~Feed();
+
+				//! tells if a new session can still start from the beginning, or from the channel time
+				bool isJoinable() throw();
+				//! adds a member starting at a given time, returning its identifier
+				size_t join( double ) throw();
+				//! removes a member
+				void leave( size_t ) throw();
+				//! reads the next entry of a member, waiting for it
+				Result next( size_t, Entry & ) throw();
+
+				//! returns log identifier
+				const char * getLogName() const throw();
+			};
+
+			//! feeds by medium
+			class Pool
+			: public Singleton::Class< Pool >
+			{
+			private:
+				typedef map< const SDP::Medium::Base *, boost::weak_ptr< Feed > > FeedMap;
+				//! feeds still alive
+				FeedMap _feeds;
+				//! protects the feeds
+				KGD::Mutex _mux;
+				//! ctor
+				Pool();
+				friend class Singleton::Class< Pool >;
+			public:
+				//! seconds after the first session when others can still join; 0 disables batching
+				static double JOIN_WINDOW;
+
+				//! returns a joinable feed of a medium, created if needed, adding a member starting at a given time to it
+				boost::shared_ptr< Feed > join( SDP::Medium::Base &, double, size_t & member ) throw( KGD::Exception::NotFound, KGD::Exception::OutOfBounds );
+			};
+		}
+	}
+}
+
+#endif
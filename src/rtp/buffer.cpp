@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     hibernation of long paused sessions
+ *     key frame trick play
+ *     prefill before play
+ *     end of stream without exceptions
+ *     frames fetched in batches
+ *     insertions go to the iterator edit list
  *     threads terminate with wait + join
  *     testing against a "speed crash"
  *     english comments; removed leak with connection serving threads
@@ -51,12 +58,14 @@ namespace KGD
 
 			double Base::SIZE_LOW = 1.0;
 			double Base::SIZE_FULL = HUGE_VAL;
+			double Base::SCALE_LIMIT = 1.0;
+			double Base::SCALE_STEP = 0.25;
 
 			Base::Base ( SDP::Medium::Base & sdp )
 			: _medium( sdp )
 			, _scale( RTSP::PlayRequest::LINEAR_SCALE )
 			{
-				_frame.idx.reset( _medium->newFrameIterator() );
+				_frame.idx.reset( new SDP::Medium::Iterator::Edit( _medium->newFrameIterator() ) );
 			}
 
 			Base::Base( )
@@ -78,7 +87,7 @@ namespace KGD
 			{
 				Frame::Lock lk( _frame );
 				_medium = sdp;
-				_frame.idx.reset( sdp.newFrameIterator() );
+				_frame.idx.reset( new SDP::Medium::Iterator::Edit( sdp.newFrameIterator() ) );
 			}
 
 			Base::~Base()
@@ -109,7 +118,9 @@ namespace KGD
 			double Base::getFirstFrameTime() const throw( KGD::Exception::OutOfBounds )
 			{
 				Frame::Lock lk( _frame );
-				return _frame.idx->at( 0 ).getTime();
+				double rt = _frame.idx->at( 0 ).getTime();
+				_frame.idx->unpin();
+				return rt;
 			}
 
 			double Base::getOutBufferTimeSize() const
@@ -118,7 +129,7 @@ namespace KGD
 				if ( b.size() <= 0 )
 					return 0.0;
 				else
-					return (b.back().getTime() - b.front().getTime()) * _scale;
+					return (b.back().getTime() - b.front().getTime()) / _scale;
 			}
 
 
@@ -140,15 +151,53 @@ namespace KGD
 				Frame::Lock lk( _frame );
 
 				size_t pos = _frame.idx->pos();
-				double rt = _frame.idx->seek( t ).getTime();
+				double rt = _frame.idx->seek( t ).getTime() + _frame.idx->getTimeShift();
 				_frame.idx->seek( pos );
+				_frame.idx->unpin();
 
 				return rt;
 			}
 
-			Base::Frame::Fetch Base::fetchNextFrame()
+			bool Base::fetchNextFrame( Frame::Fetch & next )
+			{
+				const SDP::Frame::Base * f;
+				if ( ! ( _scale >= 0 ? _frame.idx->tryNext( f ) : _frame.idx->tryPrev( f ) ) )
+					return false;
+
+				next = *f;
+				return true;
+			}
+
+			bool Base::fetchNextFrames( Frame::Batch & out ) throw( KGD::Exception::OutOfBounds )
+			{
+				if ( _scale > 0 && _scale <= 1.0 )
+					return _frame.idx->nextBatch( FETCH_BATCH, out ) > 0;
+				else
+				{
+					Frame::Fetch next;
+					if ( ! this->fetchNextFrame( next ) )
+						return false;
+					if ( next )
+						out.push_back( &*next );
+					return true;
+				}
+			}
+
+			double Base::getFetchShift() const
+			{
+				return _frame.idx->getTimeShift();
+			}
+
+			void Base::prefill( double ) throw( KGD::Exception::OutOfBounds )
+			{
+			}
+
+			void Base::drop()
 			{
-				return ( _scale >= 0 ? _frame.idx->next() : _frame.idx->prev() );
+				this->stop();
+
+				Frame::Lock lk( _frame );
+				this->clear();
 			}
 
 			bool Base::isBufferLow() const
@@ -165,12 +214,14 @@ namespace KGD
 			AVFrame::AVFrame()
 			: Buffer::Base( )
 			, _running( false )
+			, _prefill( HUGE_VAL )
 			{
 			}
 
 			AVFrame::AVFrame ( SDP::Medium::Base & sdp )
 			: Buffer::Base ( sdp )
 			, _running( false )
+			, _prefill( HUGE_VAL )
 			{
 			}
 
@@ -239,35 +290,47 @@ namespace KGD
 						while ( _running && this->isBufferFull() )
 							_frame.buf.empty.wait ( lk );
 
-						if ( _running )
+						if ( ! _running )
 						{
-							auto_ptr< RTP::Frame::Base > newFrame;
-							// seek lock / give way
-							_th.yield( lk );
-							// fetch
-							Frame::Fetch next = this->fetchNextFrame();
-							if ( next )
-								try
-								{
-									newFrame.reset( Factory::ClassRegistry< RTP::Frame::Base >::newInstance( next->getPayloadType() ) );
-									newFrame->setFrame( *next );
-									newFrame->setTimeShift( _frame.idx->getTimeShift() );
-									_frame.buf.data.push_back ( newFrame );
-								}
-								catch( const KGD::Exception::Generic & e )
-								{
-									Log::error( "%s: %s", getLogName(), e.what() );
-								}
-
-							// signal frames
-							if ( !this->isBufferLow() )
+							Log::warning( "%s: EOF", getLogName() );
+							break;
+						}
+
+						// seek lock / give way
+						_th.yield( lk );
+						// fetch
+						Frame::Batch next;
+						if ( ! this->fetchNextFrames( next ) )
+						{
+							Log::warning( "%s: end of medium", getLogName() );
+							_running = false;
+							break;
+						}
+						// a batch shares the same time shift
+						double shift = this->getFetchShift();
+						BOOST_FOREACH( const SDP::Frame::Base * f, next )
+						{
+							try
 							{
-								Frame::UnLock ulk( lk );
-								_frame.buf.full.notify_all();
+								auto_ptr< RTP::Frame::Base > newFrame( Factory::ClassRegistry< RTP::Frame::Base >::newInstance( f->getPayloadType() ) );
+								newFrame->setFrame( *f );
+								newFrame->setTimeShift( shift );
+								_frame.buf.data.push_back ( newFrame );
+							}
+							catch( const KGD::Exception::Generic & e )
+							{
+								Log::error( "%s: %s", getLogName(), e.what() );
 							}
 						}
-						else
-							throw RTP::Eof();
+						// RTP frames hold their own references now
+						_frame.idx->unpin();
+
+						// signal frames
+						if ( !this->isBufferLow() )
+						{
+							Frame::UnLock ulk( lk );
+							_frame.buf.full.notify_all();
+						}
 					}
 				}
 				catch( const KGD::Exception::OutOfBounds & e )
@@ -275,17 +338,13 @@ namespace KGD
 					Log::warning( "%s: %s", getLogName(), e.what() );
 					_running = false;
 				}
-				catch( RTP::Eof )
-				{
-					Log::warning( "%s: EOF", getLogName() );
-				}
 
 				Log::debug( "%s: thread term sync", getLogName() );
 				_frame.buf.full.notify_all();
 				_th.wait();
 			}
 
-			Frame::AVMedia* AVFrame::getNextFrame() throw( RTP::Eof )
+			Frame::AVMedia* AVFrame::tryNextFrame() throw()
 			{
 				Frame::Lock lk( _frame );
 
@@ -294,29 +353,50 @@ namespace KGD
 					// let's wait some data
 					while ( _running && this->isBufferLow() )
 						_frame.buf.full.wait ( lk );
+				}
+				catch( boost::thread_interrupted )
+				{
+					return 0;
+				}
 
-					if ( _frame.buf.data.empty() )
-						throw RTP::Eof();
+				if ( _frame.buf.data.empty() )
+					return 0;
+
+				Frame::List::auto_type result = _frame.buf.data.pop_front();
+				// if buffer size is low, fetch thread must be awakened
+				if ( _running && this->isBufferLow() )
+				{
+					Frame::UnLock ulk( lk );
+					_frame.buf.empty.notify_all();
+				}
+
+				return result.release()->asPtrUnsafe< RTP::Frame::AVMedia >();
+			}
+
+			void AVFrame::seek ( double t, double scale ) throw( KGD::Exception::OutOfBounds )
+			{
+				{
+					Frame::Lock lk( _frame );
+
+					// frames fetched since setup are the right ones
+					if ( _prefill == t && _scale == scale )
+						Log::debug("%s: using frames prefilled at %lf", getLogName(), t );
 					else
 					{
-						Frame::List::auto_type result = _frame.buf.data.pop_front();
-						// if buffer size is low, fetch thread must be awakened
-						if ( _running && this->isBufferLow() )
-						{
-							Frame::UnLock ulk( lk );
-							_frame.buf.empty.notify_all();
-						}
+						this->clear();
+
+						_frame.idx->seek( t );
+						_frame.idx->unpin();
+						_scale  = scale;
 
-						return result.release()->asPtrUnsafe< RTP::Frame::AVMedia >();
+						Log::debug("%s: seeked at %lf x %0.2lf", getLogName(), t, scale );
 					}
+					_prefill = HUGE_VAL;
 				}
-				catch( boost::thread_interrupted )
-				{
-					throw RTP::Eof();
-				}
+				this->start();
 			}
 
-			void AVFrame::seek ( double t, double scale ) throw( KGD::Exception::OutOfBounds )
+			void AVFrame::prefill( double t ) throw( KGD::Exception::OutOfBounds )
 			{
 				{
 					Frame::Lock lk( _frame );
@@ -324,9 +404,11 @@ namespace KGD
 					this->clear();
 
 					_frame.idx->seek( t );
-					_scale  = scale;
+					_frame.idx->unpin();
+					_scale = 1.0;
+					_prefill = t;
 
-					Log::debug("%s: seeked at %lf x %0.2lf", getLogName(), t, scale );
+					Log::debug("%s: prefilling at %lf", getLogName(), t );
 				}
 				this->start();
 			}
@@ -355,19 +437,18 @@ namespace KGD
 					return ( _running && _scale < 0.0 ) || Buffer::Base::isBufferFull();
 				}
 
-				Base::Frame::Fetch Base::fetchNextFrame()
+				bool Base::fetchNextFrame( Frame::Fetch & next )
 				{
-					ref< const SDP::Frame::Base > rt;
-
 					if ( _scale > 0.0 )
 					{
 						size_t n = 0;
 						do
-							rt = Buffer::Base::fetchNextFrame();
+							if ( ! Buffer::Base::fetchNextFrame( next ) )
+								return false;
 						while ( _scale > 2.0 && ++ n < _scale );
 					}
 
-					return rt;
+					return true;
 				}
 			}
 			
@@ -377,42 +458,77 @@ namespace KGD
 			{
 				Base::Base()
 				: AVFrame::AVFrame( )
-				, _lastKeyTime( -1 )
+				, _trickTime( HUGE_VAL )
+				, _trickShift( HUGE_VAL )
 				{
 				}
 
 				Base::Base ( SDP::Medium::Base & sdp )
 				: AVFrame::AVFrame ( sdp )
-				, _lastKeyTime( -1 )
+				, _trickTime( HUGE_VAL )
+				, _trickShift( HUGE_VAL )
 				{
 				}
 
 				void Base::clear()
 				{
 					Buffer::Base::clear();
-					_lastKeyTime = -1;
+					_trickTime = HUGE_VAL;
+					_trickShift = HUGE_VAL;
+				}
+
+				bool Base::fetchNextFrame( Frame::Fetch & next )
+				{
+					// every frame up to the scale limit
+					if ( _scale > 0 && _scale <= SCALE_LIMIT )
+						return Buffer::Base::fetchNextFrame( next );
+
+					// else one key frame every step of play time whatever the scale, without walking the frames in between:
+					// the nearest to when it is due, so key frames are skipped or repeated to hold the cadence
+					bool forward = ( _scale > 0 );
+					if ( _trickTime == HUGE_VAL )
+						_trickTime = _frame.idx->curr().getTime() + _frame.idx->getTimeShift();
+					else
+						_trickTime += SCALE_STEP * _scale;
+
+					// past either end: end of play
+					if ( _trickTime < 0 || _trickTime >= _frame.idx->duration() )
+						return false;
+
+					ref< const SDP::Frame::Base > rt;
+					try
+					{
+						rt = _frame.idx->seekKey( _trickTime, forward );
+					}
+					catch( const KGD::Exception::OutOfBounds & )
+					{
+						// no key frame ahead in the last group of pictures
+						return false;
+					}
+					double keyTime = rt->getTime() + _frame.idx->getTimeShift();
+					try
+					{
+						ref< const SDP::Frame::Base > behind( _frame.idx->seekKey( _trickTime, !forward ) );
+						double behindTime = behind->getTime() + _frame.idx->getTimeShift();
+						if ( fabs( behindTime - _trickTime ) < fabs( keyTime - _trickTime ) )
+						{
+							rt = behind;
+							keyTime = behindTime;
+						}
+					}
+					catch( const KGD::Exception::OutOfBounds & )
+					{
+					}
+					_trickShift = _trickTime - rt->getTime();
+
+					Log::verbose( "%s: trick play key frame at %lf for %lf", getLogName(), keyTime, _trickTime );
+					next = rt;
+					return true;
 				}
 
-				Base::Frame::Fetch Base::fetchNextFrame()
+				double Base::getFetchShift() const
 				{
-					ref< const SDP::Frame::MediaFile > rt;
-					size_t n = 0;
-					do
-						rt = Buffer::Base::fetchNextFrame()->as< SDP::Frame::MediaFile >();
-						// in speed (0,1] everything is fetched
-						// above or below, one every scale
-						// above or below, only distanced key frames
-					while ( !
-						(	( _scale > 0 && _scale <= 1.0 )
-						|| 	( rt->isKey() && ++ n < _scale )
-// 						|| 	( rt->isKey() && ( _lastKeyTime < 0 || ( rt->getTime() - _lastKeyTime ) / _scale >= 0.2 ) )
-						)
-					);
-					
-// 					if ( rt->isKey() )
-// 						_lastKeyTime = rt->getTime();
-
-					return rt;
+					return ( _trickShift == HUGE_VAL ? Buffer::Base::getFetchShift() : _trickShift );
 				}
 			}
 		}
@@ -25,6 +25,12 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     hibernation of long paused sessions
+ *     key frame trick play
+ *     prefill before play
+ *     end of stream without exceptions
+ *     frames fetched in batches
+ *     insertions go to the iterator edit list
  *     repo content is fine and working again
  *     boosted
  *     source import
@@ -48,13 +54,6 @@ namespace KGD
 {
 	namespace RTP
 	{
-		//! Stream ended
-		class Eof: public Exception::Generic
-		{
-		public:
-			Eof() : Exception::Generic("stream data terminated")  {}
-		};
-
 		//! pre-buffers
 		namespace Buffer
 		{
@@ -70,8 +69,10 @@ namespace KGD
 				static double SIZE_LOW;
 				//! Limite di velocita' oltre il quale si cominciano a mandare solo iframe
 				static double SCALE_LIMIT;
-				//! Distanza minima fra due iframe successivi una volta superato scale_limit
+				//! Distanza in secondi di riproduzione fra due iframe successivi una volta superato scale_limit
 				static double SCALE_STEP;
+				//! frames fetched at once at normal speed
+				static const size_t FETCH_BATCH = 64;
 					
 			protected:
 				//! medium descriptor
@@ -82,9 +83,10 @@ namespace KGD
 				: public Safe::LockableBase< RMutex >
 				{
 				public:
-					typedef boost::scoped_ptr< SDP::Medium::Iterator::Base > Index;
+					typedef boost::scoped_ptr< SDP::Medium::Iterator::Edit > Index;
 					typedef boost::ptr_list< RTP::Frame::Base > List;
 					typedef ref< const SDP::Frame::Base > Fetch;
+					typedef SDP::Medium::Iterator::Batch Batch;
 					//! frame iterator
 					Index idx;
 					//! out frame buffer
@@ -115,8 +117,12 @@ namespace KGD
 				virtual bool isBufferLow() const;
 				//! tells if buffer size is above the "full"
 				virtual bool isBufferFull() const;
-				//! get next frame
-				virtual Frame::Fetch fetchNextFrame();
+				//! get next frame, if any to play; false at the end
+				virtual bool fetchNextFrame( Frame::Fetch & );
+				//! get next frames, in batches when every frame is played, one by one through fetchNextFrame otherwise; false at the end
+				virtual bool fetchNextFrames( Frame::Batch & ) throw( KGD::Exception::OutOfBounds );
+				//! time shift of the frames last fetched
+				virtual double getFetchShift() const;
 
 				//! void ctor
 				Base();
@@ -133,17 +139,19 @@ namespace KGD
 				//! get log identifier
 				const char * getLogName() const throw();
 
-				//! inserts another medium in the current one, starting not before time t
+				//! inserts another medium in this playback only, starting not before time t
 				virtual void insertMedium( SDP::Medium::Base &, double t ) throw( KGD::Exception::OutOfBounds );
-				//! inserts a delay in the current medium, starting not before time t
+				//! inserts a delay in this playback only, starting not before time t
 				virtual void insertTime( double duration, double t ) throw( KGD::Exception::OutOfBounds );
 
 				//! tells actual seek time without doing anything
 				virtual double drySeek(double t, double scale) throw( KGD::Exception::OutOfBounds );
 				//! seek to new position / speed
 				virtual void seek( double t, double scale ) throw( KGD::Exception::OutOfBounds ) = 0;
-				//! get next frame in out buffer
-				virtual RTP::Frame::Base * getNextFrame() throw( RTP::Eof ) = 0;
+				//! start filling from a position at normal speed, before play; a seek there keeps the frames
+				virtual void prefill( double t ) throw( KGD::Exception::OutOfBounds );
+				//! get next frame in out buffer, 0 at the end
+				virtual RTP::Frame::Base * tryNextFrame() throw() = 0;
 
 				//! get time of first frame
 				virtual double getFirstFrameTime() const throw( KGD::Exception::OutOfBounds );
@@ -152,6 +160,8 @@ namespace KGD
 				virtual void start() = 0;
 				//! stop frame fetch
 				virtual void stop() = 0;
+				//! stop frame fetch and free fetched frames; a seek starts over
+				virtual void drop();
 			};
 
 			//! Frame threaded buffer
@@ -164,6 +174,8 @@ namespace KGD
 				OwnThread _th;
 				//! running status indicator
 				bool _running;
+				//! position the buffer has been prefilled from, HUGE_VAL if none
+				double _prefill;
 
 				//! fetch loop
 				void fetch();
@@ -185,7 +197,8 @@ namespace KGD
 				//!@{
 				//! base buffer implementation
 				virtual void seek(double t, double scale) throw( KGD::Exception::OutOfBounds );
-				virtual RTP::Frame::AVMedia * getNextFrame() throw( RTP::Eof );
+				virtual void prefill( double t ) throw( KGD::Exception::OutOfBounds );
+				virtual RTP::Frame::AVMedia * tryNextFrame() throw();
 				//!@}
 			};
 
@@ -201,7 +214,7 @@ namespace KGD
 					//! yes on negative speed
 					virtual bool isBufferFull() const;
 					//! one every scale, only for positive speed
-					virtual Frame::Fetch fetchNextFrame();
+					virtual bool fetchNextFrame( Frame::Fetch & );
 
 					//! only derived classes can build without params - factory constraint
 					Base();
@@ -219,9 +232,14 @@ namespace KGD
 				: public AVFrame
 				{
 				protected:
-					double _lastKeyTime;
-					//! get next frame: only key frames when speedy
-					virtual Frame::Fetch fetchNextFrame();
+					//! play time the next trick play frame is due at, HUGE_VAL if none
+					double _trickTime;
+					//! time shift putting the last trick play frame at its due time, HUGE_VAL if none
+					double _trickShift;
+					//! get next frame: every frame up to the scale limit, else the key frame nearest to each step
+					virtual bool fetchNextFrame( Frame::Fetch & );
+					//! trick play frames are stamped at their due time
+					virtual double getFetchShift() const;
 					//! reset last key time
 					virtual void clear();
 					//! only derived classes can build without params - factory constraint
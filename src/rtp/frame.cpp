@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     payload lookup without exceptions
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     source import
@@ -47,6 +49,16 @@ namespace KGD
 			: _frame( f )
 			, _shift( 0 )
 			{
+				f.addRef();
+			}
+
+			Base::Base( const Base & b )
+			: Factory::Base( b )
+			, _frame( b._frame )
+			, _shift( b._shift )
+			{
+				if ( _frame )
+					_frame->addRef();
 			}
 
 			Base::Base()
@@ -54,6 +66,12 @@ namespace KGD
 			{
 			}
 
+			Base::~Base()
+			{
+				if ( _frame )
+					SDP::Frame::Base::unRef( _frame.getPtr() );
+			}
+
 			void Base::setTimeShift( double s ) throw()
 			{
 				_shift = s;
@@ -69,21 +87,31 @@ namespace KGD
 				return _frame->getMediumPos();
 			}
 
+			void Base::release() const throw( KGD::Exception::NullPointer )
+			{
+				_frame->release();
+			}
+
 			void Base::setFrame( const SDP::Frame::Base & f ) throw( KGD::Exception::InvalidType )
 			{
+				f.addRef();
+				if ( _frame )
+					SDP::Frame::Base::unRef( _frame.getPtr() );
 				_frame = f;
 			}
 
-			const ByteArray & Base::getData() const throw( KGD::Exception::NotFound )
+			const Arena::Slice & Base::getData() const throw( KGD::Exception::NotFound )
 			{
-				try
-				{
-					return _frame->as< SDP::Frame::MediaFile >().data;
-				}
-				catch( bad_cast )
-				{
+				if ( const Arena::Slice * d = this->findData() )
+					return *d;
+				else
 					throw KGD::Exception::NotFound( "frame payload data" );
-				}
+			}
+
+			const Arena::Slice * Base::findData() const throw()
+			{
+				const SDP::Frame::MediaFile * mf = _frame->asPtrUnsafe< SDP::Frame::MediaFile >();
+				return ( mf ? &mf->data : 0 );
 			}
 
 			auto_ptr< Packet::List > Base::getPackets( RTP::TTimestamp rtp, TSSrc ssrc, TCseq & seq ) throw( KGD::Exception::Generic )
@@ -95,9 +123,13 @@ namespace KGD
 
 				auto_ptr< Packet::List > rt( new Packet::List );
 
+				const Arena::Slice * myData = this->findData();
+				if ( ! myData )
+					return rt;
+
 				size_t payloadSize = Packet::MTU - Header::SIZE;
-				size_t packetized = 0, tot = this->getData().size();
-				const unsigned char* payload = this->getData().get();
+				size_t packetized = 0, tot = myData->size();
+				const unsigned char* payload = myData->get();
 
 				while( packetized < tot )
 				{
@@ -115,7 +147,8 @@ namespace KGD
 					packetized += copySize;
 					rt->push_back( pkt );
 				}
-				rt->back().isLastOfSequence = true;
+				if ( ! rt->empty() )
+					rt->back().isLastOfSequence = true;
 				return rt;
 			}
 
@@ -146,7 +179,7 @@ namespace KGD
 
 			void AVMedia::setFrame( const SDP::Frame::Base & f ) throw( KGD::Exception::InvalidType )
 			{
-				_frame = f;
+				Base::setFrame( f );
 
 				try
 				{
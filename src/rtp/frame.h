@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     payload lookup without exceptions
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     source import
@@ -66,18 +68,26 @@ namespace KGD
 				Base();
 				//! construct from a frame description
 				Base( const SDP::Frame::Base & );
+				//! copy, referencing the same frame description
+				Base( const Base & );
+				//! drop reference to frame description
+				virtual ~Base();
 				//! packetize at a certain rtp time, for a ssrc, and update cseq
 				virtual auto_ptr< Packet::List > getPackets( RTP::TTimestamp , uint32_t , TCseq & ) throw( KGD::Exception::Generic );
 				//! get frame time
 				double getTime() const throw( KGD::Exception::NullPointer );
 				//! get frame position in medium array
 				size_t getMediumPos() const throw( KGD::Exception::NullPointer );
-				//! set reference to a frame description
+				//! tell the medium owning the frame description it has been sent
+				void release() const throw( KGD::Exception::NullPointer );
+				//! set reference to a frame description, keeping it alive until this frame is done with it
 				virtual void setFrame( const SDP::Frame::Base & ) throw( KGD::Exception::InvalidType );
 				//! set reference to a frame description
 				virtual void setTimeShift( double ) throw( );
 				//! get frame data if any
-				virtual const ByteArray & getData() const throw( KGD::Exception::NotFound );
+				virtual const Arena::Slice & getData() const throw( KGD::Exception::NotFound );
+				//! get frame data, 0 if none
+				const Arena::Slice * findData() const throw();
 			};
 
 			//! audio / video medium frame
@@ -25,6 +25,15 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     no port release on shared server sockets
+ *     rtcp-mux
+ *     RTCP sender started by the session, no more restart barrier
+ *     frames skipped while the channel backlog is too long
+ *     non key frames may be dropped by congested channels
+ *     frame packets written at once, flushed per send burst
+ *     hibernation of long paused sessions
+ *     vod batching
+ *     prefill at setup, first packet latency
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     fixed RTSP buffer enqueue
  *     "would block" cleanup
@@ -51,9 +60,23 @@ namespace KGD
 
 	namespace RTP
 	{
+		double Session::HIBERNATE_AFTER = 0;
+		double Session::MAX_BACKLOG = 1.0;
+
 		Session::Pause::Pause()
 		: asleep(2)
 		, sync(false)
+		, resumeAt(HUGE_VAL)
+		{
+		}
+
+		Session::Congestion::Congestion()
+		: lvl( NONE )
+		, waitKey( false )
+		, count( 0 )
+		, rate( 0 )
+		, bytes( 0 )
+		, from( HUGE_VAL )
 		{
 		}
 
@@ -90,8 +113,11 @@ namespace KGD
 			_status.bag[ Status::PAUSED ] = false;
 			_status.bag[ Status::STOPPED ] = true;
 			_status.bag[ Status::SEEKED ] = false;
+			_status.bag[ Status::HIBERNATED ] = false;
 
 			_frame.firstLost = HUGE_VAL;
+			_frame.playAt = HUGE_VAL;
+			_frame.member = 0;
 			_frame.time.reset( Factory::ClassRegistry< Timeline::Medium >::newInstance( agent ) );
 			_frame.buf.reset( Factory::ClassRegistry< Buffer::Base >::newInstance( sdp.getPayloadType() ) );
 			
@@ -100,6 +126,19 @@ namespace KGD
 
 			_frame.time->setRate( sdp.getRate() );
 
+			// frames are ready when play comes
+			if ( ! sdp.isLiveCast() )
+			{
+				try
+				{
+					_frame.buf->prefill( 0.0 );
+				}
+				catch( const KGD::Exception::OutOfBounds & e )
+				{
+					Log::warning( "%s: no prefill: %s", getLogName(), e.what() );
+				}
+			}
+
 			_rtcp.start( *this );
 
 			this->seqRestart();
@@ -111,11 +150,13 @@ namespace KGD
 			
 			this->teardown( RTSP::PlayRequest() );
 
-			// release UDP ports if needed
+			// release UDP ports if needed, a single one if RTCP is muxed, none on server sockets
 			Channel::Description
 				rtpDesc = _sock->getDescription(),
 				rtcpDesc = _rtcp.sock->getDescription();
-			if ( rtpDesc.type == Channel::Owned && rtcpDesc.type == Channel::Owned )
+			if ( rtpDesc.pooled )
+				Log::debug( "%s: on server sockets, no ports to release", getLogName() );
+			else if ( rtpDesc.type == Channel::Owned && rtcpDesc.type == Channel::Owned )
 			{
 				RTSP::Port::Udp::getInstance()->release( TPortPair( rtpDesc.ports.first, rtcpDesc.ports.first ) );
 				Log::debug( "%s: releasing port pair (%u, %u)", getLogName(), rtpDesc.ports.first, rtcpDesc.ports.first );
@@ -148,12 +189,12 @@ namespace KGD
 			return _medium;
 		}
 
-		double Session::fetchNextFrame( OwnThread::Lock & lk) throw( RTP::Eof )
+		bool Session::fetchNextFrame( OwnThread::Lock & lk, double & ft ) throw()
 		{
 
 			try
 			{
-				auto_ptr< RTP::Frame::Base > tmp;
+				Batch::Entry next;
 
 				if ( _status.bag[ Status::SEEKED ] )
 				{
@@ -169,8 +210,13 @@ namespace KGD
 						OwnThread::UnLock ulk( lk );
 						for(;;)
 						{
-							tmp.reset( _frame.buf->getNextFrame() );
-							fTime = tmp->getTime();
+							next.frame.reset( _frame.buf->tryNextFrame() );
+							if ( ! next.frame )
+							{
+								this->dropNextFrame();
+								return false;
+							}
+							fTime = next.frame->getTime();
 							double sendIn = (fTime - now) / spd;
 
 							if ( sendIn > 1 )
@@ -193,24 +239,67 @@ namespace KGD
 				}
 				else
 				{
+					boost::shared_ptr< Batch::Feed > batch = _frame.batch;
+					size_t member = _frame.member;
 					OwnThread::UnLock ulk( lk );
-					tmp.reset( _frame.buf->getNextFrame() );
+					if ( ! this->readFrame( batch, member, next ) )
+					{
+						this->dropNextFrame();
+						return false;
+					}
 				}
 
-				// release sent frame
-				if ( _frame.next )
-					_medium.releaseFrame( _frame.next->getMediumPos() );
+				// release sent frame; batched ones are released by their feed
+				if ( _frame.next && !_frame.packets )
+					_frame.next->release();
 				// update frame to send
-				_frame.next.reset( tmp.release() );
+				_frame.next = next.frame;
+				_frame.packets = next.packets;
 
-				return _frame.next->getTime();
+				ft = _frame.next->getTime();
+				return true;
 			}
 			catch( KGD::Exception::Generic const & e )
 			{
 				Log::error( "%s: %s", getLogName(), e.what() );
-				_frame.next.reset();
+				this->dropNextFrame();
+				return false;
+			}
+		}
 
-				throw;
+		void Session::dropNextFrame() throw()
+		{
+			_frame.next.reset();
+			_frame.packets.reset();
+		}
+
+		bool Session::readFrame( boost::shared_ptr< Batch::Feed > batch, size_t member, Batch::Entry & rt ) throw()
+		{
+			if ( batch )
+			{
+				switch( batch->next( member, rt ) )
+				{
+				case Batch::Feed::FRAME:
+					return true;
+				case Batch::Feed::END:
+					return false;
+				case Batch::Feed::LEFT:
+					// left meanwhile, own buffer has been positioned
+					break;
+				}
+			}
+
+			rt.frame.reset( _frame.buf->tryNextFrame() );
+			return rt.frame.get() != 0;
+		}
+
+		void Session::leaveBatch() throw()
+		{
+			if ( _frame.batch )
+			{
+				Log::debug( "%s: leaving batch %s", getLogName(), _frame.batch->getLogName() );
+				_frame.batch->leave( _frame.member );
+				_frame.batch.reset();
 			}
 		}
 
@@ -222,9 +311,10 @@ namespace KGD
 
 				uint64_t slp = 0;
 				double now = 0, spd = 0;
-				double ft = this->fetchNextFrame( lk ) ;
-				_rtcp.sender->restart();
-				_rtcp.sender->wait();
+				double ft = 0;
+				this->fetchNextFrame( lk, ft );
+				// sender reports go along, first packet does not wait for them
+				_rtcp.sender->start();
 
 				// main loop
 				while (!_status.bag[ Status::STOPPED ])
@@ -246,24 +336,30 @@ namespace KGD
 						}
 
 						// wait wakeup
-						_pause.wakeup.wait( lk );
+						if ( ! _status.bag[ Status::HIBERNATED ] )
+							_pause.wakeup.wait( lk );
+
+						// leave the thread, state is kept
+						if ( _status.bag[ Status::HIBERNATED ] )
+							break;
 
 						Log::verbose( "%s: wakeup from pause", getLogName() );
 						if ( ! _status.bag[ Status::STOPPED ] )
 						{
 							Log::verbose( "%s: awaking RTCP receiver", getLogName() );
 							_rtcp.receiver->unpause();
-							_rtcp.sender->restart();
-							Log::verbose( "%s: waiting RTCP sender", getLogName() );
-							_rtcp.sender->wait();
+							_rtcp.sender->unpause();
 							_frame.rate.start();
 						}
 					}
+					if ( _status.bag[ Status::HIBERNATED ] )
+						break;
 
 					try
 					{
 						// send loop
-						// exit if stopped, paused, or stream time has ended
+						// exit if stopped, paused, stream time has ended or stream data terminated
+						bool more = true;
 						do
 						{
 							// calc sleep while holding last fetched frame
@@ -271,13 +367,15 @@ namespace KGD
 								// send frames while their time is before now
 								do
 								{
-									this->sendNextFrame( );
-									ft = this->fetchNextFrame( lk );
+									more = this->sendNextFrame( ) && this->fetchNextFrame( lk, ft );
 
 									now = _frame.time->getPresentationTime();
 									spd = _frame.time->getSpeed();
 								}
-								while ( ( ft - now ) * sign( spd ) <= 0.0 );
+								while ( more && ( ft - now ) * sign( spd ) <= 0.0 );
+								if ( ! more )
+									break;
+								_sock->flush();
 								// this will always be positive
 								slp = Clock::secToNano( ( ft - now ) / spd );
 							}
@@ -301,11 +399,13 @@ namespace KGD
 							}
 						}
 						while( !( _status.bag[ Status::STOPPED ] || _status.bag[ Status::PAUSED ] || ( _timeEnd - now ) * sign( spd ) <= 0.0 ) );
-					}
-					catch ( RTP::Eof )
-					{
-						Log::message("%s: reached EOF", getLogName() );
-						_rtcp.sender->stop();
+
+						if ( ! more )
+						{
+							_sock->flush();
+							Log::message("%s: reached EOF", getLogName() );
+							_rtcp.sender->stop();
+						}
 					}
 					catch ( KGD::Exception::Generic const & e)
 					{
@@ -326,13 +426,22 @@ namespace KGD
 
 				Log::verbose( "%s: main loop exited", getLogName() );
 
-				_status.bag[ Status::STOPPED ] = true;
-				_status.bag[ Status::PAUSED ]  = false;
+				if ( _status.bag[ Status::HIBERNATED ] )
+				{
+					Log::verbose( "%s: suspending RTCP", getLogName() );
+					_rtcp.sender->suspend();
+					_rtcp.receiver->suspend();
+				}
+				else
+				{
+					_status.bag[ Status::STOPPED ] = true;
+					_status.bag[ Status::PAUSED ]  = false;
 
-				Log::verbose( "%s: stopping RTCP sender", getLogName() );
-				_rtcp.sender->stop();
-				Log::verbose( "%s: stopping RTCP Receiver", getLogName() );
-				_rtcp.receiver->stop();
+					Log::verbose( "%s: stopping RTCP sender", getLogName() );
+					_rtcp.sender->stop();
+					Log::verbose( "%s: stopping RTCP Receiver", getLogName() );
+					_rtcp.receiver->stop();
+				}
 				Log::verbose( "%s: stopping buffer", getLogName() );
 				_frame.buf->stop();
 			}
@@ -341,38 +450,64 @@ namespace KGD
 			_th.wait();
 		}
 
-		void Session::sendNextFrame( ) throw( KGD::Socket::Exception, RTP::Eof )
+		bool Session::sendNextFrame( ) throw( KGD::Socket::Exception )
 		{
 			if ( _frame.next )
 			{
+				// not even packetized, so sequence numbers have no gaps
+				if ( this->skipFrame() )
+					return true;
+
 // 				Log::verbose( "%s: sending packet %lf", getLogName(), _frame.next->getTime() );
-				size_t sendingSz;
 				RTP::TTimestamp rtp = _frame.time->getRTPtime( _frame.next->getTime() );
-				auto_ptr< Packet::List > pkts = _frame.next->getPackets( rtp, _ssrc, _seqCur );
+				auto_ptr< Packet::List > pkts = ( _frame.packets
+					? Batch::copyPackets( *_frame.packets, rtp, _ssrc, _seqCur )
+					: _frame.next->getPackets( rtp, _ssrc, _seqCur ) );
+
+				size_t sendingSz = 0;
+				_frame.iov.resize( pkts->size() );
+				size_t n = 0;
+				BOOST_FOREACH( Packet & pkt, *pkts )
+				{
+					_frame.iov[ n ].iov_base = pkt.data.get();
+					_frame.iov[ n ].iov_len = pkt.data.size();
+					sendingSz += pkt.data.size();
+					++ n;
+				}
+
 				try
 				{
-					BOOST_FOREACH( Packet & pkt, *pkts )
+					// the whole frame at once, flushed with the frames due with it;
+					// a congested channel may drop it if nothing depends on it
+					const RTP::Frame::AVMedia * av = dynamic_cast< const RTP::Frame::AVMedia * >( _frame.next.get() );
+					if ( n > 0 )
+						_sock->writePackets( &_frame.iov[0], n, true, av && ! av->isKey() );
+					BOOST_FOREACH( const Packet & pkt, *pkts )
+						_rtcp.sender->registerPacketSent( pkt.data.size() );
+					this->measureFrame( sendingSz );
+					_frame.firstLost = HUGE_VAL;
+					_frame.rate.tick();
+
+					if ( _frame.playAt != HUGE_VAL )
 					{
-						sendingSz = pkt.data.size();
-						*_sock << pkt;
-						_rtcp.sender->registerPacketSent( sendingSz );
-						_frame.firstLost = HUGE_VAL;
+						Log::message( "%s: first packet %.1lf ms after play", getLogName(), ( Clock::getSec() - _frame.playAt ) * 1000 );
+						_frame.playAt = HUGE_VAL;
 					}
-					_frame.rate.tick();
 				}
 				catch( KGD::Socket::Exception const & e )
 				{
 					if ( e.wouldBlock() )
 					{
-						_rtcp.sender->registerPacketLost( sendingSz );
-						Log::debug( "%s: packet lost %d / %d, %lf, %lf - %lu bytes", getLogName(), _rtcp.sender->getStats().pktLost, _medium.getFrameCount(), Clock::getSec() - _frame.firstLost, _frame.next->getTime(), sendingSz );
+						BOOST_FOREACH( const Packet & pkt, *pkts )
+							_rtcp.sender->registerPacketLost( pkt.data.size() );
+						Log::debug( "%s: frame lost %d / %d, %lf, %lf - %lu bytes", getLogName(), _rtcp.sender->getStats().pktLost, _medium.getFrameCount(), Clock::getSec() - _frame.firstLost, _frame.next->getTime(), sendingSz );
 						// more than 10 s of lost packets, drop connection
 						if ( _frame.firstLost == HUGE_VAL )
 							_frame.firstLost = Clock::getSec();
 						else if ( Clock::getSec() - _frame.firstLost >= 5 )
 						{
 							Log::warning( "%s: 5s packet loss, stopping", getLogName(), e.what() );
-							throw RTP::Eof();
+							return false;
 						}
 					}
 					else
@@ -386,9 +521,71 @@ namespace KGD
 					Log::error( "%s: %s", getLogName(), e.what() );
 				}
 			}
+			return true;
 		}
 
 
+		bool Session::skipFrame() throw()
+		{
+			if ( MAX_BACKLOG <= 0 || _cong.rate <= 0 || _medium.getType() != SDP::MediaType::Video )
+				return false;
+
+			// thin out, then key frames only, then back to every frame with some hysteresis
+			const double backlog = _sock->getBacklog() / _cong.rate;
+			const Congestion::level prev = _cong.lvl;
+			if ( backlog > MAX_BACKLOG )
+				_cong.lvl = Congestion::KEYS;
+			else if ( backlog > MAX_BACKLOG / 2 && _cong.lvl == Congestion::NONE )
+				_cong.lvl = Congestion::THIN;
+			else if ( backlog < MAX_BACKLOG / 4 )
+				_cong.lvl = Congestion::NONE;
+
+			if ( _cong.lvl != prev )
+				Log::message( "%s: %.2lf s backlog, %s", getLogName(), backlog,
+					( _cong.lvl == Congestion::KEYS ? "key frames only" : ( _cong.lvl == Congestion::THIN ? "thinning frames" : "every frame" ) ) );
+
+			// a non key frame refers to the previous ones: once one is dropped, the rest
+			// of the group of pictures is useless too, so skipping goes on to the next key frame
+			const RTP::Frame::AVMedia * av = dynamic_cast< const RTP::Frame::AVMedia * >( _frame.next.get() );
+			if ( ! av || av->isKey() )
+			{
+				_cong.waitKey = false;
+				if ( av && _cong.lvl == Congestion::THIN )
+					++ _cong.count;
+				return false;
+			}
+			else if ( _cong.lvl == Congestion::KEYS || ( _cong.lvl == Congestion::THIN && _cong.count % 2 == 0 ) )
+				_cong.waitKey = true;
+
+			return _cong.waitKey;
+		}
+
+		void Session::measureFrame( size_t sz ) throw()
+		{
+			// a thinned stream would look slower than it is
+			if ( _cong.lvl != Congestion::NONE || _cong.waitKey )
+			{
+				_cong.from = HUGE_VAL;
+				return;
+			}
+
+			const double t = _frame.next->getTime();
+			if ( t < _cong.from )
+			{
+				_cong.from = t;
+				_cong.bytes = 0;
+			}
+
+			_cong.bytes += sz;
+			if ( t - _cong.from >= 1.0 )
+			{
+				const double r = _cong.bytes / ( t - _cong.from );
+				_cong.rate = ( _cong.rate > 0 ? ( _cong.rate + r ) / 2 : r );
+				_cong.from = t;
+				_cong.bytes = 0;
+			}
+		}
+
 		uint16_t Session::getStartSeq() const throw()
 		{
 			return _seqStart;
@@ -412,13 +609,22 @@ namespace KGD
 			return _url;
 		}
 
+		bool Session::isRTCPmuxed() const throw()
+		{
+			return _sock.get() == static_cast< Channel::Out * >( _rtcp.sock.get() );
+		}
+
 		Channel::Description Session::RTPgetDescription() const throw()
 		{
-			return _sock->getDescription();
+			Channel::Description rt = _sock->getDescription();
+			rt.mux = this->isRTCPmuxed();
+			return rt;
 		}
 		Channel::Description Session::RTCPgetDescription() const throw()
 		{
-			return _rtcp.sock->getDescription();
+			Channel::Description rt = _rtcp.sock->getDescription();
+			rt.mux = this->isRTCPmuxed();
+			return rt;
 		}
 
 	}
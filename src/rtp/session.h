@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     end of stream returned, not thrown, by fetch and send
+ *     rtcp-mux
+ *     frames skipped while the channel backlog is too long
+ *     frame packets written at once, flushed per send burst
+ *     hibernation of long paused sessions
+ *     vod batching
+ *     prefill at setup, first packet latency
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     fixed RTSP buffer enqueue
  *     minor cleanup and more robust Range / Scale support during PLAY
@@ -38,6 +45,7 @@
 #define __KGD_RTP_SESSION_H
 
 #include "rtp/buffer.h"
+#include "rtp/batch.h"
 #include "rtp/header.h"
 #include "rtp/chrono.h"
 #include "sdp/sdp.h"
@@ -97,7 +105,7 @@ namespace KGD
 			//! status flags
 			struct Status
 			{
-				enum Flags { STOPPED, PAUSED, SEEKED };
+				enum Flags { STOPPED, PAUSED, SEEKED, HIBERNATED };
 				bitset< 4 > bag;
 			} _status;
 
@@ -110,6 +118,8 @@ namespace KGD
 				Barrier asleep;
 				//! flag that indicates asleep barrier must be used during pause performance
 				bool sync;
+				//! time to seek the buffer to when waking from hibernation, HUGE_VAL if already done
+				double resumeAt;
 				//! ctor
 				Pause();
 			} _pause;
@@ -124,10 +134,41 @@ namespace KGD
 				//! frame buffer
 				boost::scoped_ptr< Buffer::Base > buf;
 				//! next frame to send
-				boost::scoped_ptr< RTP::Frame::Base > next;
+				boost::shared_ptr< RTP::Frame::Base > next;
+				//! packets of the next frame when it comes from a batch feed
+				boost::shared_ptr< const Packet::List > packets;
+				//! batch feed shared with other sessions, if any
+				boost::shared_ptr< Batch::Feed > batch;
+				//! member identifier in the batch feed
+				size_t member;
+				//! packet buffers of the frame being sent
+				vector< iovec > iov;
 				//! time of first frame lost
 				double firstLost;
+				//! time the last play request arrived at, HUGE_VAL once its first packet is sent
+				double playAt;
 			} _frame;
+
+			//! adaptation to a congested channel, by seconds of stream it holds
+			struct Congestion
+			{
+				//! all frames, every other group of pictures cut to its key frame, key frames only
+				enum level { NONE, THIN, KEYS };
+				//! current level
+				level lvl;
+				//! non key frames are useless until the next key one
+				bool waitKey;
+				//! key frames met while thinning
+				size_t count;
+				//! stream bitrate estimate in bytes per second, 0 while unknown
+				double rate;
+				//! bytes sent in the measure window
+				double bytes;
+				//! media time the measure window starts at
+				double from;
+				//! ctor
+				Congestion();
+			} _cong;
 			
 			//! time elapsed on media timeline when to stop play
 			double _timeEnd;
@@ -142,6 +183,11 @@ namespace KGD
 			//! log identifier
 			const string _logName;
 
+			//! stop reading from the batch feed, if any
+			void leaveBatch() throw();
+			//! reads the next frame from the batch feed if still a member, from the own buffer otherwise; false at the end
+			bool readFrame( boost::shared_ptr< Batch::Feed >, size_t, Batch::Entry & ) throw();
+
 			//! starts a new random sequence
 			TCseq seqRestart() throw();
 
@@ -150,17 +196,25 @@ namespace KGD
 			//! sets up the session to do successive PLAY requests
 			RTSP::PlayRequest doSeekScale( const RTSP::PlayRequest & ) throw( KGD::Exception::OutOfBounds );
 
-			//! retrieves next frame from frame buffer
-			double fetchNextFrame( OwnThread::Lock & ) throw( RTP::Eof );
+			//! retrieves next frame from frame buffer, giving its time; false at the end
+			bool fetchNextFrame( OwnThread::Lock &, double & ) throw();
+			//! forgets the frame to send
+			void dropNextFrame() throw();
 
-			//! packetized and sends a frame on the RTP socket, marking the frame with the specified time on media timeline
-			void sendNextFrame( ) throw( KGD::Socket::Exception, RTP::Eof );
+			//! packetized and sends a frame on the RTP socket, marking the frame with the specified time on media timeline; false when the stream has to stop
+			bool sendNextFrame( ) throw( KGD::Socket::Exception );
+			//! tells if the next frame has to be skipped to keep the channel backlog bounded
+			bool skipFrame() throw();
+			//! updates the stream bitrate estimate with the bytes of a frame sent
+			void measureFrame( size_t ) throw();
 
 			//! logs some informations
 			void logTimes() const throw();
 
 			//! main loop
 			void run() throw();
+			//! restarts buffer and threads released by hibernation; lock must be held
+			void wake() throw();
 		public:
 			//! ctor: given the request URL, the track descriptor, RTP / RTCP channels and the user agent
 			Session( RTSP::Session & parent, const Url &, SDP::Medium::Base &,
@@ -198,6 +252,8 @@ namespace KGD
 			Channel::Description RTPgetDescription() const throw();
 			//! returns RTCP channel description
 			Channel::Description RTCPgetDescription() const throw();
+			//! tells if RTCP goes on the RTP channel, RFC 5761
+			bool isRTCPmuxed() const throw();
 
 			//! returns the time after t when another medium can be inserted; HUGE_VAL means ASAP
 			double evalMediumInsertion( double t = HUGE_VAL ) throw( KGD::Exception::OutOfBounds );
@@ -220,6 +276,13 @@ namespace KGD
 
 			//! stop
 			void teardown( const RTSP::PlayRequest & ) throw();
+
+			//! releases buffer and threads if paused for long, keeping position, SSRC, sequence and transport; caller must keep requests out
+			bool hibernate() throw();
+			//! seconds of pause before hibernation; 0 disables it
+			static double HIBERNATE_AFTER;
+			//! seconds of stream a congested channel may hold before frames are skipped; 0 disables adaptation
+			static double MAX_BACKLOG;
 		};
 	}
 }
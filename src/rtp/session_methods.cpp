@@ -25,6 +25,10 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     hibernation of long paused sessions
+ *     channel play lists
+ *     vod batching
+ *     first packet latency
  *     fixed RTSP buffer enqueue
  *     threads terminate with wait + join
  *     testing against a "speed crash"
@@ -46,6 +50,7 @@ namespace KGD
 		RTSP::PlayRequest Session::play( const RTSP::PlayRequest & rq ) throw( KGD::Exception::OutOfBounds )
 		{
 			OwnThread::Lock lk(_th);
+			_frame.playAt = Clock::getSec();
 
 			RTSP::PlayRequest ret;
 
@@ -79,7 +84,9 @@ namespace KGD
 				OwnThread::Lock lk( _th );
 				Log::message( "%s: start play", getLogName() );
 				_status.bag[ Status::PAUSED ] = false;
-				if ( ! _th )
+				if ( _status.bag[ Status::HIBERNATED ] )
+					this->wake();
+				else if ( ! _th )
 				{
 					_rtcp.receiver->start();
 					_rtcp.sender->reset();
@@ -97,6 +104,12 @@ namespace KGD
 				ret.speed = RTSP::PlayRequest::LINEAR_SCALE;
 			if ( rq.from == HUGE_VAL )
 				ret.from = signedMin( 0.0, _medium.getIterationDuration(), sign( ret.speed ) );
+			// channels play where the channel is now
+			if ( _medium.isChannel() )
+			{
+				ret.speed = RTSP::PlayRequest::LINEAR_SCALE;
+				ret.from = _medium.getChannelTime();
+			}
 
 			Log::message( "%s: play %s", getLogName(), ret.toString().c_str() );
 
@@ -107,7 +120,27 @@ namespace KGD
 			_status.bag[ Status::PAUSED ] = true;
 
 			_frame.time->seek( ret.time, ret.from, ret.speed );
-			_frame.buf->seek( ret.from, ret.speed );
+
+			// share frames with other sessions starting this medium, or playing this channel
+			if ( _medium.isChannel()
+				|| ( Batch::Pool::JOIN_WINDOW > 0 && !_medium.isLiveCast()
+					&& ret.from == 0.0 && ret.speed == RTSP::PlayRequest::LINEAR_SCALE ) )
+			{
+				try
+				{
+					_frame.batch = Batch::Pool::getInstance()->join( _medium, ret.from, _frame.member );
+					Log::debug( "%s: joined batch %s", getLogName(), _frame.batch->getLogName() );
+				}
+				catch( const KGD::Exception::NotFound & e )
+				{
+					Log::warning( "%s: no batch: %s", getLogName(), e.what() );
+				}
+			}
+
+			if ( _frame.batch )
+				_frame.buf->stop();
+			else
+				_frame.buf->seek( ret.from, ret.speed );
 
 			return ret;
 		}
@@ -140,8 +173,11 @@ namespace KGD
 
 			if ( _status.bag[ Status::PAUSED ] || ret.hasRange || ret.hasScale )
 			{
+				this->leaveBatch();
 				_frame.next.reset();
+				_frame.packets.reset();
 				_frame.buf->seek( ret.from, ret.speed );
+				_pause.resumeAt = HUGE_VAL;
 				_seqStart = _seqCur + 1;
 				_frame.time->seek( rq.time, ret.from, ret.speed );
 			}
@@ -179,6 +215,23 @@ namespace KGD
 					_pause.asleep.wait();
 				}
 				Log::debug( "%s: effectively paused", getLogName() );
+
+				// resume from the frame not sent yet on our own
+				if ( _frame.batch )
+				{
+					double t = ( _frame.next ? _frame.next->getTime() : _frame.time->getPresentationTime() );
+					this->leaveBatch();
+					_frame.next.reset();
+					_frame.packets.reset();
+					try
+					{
+						_frame.buf->seek( t, _frame.time->getSpeed() );
+					}
+					catch( const KGD::Exception::OutOfBounds & e )
+					{
+						Log::error( "%s: %s", getLogName(), e.what() );
+					}
+				}
 			}
 		}
 
@@ -192,6 +245,8 @@ namespace KGD
 				Log::message( "%s: unpause", getLogName() );
 				_status.bag[ Status::PAUSED ] = false;
 				_frame.time->unpause( rq.time, _frame.time->getSpeed() );
+				if ( _status.bag[ Status::HIBERNATED ] )
+					this->wake();
 				_th.unlock();
 
 				Log::verbose( "%s: wakeup", getLogName() );
@@ -223,6 +278,14 @@ namespace KGD
 					}
 				}
 				_frame.buf->stop();
+
+				// hibernated sender is not running, let it say goodbye
+				if ( _status.bag[ Status::HIBERNATED ] )
+				{
+					_status.bag[ Status::HIBERNATED ] = false;
+					_rtcp.sender->start();
+					_rtcp.sender->stop();
+				}
 			}
 			if ( _th )
 			{
@@ -231,6 +294,7 @@ namespace KGD
 				_th.reset();
 				Log::verbose( "%s: loop joined terminate", getLogName() );
 			}
+			this->leaveBatch();
 
 			_frame.time->stop( rq.time );
 			this->logTimes();
@@ -238,5 +302,60 @@ namespace KGD
 			Log::debug( "%s: teardown completed", getLogName() );
 		}
 
+		bool Session::hibernate() throw()
+		{
+			OwnThread::Lock lk( _th );
+
+			if ( HIBERNATE_AFTER <= 0 || ! _th
+				|| _status.bag[ Status::STOPPED ] || ! _status.bag[ Status::PAUSED ] || _status.bag[ Status::HIBERNATED ]
+				|| _frame.time->getLastPause() < HIBERNATE_AFTER )
+				return false;
+
+			Log::message( "%s: hibernating after %.0lf s of pause", getLogName(), _frame.time->getLastPause() );
+
+			// send thread leaves, suspending RTCP threads
+			_status.bag[ Status::HIBERNATED ] = true;
+			{
+				OwnThread::UnLock ulk( lk );
+				_pause.wakeup.notify_all();
+				_th.reset();
+			}
+
+			// resume from the frame not sent yet
+			_pause.resumeAt = ( _frame.next ? _frame.next->getTime() : _frame.time->getPresentationTime() );
+			if ( _frame.next && !_frame.packets )
+				_frame.next->release();
+			_frame.next.reset();
+			_frame.packets.reset();
+			this->leaveBatch();
+			_frame.buf->drop();
+
+			return true;
+		}
+
+		void Session::wake() throw()
+		{
+			Log::message( "%s: waking up from hibernation", getLogName() );
+			_status.bag[ Status::HIBERNATED ] = false;
+
+			// quick refill, unless a seek already did
+			if ( _pause.resumeAt != HUGE_VAL )
+			{
+				try
+				{
+					_frame.buf->seek( _pause.resumeAt, _frame.time->getSpeed() );
+				}
+				catch( const KGD::Exception::OutOfBounds & e )
+				{
+					Log::error( "%s: %s", getLogName(), e.what() );
+				}
+				_pause.resumeAt = HUGE_VAL;
+			}
+
+			// sender restarts along with the send loop
+			_rtcp.receiver->start();
+			_th.reset( new boost::thread( boost::bind( &RTP::Session::run, this ) ) );
+		}
+
 	}
 }
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     channel play lists
  *     minor cleanup and more robust Range / Scale support during PLAY
  *     removed magic numbers in favor of constants / ini parameters
  *     introduced keep alive on control socket (me dumb)
@@ -91,6 +92,13 @@ namespace KGD
 					
 				if ( rq.from == HUGE_VAL )
 					ret.from = signedMin( 0.0, _medium.getIterationDuration(), sign( ret.speed ) );
+
+				// channels start where the channel is now
+				if ( _medium.isChannel() )
+				{
+					ret.speed = RTSP::PlayRequest::LINEAR_SCALE;
+					ret.from = _medium.getChannelTime();
+				}
 			}
 			else
 			{
@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     framing resumes where the last scan stopped
+ *     single pass message parser, no regular expressions
  *     fixed RTSP buffer enqueue
  *     boosted
  *     source import
@@ -41,8 +43,7 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
-
-#include <boost/regex.hpp>
+#include <algorithm>
 
 using namespace std;
 
@@ -52,56 +53,77 @@ namespace KGD
 	{
 		InputBuffer::InputBuffer()
 		: KGD::Buffer()
+		, _scanned( 0 )
+		, _packetLen( 0 )
 		{
 		}
 
+		void InputBuffer::dequeue( uint16_t len ) throw( KGD::Exception::Generic )
+		{
+			KGD::Buffer::dequeue( len );
+			_scanned = 0;
+			_packetLen = 0;
+		}
 
-		size_t InputBuffer::getContentLength( ) const throw( )
+
+		size_t InputBuffer::getContentLength( size_t headerLen ) const throw( )
 		{
-			boost::regex rxSearch( EOL + Header::ContentLength + ": (\\d+)" + EOL );
-			boost::match_results< string::const_iterator > match;
-			const string data( this->getDataBegin() );
-			if (boost::regex_search( data.begin() , data.end(), match, rxSearch))
-				return fromString< size_t >( match.str(1) );
+			const char * data = this->getDataBegin();
+			Message::Parser::Token value;
+			uint64_t len;
+			if ( Message::Parser::findHeader( data, data + headerLen, Header::ContentLength, value ) && value.toUnsigned( len ) )
+				return len;
 			else
 				return 0;
 		}
 
 		size_t InputBuffer::getNextPacketLength() const throw( )
 		{
-			size_t sz = 0;
+			static const char HEADER_END[] = "\r\n\r\n";
 			size_t len = this->getDataLength();
 			const char * data = this->getDataBegin();
-			// interleave
-			// there is always at least one character in the buffer (0)
-			if ( data[0] == '$' )
+
+			if ( ! _packetLen && len )
 			{
-				// $cZS
-				if ( len >= 4 )
+				// interleave
+				if ( data[0] == '$' )
 				{
-					uint16_t payload = 0;
-					memcpy( &payload, &data[2], 2 );
-					sz = 4u + ntohs( payload );
+					// $cZS
+					if ( len >= 4 )
+					{
+						uint16_t payload = 0;
+						memcpy( &payload, &data[2], 2 );
+						_packetLen = 4u + ntohs( payload );
+					}
+				}
+				// RTSP message: go on from where last search stopped, the end may straddle it
+				else
+				{
+					size_t from = ( _scanned > 3 ? _scanned - 3 : 0 );
+					const char * end = search( data + from, data + len, HEADER_END, HEADER_END + 4 );
+					if ( end == data + len )
+						_scanned = len;
+					else
+					{
+						size_t sz = end - data + 4;
+						_packetLen = sz + this->getContentLength( sz );
+					}
 				}
-			}
-			// RTSP message
-			else if ( (sz = string( data ).find( EOL + EOL )) != string::npos )
-			{
-				sz += 2 * EOL.size() + this->getContentLength( );
 			}
 
 			// incomplete
-			if ( sz > len )
+			if ( _packetLen > len )
 				return 0;
 			else
-				return sz;
+				return _packetLen;
 		}
 
 		// ***********************************************************************************************************************************
 
 		auto_ptr< Message::Request > InputBuffer::getNextRequest( size_t pktLen, const string & remoteHost ) throw( RTSP::Exception::ManagedError, KGD::Exception::NotFound )
 		{
-			if ( pktLen )
+			// interleaved packets are not even parsed
+			if ( pktLen && *this->getDataBegin() != '$' )
 			{
 				auto_ptr< Message::Request > rt( new Message::Request( this->getDataBegin(), pktLen, remoteHost ) );
 				this->dequeue( pktLen );
@@ -113,7 +135,7 @@ namespace KGD
 
 		auto_ptr< Message::Response > InputBuffer::getNextResponse( size_t pktLen ) throw( RTSP::Exception::CSeq, KGD::Exception::NotFound )
 		{
-			if ( pktLen )
+			if ( pktLen && *this->getDataBegin() != '$' )
 			{
 				auto_ptr< Message::Response > rt( new Message::Response( this->getDataBegin(), pktLen ) );
 				this->dequeue( pktLen );
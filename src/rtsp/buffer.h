@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     framing resumes where the last scan stopped
+ *     single pass message parser, no regular expressions
  *     boosted
  *     source import
  *
@@ -55,10 +57,19 @@ namespace KGD
 		: public KGD::Buffer
 		{
 		protected:
-			size_t getContentLength( ) const throw( );
+			//! bytes of the next message already searched for the header end
+			mutable size_t _scanned;
+			//! next packet length once known, 0 otherwise
+			mutable size_t _packetLen;
+
+			//! returns the body length declared in a message header of given length
+			size_t getContentLength( size_t ) const throw( );
 		public:
 			InputBuffer();
 
+			//! dequeues data, the next packet starts over
+			virtual void dequeue( uint16_t len ) throw( KGD::Exception::Generic );
+
 			//! returns next packet' length, or 0 if incomplete
 			size_t getNextPacketLength() const throw( );
 			//! returns next request
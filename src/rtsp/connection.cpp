@@ -25,6 +25,12 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     output drained while input is paused for a slow request
+ *     channel timeline anchored to the play list time, channels always shared
+ *     output queue drained when the socket is writable
+ *     parsed messages are returned, not thrown
+ *     served by poller event loops instead of a thread per connection
+ *     hibernation of long paused sessions
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     english comments; removed leak with connection serving threads
  *     testing interrupted connections
@@ -48,42 +54,61 @@ namespace KGD
 {
 	namespace RTSP
 	{
-		bool Connection::SHARE_DESCRIPTORS = false;
+		bool Connection::SHARE_DESCRIPTORS = true;
 
-		void Connection::run( ) throw()
+		namespace
 		{
-			try
+			//! methods loading media or driving RTP sessions are served by workers
+			bool isSlow( Method::ID id ) throw()
 			{
-				this->listen();
-			}
-			catch( const KGD::Exception::Generic & e )
-			{
-				Log::error( "%s: %s", getLogName(), e.what() );
+				switch( id )
+				{
+				case Method::DESCRIBE:
+				case Method::SETUP:
+				case Method::PLAY:
+				case Method::PAUSE:
+				case Method::TEARDOWN:
+					return true;
+				default:
+					return false;
+				}
 			}
-
-			this->shutdown();
-			_th.wait();
 		}
 
-		
 		Connection::Connection( auto_ptr< KGD::Socket::Tcp > socket, RTSP::Server & svr )
 		: _svr( svr )
 		, _id( random() )
 		, _agent( UserAgent::Generic )
 		, _logName( "CONN " + socket->getRemoteHost() + "#" + toString( _id ) )
 		, _socket( new RTSP::Socket( socket, _logName ) )
+		, _poller( Poller::getInstance() )
+		, _jobs( 0 )
 		, _active( true )
 		{
 			Log::verbose( "%s: created", getLogName() );
-			_th.reset( new boost::thread( boost::bind( &Connection::run, this ) ) );
+			_socket->setPollHandler( *this );
+			try
+			{
+				_poller->add( *this );
+			}
+			catch( const KGD::Exception::Generic & e )
+			{
+				Log::error( "%s: %s", getLogName(), e.what() );
+				_active = false;
+			}
 		}
 
 		Connection::~Connection()
 		{
-			this->shutdown();
+			// no more callbacks, then let workers finish
+			_poller->remove( *this );
+			{
+				Connection::Lock lk( *this );
+				while( _jobs )
+					_noJobs.wait( lk );
+			}
 
-			Log::debug("%s: joining thread", getLogName() );
-			_th.reset();
+			this->shutdown();
 			Log::verbose( "%s: destroyed", getLogName() );
 		}
 
@@ -93,7 +118,10 @@ namespace KGD
 
 			Log::debug("%s: shutting down", getLogName() );
 
+			// stop polling before the descriptor is closed
+			_poller->remove( *this );
 			_active = false;
+			_queued.reset();
 			_sessions.clear();
 			_socket.reset();
 			releaseDescriptors();
@@ -158,6 +186,11 @@ namespace KGD
 			_socket->reply( error );
 		}
 
+		int Connection::getPollDescriptor() const throw()
+		{
+			return _socket->getDescriptor();
+		}
+
 		RTSP::Socket & Connection::getSocket() throw( )
 		{
 			return *_socket;
@@ -168,7 +201,8 @@ namespace KGD
 			Connection::Lock lk( *this );
 			try
 			{
-				if ( SHARE_DESCRIPTORS )
+				// channels are shared anyway: every viewer must feed from the same media
+				if ( SHARE_DESCRIPTORS || SDP::Container::isChannel( file ) )
 				{
 					// get mutable instance
 					SDP::Descriptions::Reference sdpool = SDP::Descriptions::getInstance();
@@ -233,53 +267,140 @@ namespace KGD
 				throw RTSP::Exception::ManagedError( Error::NotFound );
 		}
 
-		void Connection::listen() throw( KGD::Exception::Generic )
+		void Connection::onReadable() throw()
 		{
-			Log::debug( "%s: listen loop start", getLogName() );
+			Connection::Lock lk( *this );
+			if ( ! _active )
+				return;
+
+			// peer closed
+			if ( ! _socket->receive() )
+			{
+				this->offload( &Connection::close );
+				return;
+			}
+
+			this->serve();
+		}
 
-			ByteArray receiveBuffer( 1024 );
+		void Connection::onWritable() throw()
+		{
+			// no connection lock: a slow request must not hold output back, and the socket lives until polling stops
+			_socket->drain();
+		}
 
-			for(;;)
+		void Connection::serve() throw()
+		{
+			try
 			{
-				try
+				for(;;)
 				{
-					_socket->listen();
-				}
-				// got request
-				catch ( Message::Request * rq )
-				{
-					Connection::Lock lk( *this );
-					_lastRq.reset( rq );
+					auto_ptr< Message::Request > rq;
+					auto_ptr< Message::Response > resp;
+					RTSP::Socket::Inbound::type in = _socket->parse( rq, resp );
 
-					// process message and reply
-					try
-					{
-						// get message instance
-						boost::scoped_ptr< Method::Base > message(
-							Factory::ClassRegistry< Method::Base >::newInstance( rq->getMethodID() ) );
-						message->setConnection( *this );
-						// reply to message performing requested actions
-						_socket->reply( *message );
-					}
-					// method not found in factory
-					catch( const KGD::Exception::NotFound & e )
-					{
-						Log::error( "%s: %s", getLogName(), e.what() );
-						_socket->reply( Error::NotImplemented );
-					}
-					catch( const KGD::Socket::Exception & e )
+					if ( in == RTSP::Socket::Inbound::REQUEST )
 					{
-						Log::error( "%s: %s", getLogName(), e.what() );
-						throw;
+						if ( isSlow( rq->getMethodID() ) )
+						{
+							// reading resumes when the worker is done, so requests keep their order; output keeps draining meanwhile
+							_queued = rq;
+							_poller->pauseRead( *this );
+							this->offload( &Connection::process );
+							return;
+						}
+						else
+							this->handle( rq );
 					}
+					else if ( in == RTSP::Socket::Inbound::RESPONSE )
+						_lastResp.reset( resp.release() );
+					else
+						break;
+				}
+			}
+			catch( const KGD::Exception::Generic & e )
+			{
+				Log::error( "%s: %s", getLogName(), e.what() );
+				this->offload( &Connection::close );
+				return;
+			}
+
+			// the last session torn down closes the socket
+			if ( _socket->isOpen() )
+				_poller->rearm( *this );
+			else
+				this->offload( &Connection::close );
+		}
+
+		void Connection::handle( auto_ptr< Message::Request > rq ) throw( KGD::Socket::Exception )
+		{
+			_lastRq.reset( rq.release() );
+
+			// process message and reply
+			if ( Factory::ClassRegistry< Method::Base >::isRegistered( _lastRq->getMethodID() ) )
+			{
+				// get message instance
+				boost::scoped_ptr< Method::Base > message(
+					Factory::ClassRegistry< Method::Base >::newInstance( _lastRq->getMethodID() ) );
+				message->setConnection( *this );
+				// reply to message performing requested actions
+				_socket->reply( *message );
+			}
+			// method not in factory
+			else
+			{
+				Log::error( "%s: method %s not implemented", getLogName(), Method::name[ _lastRq->getMethodID() ].c_str() );
+				_socket->reply( Error::NotImplemented );
+			}
+		}
+
+		void Connection::offload( Job job ) throw()
+		{
+			++ _jobs;
+			_poller->offload( boost::bind( job, this ) );
+		}
+
+		void Connection::process() throw()
+		{
+			Connection::Lock lk( *this );
+			if ( _active && _queued.get() )
+			{
+				try
+				{
+					this->handle( _queued );
+					this->serve();
 				}
-				// got response
-				catch( Message::Response * resp )
+				catch( const KGD::Socket::Exception & e )
 				{
-					Connection::Lock lk( *this );
-					_lastResp.reset( resp );
+					Log::error( "%s: %s", getLogName(), e.what() );
+					this->shutdown();
 				}
 			}
+
+			-- _jobs;
+			_noJobs.notify_all();
+		}
+
+		void Connection::close() throw()
+		{
+			Connection::Lock lk( *this );
+			if ( _active )
+				this->shutdown();
+
+			-- _jobs;
+			_noJobs.notify_all();
+		}
+
+		void Connection::hibernate() throw()
+		{
+			// called under the server lock: never wait on a busy connection
+			Connection::TryLock lk( *this );
+
+			if ( lk.owns_lock() && _active )
+			{
+				BOOST_FOREACH( SessionMap::iterator::reference sess, _sessions )
+					sess->second->hibernate();
+			}
 		}
 
 		Session & Connection::createSession( const TSessionID & sessionID ) throw( RTSP::Exception::ManagedError )
@@ -318,6 +439,7 @@ namespace KGD
 				if ( _sessions.empty() )
 				{
 					Log::debug( "%s: no more sessions, tearing down", getLogName() );
+					_poller->remove( *this );
 					_socket->close();
 				}
 			}
@@ -25,6 +25,9 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     output queue drained when the socket is writable
+ *     served by poller event loops instead of a thread per connection
+ *     hibernation of long paused sessions
  *     english comments; removed leak with connection serving threads
  *     testing interrupted connections
  *     boosted
@@ -44,6 +47,7 @@
 #include "rtsp/exceptions.h"
 #include "rtsp/ports.h"
 #include "sdp/sdp.h"
+#include "lib/poller.h"
 
 #include <vector>
 #include <string>
@@ -57,9 +61,10 @@ namespace KGD
 	{
 		class Server;
 		
-		//! RTSP client connection management
+		//! RTSP client connection management, served by the poller
 		class Connection
 		: public Safe::LockableBase< RMutex >
+		, public Poller::Handler
 		{
 		public:
 			static bool SHARE_DESCRIPTORS;
@@ -67,7 +72,7 @@ namespace KGD
 			typedef boost::ptr_map< TSessionID, Session > SessionMap;
 			typedef map< string, ref< SDP::Container > > DescriptorMap;
 			typedef boost::ptr_map< string, SDP::Container > LocalDescriptorMap;
-			typedef Safe::ThreadBarrier OwnThread;
+			typedef void ( Connection::*Job )();
 
 			//! ref to server
 			RTSP::Server & _svr;
@@ -89,15 +94,27 @@ namespace KGD
 			DescriptorMap _descriptors;
 			//! local instanced descriptors
 			LocalDescriptorMap _descriptorInstances;
-			//! connection thread
-			OwnThread _th;
+			//! event loops and workers
+			Singleton::Class< Poller >::Reference _poller;
+			//! request waiting for a worker
+			auto_ptr< Message::Request > _queued;
+			//! jobs queued or running on workers
+			size_t _jobs;
+			//! signals no more jobs
+			Condition _noJobs;
 			//! connection active and listening flag
 			bool _active;
 
-			//! socket-event-driven main action loop
-			void listen() throw( KGD::Exception::Generic );
-			//! listen guard and sync
-			void run() throw();
+			//! handles buffered messages, then waits for more input or hands over to a worker; lock must be held
+			void serve() throw();
+			//! processes a request and replies; lock must be held
+			void handle( auto_ptr< Message::Request > ) throw( KGD::Socket::Exception );
+			//! runs a job on a worker
+			void offload( Job ) throw();
+			//! worker job: handles the queued request, then serves what follows
+			void process() throw();
+			//! worker job: shuts down
+			void close() throw();
 			//! release every SDP descriptor
 			void releaseDescriptors() throw();
 			//! resource deallocation
@@ -111,8 +128,17 @@ namespace KGD
 			//! get log identifier for this connection
 			const char * getLogName() const throw();
 
+			//! returns control socket descriptor
+			virtual int getPollDescriptor() const throw();
+			//! reads and serves what arrived on the control socket
+			virtual void onReadable() throw();
+			//! sends output queued for a slow peer
+			virtual void onWritable() throw();
+
 			//! is connection active and listening ?
 			bool isActive() const throw();
+			//! hibernates sessions paused for long, skipping the connection if it is busy
+			void hibernate() throw();
 
 			//! sets user agent, to build specialized timelines in rtp sessions
 			void setUserAgent( UserAgent::type ) throw();
@@ -0,0 +1,398 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtsp/egress.cpp
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     server-wide udp sockets shared by client tracks
+ *
+ **/
+
+
+#include "rtsp/egress.h"
+#include "rtsp/ports.h"
+#include "lib/log.h"
+
+#include <cstring>
+#include <cerrno>
+
+extern "C"
+{
+#include <arpa/inet.h>
+}
+
+namespace KGD
+{
+	namespace RTSP
+	{
+		namespace Egress
+		{
+			namespace
+			{
+				//! map key of an address
+				uint64_t addressKey( const sockaddr_in & a ) throw()
+				{
+					return ( uint64_t( ntohl( a.sin_addr.s_addr ) ) << 16 ) | ntohs( a.sin_port );
+				}
+
+				//! max messages in a sendmmsg call, UIO_MAXIOV
+				const size_t MAX_BATCH = 1024;
+				//! RTCP sender / receiver report types and the offset of their report blocks
+				const uint8_t SR = 200, RR = 201;
+				const size_t SR_BLOCKS = 28, RR_BLOCKS = 8, BLOCK_SIZE = 24;
+			}
+
+			Link::Link( TPort port ) throw( KGD::Socket::Exception )
+			: KGD::Socket::Udp( port )
+			, _taken( 0 )
+			, _sent( 0 )
+			, _sending( false )
+			, _poller( Poller::getInstance() )
+			{
+				this->setWriteTimeout( KGD::Socket::WRITE_TIMEOUT );
+				this->setReadBlock( false );
+				try
+				{
+					_poller->add( *this );
+				}
+				catch( const KGD::Exception::Generic & e )
+				{
+					throw KGD::Socket::Exception( "shared link", e.what() );
+				}
+			}
+
+			Link::~Link() throw()
+			{
+				_poller->remove( *this );
+			}
+
+			sockaddr_in Link::resolve( TPort port, const string & host ) const throw( KGD::Socket::Exception )
+			{
+				return this->getAddress( port, host );
+			}
+
+			int Link::getPollDescriptor() const throw()
+			{
+				return _fileDescriptor;
+			}
+
+			void Link::sendBatch( vector< mmsghdr > & msgs, vector< sockaddr_in > & addrs, vector< Result * > & owners ) throw()
+			{
+				for( size_t i = 0; i < msgs.size(); ++i )
+					msgs[ i ].msg_hdr.msg_name = &addrs[ i ];
+
+				size_t i = 0;
+				while( i < msgs.size() )
+				{
+					int sent = sendmmsg( _fileDescriptor, &msgs[ i ], min( msgs.size() - i, MAX_BATCH ), 0 );
+					if ( sent < 0 && errno == EINTR )
+						continue;
+					else if ( sent < 0 )
+					{
+						// the first one failed, go on with the others
+						if ( ! owners[ i ]->err )
+							owners[ i ]->err = errno;
+						++ i;
+					}
+					else
+						i += sent;
+				}
+			}
+
+			void Link::send( const Peer & p, const iovec * v, size_t n ) throw( KGD::Socket::Exception )
+			{
+				Result res;
+				res.err = 0;
+
+				KGD::Lock lk( _outMux );
+				for( size_t i = 0; i < n; ++i )
+				{
+					mmsghdr m;
+					memset( &m, 0, sizeof( m ) );
+					m.msg_hdr.msg_namelen = sizeof( sockaddr_in );
+					m.msg_hdr.msg_iov = const_cast< iovec * >( v + i );
+					m.msg_hdr.msg_iovlen = 1;
+					_msgs.push_back( m );
+					_addrs.push_back( p._remote );
+					_owners.push_back( &res );
+				}
+
+				// queued packets go with the next batch: whoever finds no batch being sent
+				// sends every queued one, others wait, so that their buffers are still valid
+				uint64_t batch = _taken + 1;
+				while( _sent < batch )
+				{
+					if ( _sending )
+						_batchSent.wait( lk );
+					else
+					{
+						vector< mmsghdr > msgs;
+						vector< sockaddr_in > addrs;
+						vector< Result * > owners;
+						msgs.swap( _msgs );
+						addrs.swap( _addrs );
+						owners.swap( _owners );
+						_sending = true;
+						++ _taken;
+						{
+							Safe::UnLock ulk( lk );
+							this->sendBatch( msgs, addrs, owners );
+						}
+						_sending = false;
+						_sent = _taken;
+						_batchSent.notify_all();
+					}
+				}
+
+				if ( res.err )
+					throw KGD::Socket::Exception( "sendmmsg", res.err );
+			}
+
+			Peer * Link::findReported( const uint8_t * data, size_t len ) throw()
+			{
+				if ( len < RR_BLOCKS )
+					return 0;
+
+				size_t count = data[ 0 ] & 0x1F;
+				size_t off;
+				if ( data[ 1 ] == SR )
+					off = SR_BLOCKS;
+				else if ( data[ 1 ] == RR )
+					off = RR_BLOCKS;
+				else
+					return 0;
+
+				for( size_t i = 0; i < count && off + sizeof( uint32_t ) <= len; ++i, off += BLOCK_SIZE )
+				{
+					uint32_t ssrc;
+					memcpy( &ssrc, data + off, sizeof( ssrc ) );
+					map< TSSrc, Peer * >::iterator it = _bySsrc.find( ntohl( ssrc ) );
+					if ( it != _bySsrc.end() )
+						return it->second;
+				}
+				return 0;
+			}
+
+			void Link::onReadable() throw()
+			{
+				uint8_t buffer[ 2048 ];
+				sockaddr_in from;
+				ssize_t read;
+
+				while( ( read = this->recvFromSocket( buffer, sizeof( buffer ), &from ) ) >= 0 )
+				{
+					// RTCP only, RFC 5761 4
+					if ( read < 2 || buffer[ 1 ] < 192 || buffer[ 1 ] > 223 )
+						continue;
+
+					KGD::Lock lk( _mux );
+					Peer * p = 0;
+					map< uint64_t, Peer * >::iterator it = _byAddr.find( addressKey( from ) );
+					if ( it != _byAddr.end() )
+						p = it->second;
+					// a client behind a NAT may show up from another port, not from another host:
+					// addresses are forgeable, ssrcs are public, media must not be redirected elsewhere
+					else if ( ( p = this->findReported( buffer, read ) ) && p->_remote.sin_addr.s_addr != from.sin_addr.s_addr )
+					{
+						Log::warning( "shared link %u: report on ssrc %lX from a foreign host dropped", getLocalPort(), p->_ssrc );
+						p = 0;
+					}
+					else if ( p )
+					{
+						Log::debug( "shared link %u: peer of ssrc %lX moved to port %u", getLocalPort(), p->_ssrc, ntohs( from.sin_port ) );
+						_byAddr.erase( addressKey( p->_remote ) );
+						_byAddr[ addressKey( from ) ] = p;
+						KGD::Lock olk( _outMux );
+						p->_remote = from;
+					}
+
+					if ( p && p->_sink )
+						p->_sink->onData( buffer, read );
+					else
+						Log::verbose( "shared link %u: %u bytes from unknown peer", getLocalPort(), read );
+				}
+
+				if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+					Log::error( "shared link %u: %s", getLocalPort(), strerror( errno ) );
+
+				_poller->rearm( *this );
+			}
+
+			// ***********************************************************************************************
+
+			Peer::Peer( Link & l, TPort port, const string & host ) throw( KGD::Socket::Exception )
+			: _link( l )
+			, _remote( l.resolve( port, host ) )
+			, _port( port )
+			, _ssrc( 0 )
+			, _sink( 0 )
+			, _closed( false )
+			{
+				KGD::Lock lk( _link._mux );
+				_link._byAddr[ addressKey( _remote ) ] = this;
+			}
+
+			Peer::~Peer() throw()
+			{
+				KGD::Lock lk( _link._mux );
+				map< uint64_t, Peer * >::iterator a = _link._byAddr.find( addressKey( _remote ) );
+				if ( a != _link._byAddr.end() && a->second == this )
+					_link._byAddr.erase( a );
+				map< TSSrc, Peer * >::iterator s = _link._bySsrc.find( _ssrc );
+				if ( s != _link._bySsrc.end() && s->second == this )
+					_link._bySsrc.erase( s );
+			}
+
+			void Peer::setSsrc( TSSrc ssrc ) throw()
+			{
+				KGD::Lock lk( _link._mux );
+				if ( _ssrc && _link._bySsrc[ _ssrc ] == this )
+					_link._bySsrc.erase( _ssrc );
+				_ssrc = ssrc;
+				_link._bySsrc[ _ssrc ] = this;
+			}
+
+			size_t Peer::writeSome( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+			{
+				iovec v;
+				v.iov_base = const_cast< void * >( data );
+				v.iov_len = sz;
+				this->writePackets( &v, 1 );
+				return sz;
+			}
+
+			size_t Peer::writeLast( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+			{
+				return this->writeSome( data, sz );
+			}
+
+			void Peer::writePackets( const iovec * v, size_t n, bool, bool ) throw( KGD::Socket::Exception )
+			{
+				if ( _closed )
+					throw KGD::Socket::Exception( "send", EBADF );
+				_link.send( *this, v, n );
+			}
+
+			size_t Peer::readSome( void *, size_t ) throw( KGD::Socket::Exception )
+			{
+				throw KGD::Socket::Exception( "readSome", EAGAIN );
+			}
+
+			bool Peer::setSink( Channel::Sink * s ) throw()
+			{
+				KGD::Lock lk( _link._mux );
+				_sink = s;
+				return true;
+			}
+
+			void Peer::setWriteBufferSize( size_t ) throw( )
+			{
+			}
+			void Peer::setWriteBlock( bool ) throw( )
+			{
+			}
+			void Peer::setWriteTimeout( double ) throw( )
+			{
+			}
+			bool Peer::isWriteBlock( ) const throw()
+			{
+				return true;
+			}
+			void Peer::setReadBlock( bool ) throw( )
+			{
+			}
+			void Peer::setReadTimeout( double ) throw( )
+			{
+			}
+			bool Peer::isReadBlock( ) const throw()
+			{
+				return false;
+			}
+
+			void Peer::close() throw()
+			{
+				_closed = true;
+			}
+
+			Channel::Description Peer::getDescription() const
+			{
+				Channel::Description rt;
+				rt.type = Channel::Owned;
+				rt.ports = make_pair( _link.getLocalPort(), _port );
+				rt.mux = false;
+				rt.pooled = true;
+
+				return rt;
+			}
+
+			// ***********************************************************************************************
+
+			size_t Service::SOCKETS = 0;
+
+			Service::Service() throw( KGD::Socket::Exception, KGD::Exception::NotFound )
+			: _next( 0 )
+			{
+				for( size_t i = 0; i < SOCKETS; ++i )
+				{
+					TPortPair p = Port::Udp::getInstance()->getPair();
+					try
+					{
+						_rtp.push_back( new Link( p.first ) );
+						_rtcp.push_back( new Link( p.second ) );
+					}
+					catch( const KGD::Socket::Exception & )
+					{
+						Port::Udp::getInstance()->release( p );
+						throw;
+					}
+					Log::debug( "shared links: %u / %u", p.first, p.second );
+				}
+			}
+
+			Service::~Service()
+			{
+				for( size_t i = 0; i < _rtp.size(); ++i )
+					Port::Udp::getInstance()->release( TPortPair( _rtp[ i ].getLocalPort(), _rtcp[ i ].getLocalPort() ) );
+			}
+
+			pair< boost::shared_ptr< Peer >, boost::shared_ptr< Peer > > Service::open( const string & host, TPortPair remote, bool mux ) throw( KGD::Socket::Exception )
+			{
+				size_t i;
+				{
+					KGD::Lock lk( _mux );
+					i = _next ++ % _rtp.size();
+				}
+
+				pair< boost::shared_ptr< Peer >, boost::shared_ptr< Peer > > rt;
+				rt.first.reset( new Peer( _rtp[ i ], remote.first, host ) );
+				if ( mux )
+					rt.second = rt.first;
+				else
+					rt.second.reset( new Peer( _rtcp[ i ], remote.second, host ) );
+
+				return rt;
+			}
+		}
+	}
+}
@@ -0,0 +1,209 @@
+/*************************************************************************
+ *
+ * Kinoglaz Streaming Server Daemon
+ * Copyright (C) 2010 Emiliano Leporati ( emiliano.leporati@gmail.com )
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *************************************************************************
+ *
+ * File name: src/rtsp/egress.h
+ * First submitted: 2026-10-18
+ * First submitter: agent <agent@local>
+ * Contributor(s) so far - 2026-10-18 :
+ *     agent <agent@local>
+ *
+ * Last changes :
+ *     server-wide udp sockets shared by client tracks
+ *
+ **/
+
+
+#ifndef __KGD_RTSP_EGRESS_H
+#define __KGD_RTSP_EGRESS_H
+
+#include "lib/socket.h"
+#include "lib/poller.h"
+#include "lib/utils/singleton.hpp"
+
+#include <map>
+#include <vector>
+
+extern "C"
+{
+#include <sys/socket.h>
+}
+
+using namespace std;
+
+namespace KGD
+{
+	namespace RTSP
+	{
+		//! udp tracks sent through a few server sockets instead of a socket each
+		namespace Egress
+		{
+			class Peer;
+
+			//! a server socket bound once, sending for many peers and demultiplexing what they send back
+			class Link
+			: public KGD::Socket::Udp
+			, public Poller::Handler
+			{
+			private:
+				//! outcome of the packets of a writer
+				struct Result
+				{
+					int err;
+				};
+
+				//! messages waiting for the next batch
+				vector< mmsghdr > _msgs;
+				//! destination of each message
+				vector< sockaddr_in > _addrs;
+				//! writer of each message
+				vector< Result * > _owners;
+				//! batches taken and sent
+				uint64_t _taken, _sent;
+				//! a writer is sending a batch
+				bool _sending;
+				//! protects the batch
+				KGD::Mutex _outMux;
+				//! signals a batch sent
+				Condition _batchSent;
+
+				//! peers by address
+				map< uint64_t, Peer * > _byAddr;
+				//! peers by RTP session ssrc
+				map< TSSrc, Peer * > _bySsrc;
+				//! protects peers
+				KGD::Mutex _mux;
+
+				//! event loops watching the socket
+				Singleton::Class< Poller >::Reference _poller;
+
+				//! sends a batch of messages, recording failures
+				void sendBatch( vector< mmsghdr > &, vector< sockaddr_in > &, vector< Result * > & ) throw();
+				//! finds the peer reported on by a RTCP packet; lock must be held
+				Peer * findReported( const uint8_t *, size_t ) throw();
+
+				friend class Peer;
+			public:
+				//! binds a port
+				Link( TPort ) throw( KGD::Socket::Exception );
+				//! stops receiving
+				~Link() throw();
+
+				//! resolves a client address
+				sockaddr_in resolve( TPort, const string & ) const throw( KGD::Socket::Exception );
+				//! sends whole packets to a peer, batched with those of other writers
+				void send( const Peer &, const iovec *, size_t ) throw( KGD::Socket::Exception );
+
+				//! socket descriptor
+				virtual int getPollDescriptor() const throw();
+				//! receives and demultiplexes by source address, or by ssrc of the reports
+				virtual void onReadable() throw();
+			};
+
+			//! a client end-point reached through a link
+			class Peer
+			: public Channel::Bi
+			{
+			private:
+				//! the link
+				Link & _link;
+				//! client address, changed if the client shows up from another one
+				sockaddr_in _remote;
+				//! client port asked for
+				const TPort _port;
+				//! RTP session ssrc, 0 if unknown
+				TSSrc _ssrc;
+				//! takes inbound data
+				Channel::Sink * _sink;
+				//! no more writes
+				bool _closed;
+
+				friend class Link;
+			public:
+				//! registers on a link
+				Peer( Link &, TPort, const string & ) throw( KGD::Socket::Exception );
+				//! leaves the link
+				~Peer() throw();
+
+				//! demultiplexes reports on this ssrc too
+				void setSsrc( TSSrc ) throw();
+
+				//! sends a datagram
+				virtual size_t writeSome( void const *, size_t ) throw( KGD::Socket::Exception );
+				//! sends a datagram
+				virtual size_t writeLast( void const *, size_t ) throw( KGD::Socket::Exception );
+				//! sends datagrams in a single batch
+				virtual void writePackets( const iovec *, size_t, bool more = false, bool droppable = false ) throw( KGD::Socket::Exception );
+				//! nothing to read, data goes to the sink
+				virtual size_t readSome( void *, size_t ) throw( KGD::Socket::Exception );
+				//! hands inbound data to a sink
+				virtual bool setSink( Channel::Sink * ) throw();
+
+				//! invalid operation
+				virtual void setWriteBufferSize( size_t ) throw( );
+				//! invalid operation
+				virtual void setWriteBlock( bool ) throw( );
+				//! invalid operation
+				virtual void setWriteTimeout( double ) throw( );
+				//! is write blocking
+				virtual bool isWriteBlock( ) const throw();
+				//! invalid operation
+				virtual void setReadBlock( bool ) throw( );
+				//! invalid operation
+				virtual void setReadTimeout( double ) throw( );
+				//! is read blocking
+				virtual bool isReadBlock( ) const throw();
+				//! stops writing
+				virtual void close() throw();
+				//! get description
+				virtual Channel::Description getDescription() const;
+			};
+
+			//! the links, in RTP / RTCP pairs on consecutive ports
+			class Service
+			: public Singleton::Class< Service >
+			{
+			private:
+				//! RTP links
+				boost::ptr_vector< Link > _rtp;
+				//! RTCP links
+				boost::ptr_vector< Link > _rtcp;
+				//! next pair to hand out
+				size_t _next;
+				//! protects the round robin
+				KGD::Mutex _mux;
+
+				//! ctor, binds the links
+				Service() throw( KGD::Socket::Exception, KGD::Exception::NotFound );
+				friend class Singleton::Class< Service >;
+			public:
+				//! releases the ports
+				~Service();
+
+				//! link pairs, 0 for a socket per track
+				static size_t SOCKETS;
+
+				//! RTP and RTCP peers of a client, the same one with rtcp-mux
+				pair< boost::shared_ptr< Peer >, boost::shared_ptr< Peer > > open( const string & host, TPortPair, bool mux ) throw( KGD::Socket::Exception );
+			};
+		}
+	}
+}
+
+#endif
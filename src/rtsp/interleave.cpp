@@ -25,6 +25,14 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     pooled ports in channel descriptions
+ *     rtcp-mux in channel descriptions
+ *     inbound data handed to a sink
+ *     backlog of the output queue and kernel
+ *     bounded output queue for slow peers, control ahead of media
+ *     interleaved packets written in a single send, no envelope copy
+ *     parsed messages are returned, not thrown
+ *     non blocking receive and incremental parse driven by the poller
  *     fixed RTSP buffer enqueue
  *     "would block" cleanup
  *     added param for tcp socket send buffer
@@ -38,6 +46,8 @@
 #include "lib/array.hpp"
 #include "daemon.h"
 
+#include <cstring>
+
 namespace KGD
 {
 	namespace RTSP
@@ -54,6 +64,7 @@ namespace KGD
 		, _rtspSocket( sock )
 		, _rdTimeout( -1 )
 		, _running( true )
+		, _sink( 0 )
 		, _logName( sock.getLogName() + string( " CHANNEL $" ) + toString( local ) )
 		{
 			Log::verbose("%s: created", getLogName() );
@@ -93,11 +104,30 @@ namespace KGD
 			Log::verbose( "%s: pushing %u bytes to read", getLogName(), sz );
 			{
 				InputBuffer::Lock lk( _recv );
+				if ( _sink )
+				{
+					_sink->onData( data, sz );
+					return;
+				}
 				(*_recv).push_back( new ByteArray( data, sz ) );
 			}
 
 			_condNotEmpty.notify_all();
 		}
+
+		bool Interleave::setSink( Channel::Sink * s ) throw()
+		{
+			InputBuffer::Lock lk( _recv );
+			_sink = s;
+			// what came before
+			if ( _sink )
+			{
+				BOOST_FOREACH( const ByteArray & b, *_recv )
+					_sink->onData( b.get(), b.size() );
+				(*_recv).clear();
+			}
+			return true;
+		}
 		void Interleave::close() throw()
 		{
 			Log::debug("%s: stopping", getLogName() );
@@ -114,37 +144,71 @@ namespace KGD
 			}
 		}
 
-		size_t Interleave::writeSome( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+		void Interleave::writePackets( const iovec * v, size_t n, bool more, bool droppable ) throw( KGD::Socket::Exception )
 		{
-			ByteArray envelope( 4 + sz );
-			envelope[0] = '$';
-			envelope[1] = _remote;
-			envelope
-				.set( htons( sz ), 2 )
-				.set( data, sz, 4 );
+			if ( ! _running )
+				throw KGD::Socket::Exception( "writePackets", "connection shut down" );
+			else if ( n == 0 )
+				return;
 
+			// a header and a payload buffer for each packet, no copies unless queued
+			TcpTunnel::Lock lk( _sock );
+			_out.resize( 2 * n );
+			_headers.resize( 4 * n );
+			for( size_t i = 0; i < n; ++i )
 			{
-				if ( _running )
-				{
-					TcpTunnel::Lock lk( _sock );
-					// not counting header bytes
-					return (*_sock)->writeSome( envelope.get(), envelope.size() ) - 4;
-				}
-				else
-					throw KGD::Socket::Exception( "writeSome", "connection shut down" );
+				uint8_t * hdr = &_headers[ 4 * i ];
+				uint16_t sz = htons( v[ i ].iov_len );
+				hdr[ 0 ] = '$';
+				hdr[ 1 ] = _remote;
+				memcpy( hdr + 2, &sz, 2 );
+
+				_out[ 2 * i ].iov_base = hdr;
+				_out[ 2 * i ].iov_len = 4;
+				_out[ 2 * i + 1 ] = v[ i ];
 			}
+			_rtspSocket.send( &_out[0], 2 * n, 2, ( droppable ? Socket::Output::DROPPABLE : Socket::Output::MEDIA ), more );
 		}
 
-		size_t Interleave::writeLast( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+		void Interleave::flush() throw()
 		{
 			if ( _running )
 			{
 				TcpTunnel::Lock lk( _sock );
-				(*_sock)->setLastPacket( true );
-				return this->writeSome( data, sz );
+				if ( *_sock )
+					(*_sock)->flush();
 			}
-			else
-				throw KGD::Socket::Exception( "writeLast", "connection shut down" );
+		}
+
+		size_t Interleave::getBacklog() throw()
+		{
+			return _rtspSocket.getBacklog();
+		}
+
+		size_t Interleave::writeSome( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+		{
+			if ( ! _running )
+				throw KGD::Socket::Exception( "writeSome", "connection shut down" );
+
+			uint8_t hdr[ 4 ];
+			uint16_t nsz = htons( sz );
+			hdr[ 0 ] = '$';
+			hdr[ 1 ] = _remote;
+			memcpy( hdr + 2, &nsz, 2 );
+
+			iovec v[ 2 ];
+			v[ 0 ].iov_base = hdr;
+			v[ 0 ].iov_len = 4;
+			v[ 1 ].iov_base = const_cast< void * >( data );
+			v[ 1 ].iov_len = sz;
+			// RTCP goes ahead of media
+			_rtspSocket.send( v, 2, 2, Socket::Output::CONTROL, false );
+			return sz;
+		}
+
+		size_t Interleave::writeLast( void const * data, size_t sz ) throw( KGD::Socket::Exception )
+		{
+			return this->writeSome( data, sz );
 		}
 
 		template< class L >
@@ -262,21 +326,39 @@ namespace KGD
 			Channel::Description rt;
 			rt.type = Channel::Shared;
 			rt.ports = make_pair( _channel, _channel );
+			rt.mux = false;
+			rt.pooled = false;
 
 			return rt;
 		}
 
 		// ******************************************************************************************************************
 
+		size_t Socket::OUTPUT_QUEUE = 512 * 1024;
+
 		Socket::Socket( auto_ptr< KGD::Socket::Tcp > sk, const string & parentLogName )
 		: _cseq( 0 )
 		, _logName( parentLogName + " SOCKET" )
+		, _outQueued( 0 )
+		, _pollHandler( 0 )
 		{
 			(*_sock).reset( sk.release() );
-			(*_sock)->setReadBlock( true );
-			(*_sock)->setWriteBlock( true );
-			(*_sock)->setWriteTimeout( KGD::Socket::WRITE_TIMEOUT );
+			// reads happen when the poller tells data is there, writes never wait for a slow peer
+			(*_sock)->setReadBlock( false );
+			(*_sock)->setWriteBlock( false );
 			(*_sock)->setWriteBufferSize( KGD::Socket::WRITE_BUFFER_SIZE );
+			// keep the backlog in the output queue, where it's visible and can be dropped
+			if ( KGD::Socket::NOTSENT_LOWAT )
+			{
+				try
+				{
+					(*_sock)->setNotSentLowat( KGD::Socket::NOTSENT_LOWAT );
+				}
+				catch( const KGD::Socket::Exception & e )
+				{
+					Log::debug( "%s: %s", getLogName(), e.what() );
+				}
+			}
 		}
 
 		Socket::~Socket()
@@ -299,6 +381,11 @@ namespace KGD
 				}
 				Log::debug("%s: no more interleaves", getLogName());
 
+				// last replies, as far as they go
+				this->drain();
+				if ( _outQueued )
+					Log::debug( "%s: %lu bytes not sent", getLogName(), _outQueued );
+
 				(*_sock)->close();
 				Log::debug("%s: closed", getLogName());
 			}
@@ -407,76 +494,275 @@ namespace KGD
 				return *it->second;
 		}
 
-		void Socket::listen() throw( Message::Request *, Message::Response *, KGD::Exception::Generic )
+		int Socket::getDescriptor() const throw()
 		{
-			ByteArray receiveBuffer( 1024 );
-			for(;;)
+			return (*_sock)->getFileDescriptor();
+		}
+
+		bool Socket::isOpen() const throw()
+		{
+			return *_sock && (*_sock)->getFileDescriptor() >= 0;
+		}
+
+		void Socket::setPollHandler( Poller::Handler & h ) throw()
+		{
+			TcpTunnel::Lock lk( _sock );
+			_pollHandler = &h;
+		}
+
+		void Socket::send( const iovec * v, size_t n, size_t group, Output::type t, bool more ) throw( KGD::Socket::Exception )
+		{
+			size_t total = 0;
+			for( size_t i = 0; i < n; ++i )
+				total += v[ i ].iov_len;
+
+			TcpTunnel::Lock lk( _sock );
+			if ( ! *_sock )
+				throw KGD::Socket::Exception( "send", "connection shut down" );
+
+			size_t sent = 0;
+			if ( _outQueued == 0 )
 			{
-				// read bytes from underlying socket
-				size_t receivedBytes = (*_sock)->Channel::In::readSome( receiveBuffer );
-
-				// put in parser buffer
-				_inBuf.enqueue( receiveBuffer.get(), receivedBytes );
-				// get next packet length
-				size_t msgSz = _inBuf.getNextPacketLength();
-				if ( msgSz )
+				try
 				{
-					// try if a request
-					try
-					{
-						auto_ptr< Message::Request > rq( _inBuf.getNextRequest( msgSz, (*_sock)->getRemoteHost() ) );
-						_cseq = rq->getCseq();
+					sent = (*_sock)->writeVector( v, n, more );
+				}
+				catch( const KGD::Socket::Exception & e )
+				{
+					if ( ! e.wouldBlock() )
+						throw;
+				}
+				if ( sent == total )
+					return;
+			}
+			// slow peer: whole frames are dropped, key ones only when far behind
+			else if ( ( t == Output::DROPPABLE && _outQueued + total > OUTPUT_QUEUE )
+				|| ( t == Output::MEDIA && _outQueued + total > 2 * OUTPUT_QUEUE ) )
+				throw KGD::Socket::Exception( "send", EAGAIN );
+
+			const bool wasIdle = ( _outQueued == 0 );
+			// the rest is copied, a packet at a time
+			for( size_t i = 0; i < n; i += group )
+			{
+				size_t k = min( group, n - i ), sz = 0;
+				for( size_t j = 0; j < k; ++j )
+					sz += v[ i + j ].iov_len;
+				if ( sent >= sz )
+				{
+					sent -= sz;
+					continue;
+				}
 
-						Log::message( "%s: request: %s", getLogName(), Method::name[ rq->getMethodID() ].c_str() );
-						Log::request( rq->get() );
+				const bool partial = ( sent > 0 );
+				auto_ptr< ByteArray > pkt( new ByteArray( sz - sent ) );
+				size_t off = 0;
+				for( size_t j = 0; j < k; ++j )
+				{
+					const iovec & b = v[ i + j ];
+					size_t skip = min( sent, b.iov_len );
+					memcpy( pkt->get() + off, reinterpret_cast< const uint8_t * >( b.iov_base ) + skip, b.iov_len - skip );
+					off += b.iov_len - skip;
+					sent -= skip;
+				}
+
+				_outQueued += pkt->size();
+				if ( partial )
+					_outPartial.reset( pkt.release() );
+				else if ( t == Output::CONTROL )
+					_outControl.push_back( pkt );
+				else
+					_outMedia.push_back( pkt );
+			}
+
+			if ( wasIdle && _pollHandler )
+				Poller::getInstance()->watchWrite( *_pollHandler, true );
+		}
+
+		size_t Socket::getBacklog() throw()
+		{
+			TcpTunnel::Lock lk( _sock );
+			return _outQueued + ( *_sock ? (*_sock)->getBacklog() : 0 );
+		}
+
+		void Socket::drain() throw()
+		{
+			TcpTunnel::Lock lk( _sock );
+			while( _outQueued )
+			{
+				// partial packet, then control, then media
+				const size_t MAX_IOV = 64;
+				iovec v[ MAX_IOV ];
+				size_t n = 0;
+				if ( _outPartial )
+				{
+					v[ n ].iov_base = _outPartial->get();
+					v[ n ++ ].iov_len = _outPartial->size();
+				}
+				for( boost::ptr_deque< ByteArray >::iterator it = _outControl.begin(); it != _outControl.end() && n < MAX_IOV; ++it, ++n )
+				{
+					v[ n ].iov_base = it->get();
+					v[ n ].iov_len = it->size();
+				}
+				for( boost::ptr_deque< ByteArray >::iterator it = _outMedia.begin(); it != _outMedia.end() && n < MAX_IOV; ++it, ++n )
+				{
+					v[ n ].iov_base = it->get();
+					v[ n ].iov_len = it->size();
+				}
 
-						throw rq.release();
+				size_t wrote;
+				try
+				{
+					if ( ! *_sock )
+						throw KGD::Socket::Exception( "drain", "connection shut down" );
+					wrote = (*_sock)->writeVector( v, n );
+				}
+				catch( const KGD::Socket::Exception & e )
+				{
+					if ( e.wouldBlock() )
+						return;
+
+					Log::debug( "%s: dropping %lu queued bytes: %s", getLogName(), _outQueued, e.what() );
+					_outPartial.reset();
+					_outControl.clear();
+					_outMedia.clear();
+					_outQueued = 0;
+					break;
+				}
+
+				// take out what was sent, in the same order
+				_outQueued -= wrote;
+				if ( _outPartial )
+				{
+					if ( wrote < _outPartial->size() )
+					{
+						_outPartial->chopFront( wrote );
+						continue;
 					}
-					catch( KGD::Exception::NotFound )
+					wrote -= _outPartial->size();
+					_outPartial.reset();
+				}
+				boost::ptr_deque< ByteArray > * queues[] = { &_outControl, &_outMedia };
+				for( size_t q = 0; q < 2 && wrote > 0; ++q )
+					while( wrote > 0 && ! queues[ q ]->empty() )
 					{
-						// try if a response
-						try
+						if ( wrote < queues[ q ]->front().size() )
 						{
-							auto_ptr< Message::Response > resp = _inBuf.getNextResponse( msgSz );
-							if ( resp->getCseq() != _cseq )
-								throw RTSP::Exception::CSeq();
-
-							throw resp.release();
+							_outPartial.reset( queues[ q ]->pop_front().release() );
+							_outPartial->chopFront( wrote );
+							wrote = 0;
 						}
-						catch( KGD::Exception::NotFound )
+						else
 						{
-							// try interleaved
-							try
-							{
-								pair< TPort, boost::shared_ptr< RTP::Packet > > intlv( _inBuf.getNextInterleave( msgSz ) );
-								this->getInterleaveRef( intlv.first ).pushToRead( intlv.second->data );
-
-							}
-							catch( KGD::Exception::NotFound )
-							{
-								// deque
-								Log::error( "%s: unrecognized inbound packet, dequeuing %lu bytes", getLogName(), msgSz );
-								_inBuf.dequeue( msgSz );
-							}
+							wrote -= queues[ q ]->front().size();
+							queues[ q ]->pop_front();
 						}
 					}
-					catch ( const RTSP::Exception::ManagedError &e)
+			}
+
+			if ( _pollHandler )
+				Poller::getInstance()->watchWrite( *_pollHandler, false );
+		}
+
+		bool Socket::receive() throw()
+		{
+			ByteArray receiveBuffer( 4096 );
+			for(;;)
+			{
+				try
+				{
+					size_t receivedBytes = (*_sock)->Channel::In::readSome( receiveBuffer );
+					// put in parser buffer
+					_inBuf.enqueue( receiveBuffer.get(), receivedBytes );
+				}
+				catch( const KGD::Socket::Exception & e )
+				{
+					if ( e.wouldBlock() )
+						return true;
+
+					Log::debug( "%s: %s", getLogName(), e.what() );
+					return false;
+				}
+			}
+		}
+
+		namespace
+		{
+			//! responses start with the protocol, requests with the method
+			bool isResponse( const char * data, size_t sz ) throw()
+			{
+				static const char PROTO[] = "RTSP/";
+				size_t i = 0;
+				while( i < sz && ( data[i] == '\r' || data[i] == '\n' ) )
+					++ i;
+				return sz - i >= sizeof( PROTO ) - 1 && memcmp( data + i, PROTO, sizeof( PROTO ) - 1 ) == 0;
+			}
+		}
+
+		Socket::Inbound::type Socket::parse( auto_ptr< Message::Request > & rq, auto_ptr< Message::Response > & resp ) throw( KGD::Socket::Exception )
+		{
+			// get next packet length, 0 while incomplete
+			size_t msgSz;
+			while( ( msgSz = _inBuf.getNextPacketLength() ) != 0 )
+			{
+				const char * data = _inBuf.getDataBegin();
+				const size_t buffered = _inBuf.getDataLength();
+				try
+				{
+					if ( data[0] == '$' )
 					{
-						Log::error( "%s: %s", getLogName(), e.what() );
-						this->reply( e.getError() );
+						// interleaved data goes to its channel
+						pair< TPort, boost::shared_ptr< RTP::Packet > > intlv( _inBuf.getNextInterleave( msgSz ) );
+						try
+						{
+							this->getInterleaveRef( intlv.first ).pushToRead( intlv.second->data );
+						}
+						catch( const KGD::Exception::NotFound & e )
+						{
+							Log::debug( "%s: dropping interleaved packet, no %s", getLogName(), e.what() );
+						}
 					}
-					catch ( const KGD::Socket::Exception & )
+					else if ( isResponse( data, msgSz ) )
 					{
-						throw;
+						resp = _inBuf.getNextResponse( msgSz );
+						if ( resp->getCseq() != _cseq )
+							throw RTSP::Exception::CSeq();
+
+						return Inbound::RESPONSE;
 					}
-					catch ( const KGD::Exception::Generic &e)
+					else
 					{
-						Log::error( "%s: %s", getLogName(), e.what() );
+						rq = _inBuf.getNextRequest( msgSz, (*_sock)->getRemoteHost() );
+						_cseq = rq->getCseq();
+
+						Log::message( "%s: request: %s", getLogName(), Method::name[ rq->getMethodID() ].c_str() );
+						Log::request( rq->get() );
+
+						return Inbound::REQUEST;
 					}
+				}
+				catch ( const RTSP::Exception::ManagedError &e)
+				{
+					Log::error( "%s: %s", getLogName(), e.what() );
+					this->reply( e.getError() );
+				}
+				catch ( const KGD::Socket::Exception & )
+				{
+					throw;
+				}
+				catch ( const KGD::Exception::Generic &e)
+				{
+					Log::error( "%s: %s", getLogName(), e.what() );
+				}
 
+				// a message failing to parse is still in the buffer
+				if ( _inBuf.getDataLength() == buffered )
+				{
+					Log::error( "%s: unrecognized inbound packet, dequeuing %lu bytes", getLogName(), msgSz );
+					_inBuf.dequeue( msgSz );
 				}
 			}
-			Log::message( "%s: connection loop terminated", getLogName() );
+
+			return Inbound::NOTHING;
 		}
 
 
@@ -492,14 +778,15 @@ namespace KGD
 
 		size_t Socket::writeSome( void const * data, size_t sz ) throw( KGD::Socket::Exception )
 		{
-			TcpTunnel::Lock lk( _sock );
-			return (*_sock)->writeSome( data, sz );
+			iovec v;
+			v.iov_base = const_cast< void * >( data );
+			v.iov_len = sz;
+			this->send( &v, 1, 1, Output::CONTROL, false );
+			return sz;
 		}
 
 		size_t Socket::writeLast( void const * data, size_t sz ) throw( KGD::Socket::Exception )
 		{
-			TcpTunnel::Lock lk( _sock );
-			(*_sock)->setLastPacket( true );
 			return this->writeSome( data, sz );
 		}
 
@@ -528,30 +815,7 @@ namespace KGD
 			string msg = o.str();
 			Log::reply( msg );
 
-			{
-				TcpTunnel::Lock lk( _sock );
-
-				size_t sent = 0, len = msg.size();
-				uint8_t tries = 0;
-				const char * data = msg.c_str();
-
-				while( sent < len )
-				{
-					try
-					{
-						size_t wrote = (*_sock)->writeSome( data, len - sent );
-						data += wrote;
-						sent += wrote;
-					}
-					catch( KGD::Socket::Exception const & e )
-					{
-						if ( e.wouldBlock() && tries ++ < 5 )
-							Log::debug( "%s: socket would block in writeAll (%s) - %u", getLogName(), e.what(), tries );
-						else
-							throw;
-					}
-				}
-			}
+			this->writeSome( msg.data(), msg.size() );
 		}
 
 
@@ -25,6 +25,12 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     inbound data handed to a sink
+ *     backlog of the output queue and kernel
+ *     bounded output queue for slow peers, control ahead of media
+ *     interleaved packets written in a single send, no envelope copy
+ *     parsed messages are returned, not thrown
+ *     non blocking receive and incremental parse driven by the poller
  *     "would block" cleanup
  *     added param for tcp socket send buffer
  *     english comments; removed leak with connection serving threads
@@ -40,6 +46,9 @@
 #include "lib/socket.h"
 #include "rtsp/buffer.h"
 #include "rtsp/ports.h"
+#include "lib/poller.h"
+
+#include <boost/ptr_container/ptr_deque.hpp>
 
 namespace KGD
 {
@@ -78,8 +87,14 @@ namespace KGD
 			Condition _condNotEmpty;
 			//! running flag
 			Safe::Bool _running;
+			//! takes inbound data instead of the receive buffer, if set
+			Channel::Sink * _sink;
 			//! log identifier
 			const string _logName;
+			//! header and payload buffers of the packets being written
+			vector< iovec > _out;
+			//! headers of the packets being written
+			vector< uint8_t > _headers;
 
 			//! internal utility
 			template< class L >
@@ -97,6 +112,12 @@ namespace KGD
 			virtual size_t writeSome( void const *, size_t ) throw( KGD::Socket::Exception );
 			//! write to socket
 			virtual size_t writeLast( void const *, size_t ) throw( KGD::Socket::Exception );
+			//! writes packets with their headers through the connection output queue
+			virtual void writePackets( const iovec *, size_t, bool more = false, bool droppable = false ) throw( KGD::Socket::Exception );
+			//! pushes out packets held back
+			virtual void flush() throw();
+			//! bytes queued on the connection or in kernel, not yet sent
+			virtual size_t getBacklog() throw();
 			//! read from buffer
 			virtual size_t readSome( void *, size_t ) throw( KGD::Socket::Exception );
 			//! interlocked read from buffer
@@ -120,6 +141,8 @@ namespace KGD
 			virtual bool isReadBlock( ) const throw();
 			//! get description
 			virtual Channel::Description getDescription() const;
+			//! hands inbound data to a sink instead of the receive buffer
+			virtual bool setSink( Channel::Sink * ) throw();
 			//! push to buffer
 			void pushToRead( void const *, size_t ) throw( );
 			//! push to buffer
@@ -136,6 +159,15 @@ namespace KGD
 		: public boost::noncopyable
 		, public Channel::Out
 		{
+		public:
+			//! bytes queued for a slow peer beyond which droppable media is discarded
+			static size_t OUTPUT_QUEUE;
+
+			//! what is being written
+			struct Output
+			{
+				enum type { CONTROL, MEDIA, DROPPABLE };
+			};
 		protected:
 			typedef map< TPort, ref< Interleave > > ChannelMap;
 			//! shared tcp socket
@@ -154,9 +186,21 @@ namespace KGD
 			TCseq _cseq;
 			//! log identifier
 			const string _logName;
+			//! queued replies and RTCP, sent ahead of media
+			boost::ptr_deque< ByteArray > _outControl;
+			//! queued media packets
+			boost::ptr_deque< ByteArray > _outMedia;
+			//! rest of a packet partly sent, goes out before anything else
+			boost::scoped_ptr< ByteArray > _outPartial;
+			//! bytes queued
+			size_t _outQueued;
+			//! handler watched for writability while output is queued
+			Poller::Handler * _pollHandler;
 
 			//! internal utility
 			void reply( const ostringstream & o ) throw( KGD::Socket::Exception );
+			//! sends packets of a number of buffers each without blocking, queueing what doesn't go out
+			void send( const iovec *, size_t n, size_t group, Output::type, bool more ) throw( KGD::Socket::Exception );
 			
 			//! will be called by Interleave destructor
 			void release( TPort );
@@ -179,8 +223,26 @@ namespace KGD
 			TPortPair addInterleavePair( const TPortPair & remote, const TSessionID & ) throw( KGD::Exception::NotFound );
 			//! get interleave channel p
 			boost::shared_ptr< Interleave > getInterleave( TPort p ) throw( KGD::Exception::NotFound );
-			//! listen for incoming messages
-			void listen() throw( Message::Request *, Message::Response *, KGD::Exception::Generic );
+			//! what a parse step found
+			struct Inbound
+			{
+				enum type { NOTHING, REQUEST, RESPONSE };
+			};
+
+			//! reads whatever arrived without blocking; false when the peer closed or the socket failed
+			bool receive() throw();
+			//! dispatches buffered interleaves and returns the next complete request or response, nothing when none is left
+			Inbound::type parse( auto_ptr< Message::Request > &, auto_ptr< Message::Response > & ) throw( KGD::Socket::Exception );
+			//! returns the tcp descriptor to poll
+			int getDescriptor() const throw();
+			//! tells if the tcp socket is still open
+			bool isOpen() const throw();
+			//! sets the handler to watch for writability while output is queued
+			void setPollHandler( Poller::Handler & ) throw();
+			//! sends queued output as far as it goes without blocking
+			void drain() throw();
+			//! bytes queued or in kernel, not yet sent
+			virtual size_t getBacklog() throw();
 			//! begins shutdown of all interleaved channels
 			void stopInterleaving() throw();
 			//! begins shutdown of all interleaved channels for a specific RTSP session
@@ -25,6 +25,10 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     headers past the first 32 kept instead of dropped
+ *     pooled ports in channel descriptions
+ *     rtcp-mux and single client port in Transport
+ *     single pass message parser, no regular expressions
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     boosted
  *     Some cosmetics about enums and RTCP library
@@ -43,10 +47,16 @@
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <cctype>
+#include <algorithm>
 
-#include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 
+extern "C"
+{
+#include <strings.h>
+}
+
 
 using namespace std;
 
@@ -59,53 +69,219 @@ namespace KGD
 
 			// ***********************************************************************************************************************************
 
-			Parser::Parser( const char * data , size_t sz ) throw( )
+			namespace
+			{
+				//! gets the line at p, moving p to the next one; false at the end
+				bool nextLine( const char * & p, const char * ed, Parser::Token & line ) throw()
+				{
+					if ( p >= ed )
+						return false;
+
+					const char * eol = static_cast< const char * >( memchr( p, '\n', ed - p ) );
+					if ( ! eol )
+						eol = ed;
+					const char * end = eol;
+					if ( end > p && end[-1] == '\r' )
+						-- end;
+
+					line = Parser::Token( p, end - p );
+					p = ( eol < ed ? eol + 1 : ed );
+					return true;
+				}
+
+				//! splits a header line in name and trimmed value; false if not a header
+				bool splitHeader( const Parser::Token & line, Parser::Token & name, Parser::Token & value ) throw()
+				{
+					const char * colon = static_cast< const char * >( memchr( line.ptr, ':', line.len ) );
+					if ( ! colon || colon == line.ptr )
+						return false;
+
+					const char * v = colon + 1, * e = line.ptr + line.len;
+					while( v < e && ( *v == ' ' || *v == '\t' ) )
+						++ v;
+					while( e > v && ( e[-1] == ' ' || e[-1] == '\t' ) )
+						-- e;
+
+					name = Parser::Token( line.ptr, colon - line.ptr );
+					value = Parser::Token( v, e - v );
+					return true;
+				}
+
+				//! header names are case insensitive
+				bool sameName( const char * n, size_t len, const string & header ) throw()
+				{
+					return len == header.size() && strncasecmp( n, header.data(), len ) == 0;
+				}
+
+				//! parses digits with an optional fraction
+				bool toDecimal( const Parser::Token & t, double & rt ) throw()
+				{
+					if ( t.empty() || ! isdigit( t.ptr[0] ) )
+						return false;
+
+					bool point = false;
+					for( size_t i = 1; i < t.len; ++i )
+						if ( t.ptr[i] == '.' && ! point )
+							point = true;
+						else if ( ! isdigit( t.ptr[i] ) )
+							return false;
+
+					// a token never ends a message: the parser buffer is null terminated
+					rt = strtod( t.ptr, 0 );
+					return true;
+				}
+			}
+
+			// ***********************************************************************************************************************************
+
+			Parser::Token::Token() throw()
+			: ptr( 0 )
+			, len( 0 )
+			{
+			}
+
+			Parser::Token::Token( const char * p, size_t l ) throw()
+			: ptr( p )
+			, len( l )
+			{
+			}
+
+			string Parser::Token::str() const
+			{
+				return string( ptr, len );
+			}
+
+			bool Parser::Token::empty() const throw()
+			{
+				return len == 0;
+			}
+
+			bool Parser::Token::operator==( const char * s ) const throw()
+			{
+				return strlen( s ) == len && memcmp( ptr, s, len ) == 0;
+			}
+
+			bool Parser::Token::operator==( const string & s ) const throw()
+			{
+				return s.size() == len && memcmp( ptr, s.data(), len ) == 0;
+			}
+
+			Parser::Token Parser::Token::before( char c ) const throw()
+			{
+				const char * p = static_cast< const char * >( memchr( ptr, c, len ) );
+				return Token( ptr, p ? p - ptr : len );
+			}
+
+			Parser::Token Parser::Token::after( char c ) const throw()
+			{
+				const char * p = static_cast< const char * >( memchr( ptr, c, len ) );
+				return ( p ? Token( p + 1, ptr + len - p - 1 ) : Token( ptr + len, 0 ) );
+			}
+
+			bool Parser::Token::toUnsigned( uint64_t & rt ) const throw()
+			{
+				if ( len == 0 || len > 19 )
+					return false;
+
+				rt = 0;
+				for( size_t i = 0; i < len; ++i )
+					if ( isdigit( ptr[i] ) )
+						rt = rt * 10 + ( ptr[i] - '0' );
+					else
+						return false;
+				return true;
+			}
+
+			// ***********************************************************************************************************************************
+
+			Parser::Parser( const char * data , size_t sz )
 			: CharArray( sz + 1 )
 			, _cseq( 0 )
+			, _lineStart( 0 )
+			, _lineLen( 0 )
+			, _nFields( 0 )
 			{
 				CharArray::set( data, sz, 0 );
 				CharArray::set< char >( 0, sz );
+
+				// start line, then headers up to the first empty line
+				const char * p = _ptr, * ed = _ptr + sz;
+				Token line, name, value;
+				// stray line ends may precede a message
+				while( p < ed && ( *p == '\r' || *p == '\n' ) )
+					++ p;
+				if ( nextLine( p, ed, line ) )
+				{
+					_lineStart = line.ptr - _ptr;
+					_lineLen = line.len;
+					while( nextLine( p, ed, line ) && ! line.empty() )
+					{
+						if ( splitHeader( line, name, value ) )
+						{
+							Field f;
+							f.name = name.ptr - _ptr;
+							f.nameLen = name.len;
+							f.value = value.ptr - _ptr;
+							f.valueLen = value.len;
+							// rare: plenty of headers
+							if ( _nFields < MAX_HEADERS )
+								_fields[ _nFields ++ ] = f;
+							else
+								_moreFields.push_back( f );
+						}
+					}
+				}
 			}
 
-			pair< vector< string >, size_t > Parser::extractData( string::const_iterator bg, string::const_iterator ed, const string & rx ) const throw( KGD::Exception::NotFound )
+			bool Parser::findHeader( const char * bg, const char * ed, const string & header, Token & value ) throw()
 			{
-				boost::regex rxSearch( rx );
-				boost::match_results< string::const_iterator > match;
-				if (boost::regex_search(bg, ed, match, rxSearch))
-				{
-					vector< string > rt;
-					for( size_t i = 1; i < match.size(); ++i )
-						rt.push_back( match.str(i) );
+				const char * p = bg;
+				Token line, name;
+				// skip start line
+				if ( ! nextLine( p, ed, line ) )
+					return false;
 
-					return make_pair( rt, match.position() + match.length() );
-				}
-				else
-					throw KGD::Exception::NotFound( rx );
+				while( nextLine( p, ed, line ) && ! line.empty() )
+					if ( splitHeader( line, name, value ) && sameName( name.ptr, name.len, header ) )
+						return true;
+
+				return false;
 			}
-			vector< string > Parser::extractData( const string & rx ) const throw( KGD::Exception::NotFound )
+
+			Parser::Token Parser::getStartLine() const throw()
 			{
-				string data( _ptr );
-				return this->extractData( data.begin(), data.end(), rx ).first;
+				return Token( _ptr + _lineStart, _lineLen );
 			}
 
-			vector< string > Parser::extractHeaderData( const string & header, const string & rx ) const throw( KGD::Exception::NotFound )
+			bool Parser::getHeader( const string & header, Token & value ) const throw()
 			{
-				return this->extractData( EOL + header + ": " + rx + EOL );
+				for( size_t i = 0; i < _nFields + _moreFields.size(); ++i )
+				{
+					const Field & f = ( i < _nFields ? _fields[ i ] : _moreFields[ i - _nFields ] );
+					if ( sameName( _ptr + f.name, f.nameLen, header ) )
+					{
+						value = Token( _ptr + f.value, f.valueLen );
+						return true;
+					}
+				}
+				return false;
 			}
 
-			pair< vector< string >, size_t > Parser::extractHeaderData( const string & header, size_t offset , const string & rx) const throw( KGD::Exception::NotFound )
+			Parser::Token Parser::getHeader( const string & header ) const throw( KGD::Exception::NotFound )
 			{
-				string data( _ptr );
-				pair< vector< string >, size_t > rt = this->extractData( data.begin() + offset, data.end(), EOL + header + ": " + rx + EOL );
-				return make_pair( rt.first, rt.second + offset );
+				Token rt;
+				if ( this->getHeader( header, rt ) )
+					return rt;
+				else
+					throw KGD::Exception::NotFound( header );
 			}
 
-			void Parser::checkVersion( const string & v ) const throw( RTSP::Exception::ManagedError )
+			void Parser::checkVersion( const Token & v ) const throw( RTSP::Exception::ManagedError )
 			{
-				if ( v != "1.0")
+				if ( !( v == "1.0" ) )
 				{
 					if ( ! v.empty() )
-						Log::error("RTSP: unsupported version %s", v.c_str());
+						Log::error("RTSP: unsupported version %s", v.str().c_str());
 					throw RTSP::Exception::ManagedError( Error::VersionNotSupported );
 				}
 			}
@@ -122,12 +298,24 @@ namespace KGD
 			{
 				// first row must contain method, url and rtsp version
 				// <method> <url> RTSP/1.0
-				vector< string > requestData = this->extractData( "^\\s*(\\w+) (.+) RTSP/(\\d+\\.\\d+)" + EOL );
-				this->checkVersion( requestData[2] );
+				static const char PROTO[] = " RTSP/";
+				const Token line = this->getStartLine();
+				const char * p = line.ptr, * e = line.ptr + line.len;
+				while( p < e && isspace( *p ) )
+					++ p;
+				const char * method = p;
+				while( p < e && ( isalnum( *p ) || *p == '_' ) )
+					++ p;
+				// url goes up to the last protocol mark
+				const char * proto = find_end( p, e, PROTO, PROTO + sizeof( PROTO ) - 1 );
+				if ( p == method || p == e || *p != ' ' || proto == e || proto <= p + 1 )
+					throw KGD::Exception::NotFound( "request line" );
+
+				this->checkVersion( Token( proto + sizeof( PROTO ) - 1, e - proto - sizeof( PROTO ) + 1 ) );
 				// check method
 				try
 				{
-					_method = Method::getIDfromName( requestData[0] );
+					_method = Method::getIDfromName( Token( method, p - method ).str() );
 				}
 				catch( const KGD::Exception::NotFound & e )
 				{
@@ -136,15 +324,16 @@ namespace KGD
 				}
 
 				// scan other rows to get CSeq
-				try
+				uint64_t cseq;
+				Token cseqData;
+				if ( this->getHeader( Header::Cseq, cseqData ) && cseqData.toUnsigned( cseq ) )
 				{
-					string cseqData = this->extractHeaderData( Header::Cseq, "(\\d+)" ).at(0);
-					_cseq = fromString< TCseq >( cseqData );
+					_cseq = cseq;
 
 					// ok, update request URL
-					this->loadUrl( Url::decode( requestData[1] ), remoteHost );
+					this->loadUrl( Url::decode( Token( p + 1, proto - p - 1 ).str() ), remoteHost );
 				}
-				catch( KGD::Exception::NotFound )
+				else
 				{
 					Log::error("RTSP: no Cseq header");
 					throw RTSP::Exception::ManagedError( Error::BadRequest );
@@ -169,13 +358,13 @@ namespace KGD
 						// skip null path components
 						if ( urlParts[i].size() )
 						{
-							string::const_iterator start = urlParts[i].begin(), end = urlParts[i].end();
-							boost::regex rxTrack("^tk=(\\d+)$");
-							boost::match_results< string::const_iterator > match;
-							if (boost::regex_search(start, end, match, rxTrack))
-								u->track = match.str(1);
+							// tk=<digits>
+							uint64_t tk;
+							const string & part = urlParts[i];
+							if ( part.compare( 0, 3, "tk=" ) == 0 && Token( part.data() + 3, part.size() - 3 ).toUnsigned( tk ) )
+								u->track = part.substr( 3 );
 							else
-								pathParts.push_back( urlParts[i] );
+								pathParts.push_back( part );
 						}
 					}
 					u->file = join("/", pathParts);
@@ -207,7 +396,8 @@ namespace KGD
 
 			void Request::checkRequireHeader() const throw( RTSP::Exception::ManagedError )
 			{
-				if ( string( _ptr ).find( Header::Require ) != string::npos )
+				Token require;
+				if ( this->getHeader( Header::Require, require ) )
 				{
 					Log::error("RTSP: header \"Require\" not supported");
 					throw RTSP::Exception::ManagedError( Error::NotImplemented );
@@ -216,40 +406,37 @@ namespace KGD
 
 			void Request::checkAcceptHeader() const throw( RTSP::Exception::ManagedError )
 			{
-				try
+				Token mimeData;
+				// nothing to do
+				if ( ! this->getHeader( Header::Accept, mimeData ) )
+					return;
+
+				// comma separated mime types
+				const char * p = mimeData.ptr, * e = mimeData.ptr + mimeData.len;
+				while( p < e )
 				{
-					string mimeData = this->extractHeaderData( Header::Accept ).at(0);
-// 					Log::debug("RTSP: client accepts %s", mimeData.c_str());
-					vector< string > mimes = split( ", ", mimeData );
-					bool found = false;
-					for( size_t i = 0; i < mimes.size(); ++i )
-					{
-						if ( mimes[i] == "application/sdp" )
-						{
-							found = true;
-							break;
-						}
-					}
-					if ( !found )
-					{
-						Log::error("RTSP: accepted mime types does not includes \"application/sdp\", no other is supported");
-						throw RTSP::Exception::ManagedError( Error::NotImplemented );
-					}
+					while( p < e && *p == ' ' )
+						++ p;
+					Token mime = Token( p, e - p ).before( ',' );
+					if ( mime == "application/sdp" )
+						return;
+					p += mime.len + 1;
 				}
-				// nothing to do
-				catch( KGD::Exception::NotFound ) { }
+
+				Log::error("RTSP: accepted mime types does not includes \"application/sdp\", no other is supported");
+				throw RTSP::Exception::ManagedError( Error::NotImplemented );
 			}
 
 			// ***********************************************************************************************************************************
 
 			TSessionID Request::getSessionID() const throw( RTSP::Exception::ManagedError )
 			{
-				try
-				{
-					string sessionData = this->extractHeaderData( Header::Session ).at(0);
-					return fromString< TSessionID >( sessionData );
-				}
-				catch( KGD::Exception::NotFound )
+				// <id>[;timeout=<sec>]
+				uint64_t id;
+				Token sessionData;
+				if ( this->getHeader( Header::Session, sessionData ) && sessionData.before( ';' ).toUnsigned( id ) )
+					return TSessionID( id );
+				else
 				{
 					Log::error("RTSP: no Session header");
 					throw RTSP::Exception::ManagedError( Error::BadRequest );
@@ -258,72 +445,82 @@ namespace KGD
 
 			double Request::getScale() const throw( )
 			{
-				try
-				{
-					double rt;
-					vector< string > scaleData = this->extractHeaderData( Header::Scale, "(\\+|-)?\\s*(\\d+\\.\\d+)" );
-					rt = fromString< double >( scaleData.at(1) );
-					if ( scaleData.at(0) == "-" )
-						rt = -rt;
-// 					Log::debug("RTSP: Scale: %lf", rt);
-					return rt;
-				}
-				catch( KGD::Exception::NotFound )
-				{
+				Token scaleData;
+				if ( ! this->getHeader( Header::Scale, scaleData ) )
+					return HUGE_VAL;
+
+				// [+|-] <digits>.<digits>
+				bool negative = false;
+				const char * p = scaleData.ptr, * e = scaleData.ptr + scaleData.len;
+				if ( p < e && ( *p == '+' || *p == '-' ) )
+					negative = ( *p ++ == '-' );
+				while( p < e && isspace( *p ) )
+					++ p;
+
+				double rt;
+				if ( toDecimal( Token( p, e - p ), rt ) )
+					return ( negative ? -rt : rt );
+				else
 					return HUGE_VAL;
-				}
 			}
 
 			UserAgent::type Request::getUserAgent() const throw( )
 			{
-				try
-				{
-					string ua = this->extractHeaderData( Header::UserAgent ).at(0);
-					if ( ua == "VLC media player (LIVE555 Streaming Media v2008.07.24)" )
-						return UserAgent::VLC_1_0_2;
-					else if ( ua == "VLC media player (LIVE555 Streaming Media v2010.02.10)" )
-						return UserAgent::VLC_1_0_6;
-					else if ( ua == "LibVLC/1.1.4 (LIVE555 Streaming Media v2010.04.09)")
-						return UserAgent::VLC_1_1_4;
-					else
-						return UserAgent::Generic;
-				}
-				catch( KGD::Exception::NotFound )
-				{
+				Token ua;
+				if ( ! this->getHeader( Header::UserAgent, ua ) )
+					return UserAgent::Generic;
+				else if ( ua == "VLC media player (LIVE555 Streaming Media v2008.07.24)" )
+					return UserAgent::VLC_1_0_2;
+				else if ( ua == "VLC media player (LIVE555 Streaming Media v2010.02.10)" )
+					return UserAgent::VLC_1_0_6;
+				else if ( ua == "LibVLC/1.1.4 (LIVE555 Streaming Media v2010.04.09)")
+					return UserAgent::VLC_1_1_4;
+				else
 					return UserAgent::Generic;
-				}
 			}
 
 			pair< double, double > Request::getTimeRange() const throw( RTSP::Exception::ManagedError )
 			{
-				try
+				Token rangeData;
+				if ( ! this->getHeader( Header::Range, rangeData ) )
 				{
-					vector< string > rangeData = this->extractHeaderData( Header::Range, "(.+)=(now|\\d+|\\d+\\.\\d+)-(\\d+\\.\\d+)?" );
+					Log::error("RTSP: no Range header");
+					throw RTSP::Exception::ManagedError( Error::BadRequest );
+				}
 
-					if ( rangeData[0] != "npt" )
-						throw RTSP::Exception::ManagedError( Error::NotImplemented );
+				// <unit>=<now|from>-[to]
+				const Token unit = rangeData.before( '=' );
+				const Token range = rangeData.after( '=' );
+				const Token from = range.before( '-' );
+				const Token to = range.after( '-' );
+				if ( unit.len == rangeData.len || from.len == range.len )
+				{
+					Log::error("RTSP: bad Range header");
+					throw RTSP::Exception::ManagedError( Error::BadRequest );
+				}
 
-					pair< double, double > result( HUGE_VAL, HUGE_VAL );
-					if ( rangeData[1] != "now" )
-						result.first = fromString< double >( rangeData[1] );
-					if ( rangeData.size() > 2 && rangeData[2].size() )
-						result.second = fromString< double >( rangeData[2] );
+				if ( !( unit == "npt" ) )
+					throw RTSP::Exception::ManagedError( Error::NotImplemented );
 
-					return result;
-				}
-				catch( KGD::Exception::NotFound )
+				pair< double, double > result( HUGE_VAL, HUGE_VAL );
+				if ( ( !( from == "now" ) && ! toDecimal( from, result.first ) )
+					|| ( ! to.empty() && ! toDecimal( to, result.second ) ) )
 				{
-					Log::error("RTSP: no Range header");
+					Log::error("RTSP: bad Range header");
 					throw RTSP::Exception::ManagedError( Error::BadRequest );
 				}
+
+				return result;
 			}
 
 			pair< Channel::Description, boost::optional< TSSrc > > Request::getTransport( ) const throw( RTSP::Exception::ManagedError )
 			{
 				pair< Channel::Description, boost::optional< TSSrc > > rt;
+				rt.first.mux = false;
+				rt.first.pooled = false;
 				try
 				{
-					string data = this->extractHeaderData( Header::Transport ).at(0);
+					string data = this->getHeader( Header::Transport ).str();
 					vector< string > sets = split( ",", data );
 					for( size_t s = 0; s < sets.size(); ++s )
 					{
@@ -369,12 +566,24 @@ namespace KGD
 							continue;
 						}
 
-						boost::regex rxPorts( ( portParam + "=(\\d+)-(\\d+)" ).c_str() );
-						boost::match_results< string::const_iterator > match;
-						if (boost::regex_search(cPorts->begin(), cPorts->end(), match, rxPorts))
+						// RTCP on the RTP port, udp only
+						rt.first.mux = ( rt.first.type == Channel::Owned && find( parts.begin(), parts.end(), "rtcp-mux" ) != parts.end() );
+
+						// <param>=<first>-<second>, or <param>=<first> with the second implied
+						const Token ports = Token( cPorts->data() + portParam.size(), cPorts->size() - portParam.size() ).after( '=' );
+						const Token second = ports.after( '-' );
+						uint64_t firstPort, secondPort;
+						bool valid = ports.before( '-' ).toUnsigned( firstPort );
+						// udp single port: RTCP on the next one, or on the same with mux
+						if ( valid && second.empty() && rt.first.type == Channel::Owned )
+							secondPort = ( rt.first.mux ? firstPort : firstPort + 1 );
+						else
+							valid = valid && second.toUnsigned( secondPort );
+
+						if ( valid )
 						{
-							rt.first.ports.first = fromString< TPort >( match.str(1) );
-							rt.first.ports.second = fromString< TPort >( match.str(2) );
+							rt.first.ports.first = TPort( firstPort );
+							rt.first.ports.second = TPort( secondPort );
 							// hint ssrc
 							vector< string >::const_iterator cSSRC =
 								find_if( parts.begin(), parts.end(), boost::bind( & boost::starts_with< string, string >, _1, "ssrc=" ) );
@@ -404,20 +613,32 @@ namespace KGD
 			{
 				// first row contains
 				// RTSP/1.0 <code> <description>
-				vector< string > requestData = this->extractData( "^\\s*RTSP/(\\d+\\.\\d+) (\\d+) ([\\w|\\s]+?)" + EOL );
-				this->checkVersion( requestData[0] );
+				static const char PROTO[] = "RTSP/";
+				const Token line = this->getStartLine();
+				const char * p = line.ptr, * e = line.ptr + line.len;
+				while( p < e && isspace( *p ) )
+					++ p;
+				if ( size_t( e - p ) < sizeof( PROTO ) - 1 || memcmp( p, PROTO, sizeof( PROTO ) - 1 ) != 0 )
+					throw KGD::Exception::NotFound( "response line" );
+
+				p += sizeof( PROTO ) - 1;
+				const Token version = Token( p, e - p ).before( ' ' );
+				const Token status = Token( p, e - p ).after( ' ' );
+				uint64_t code;
+				if ( ! status.before( ' ' ).toUnsigned( code ) || status.after( ' ' ).empty() )
+					throw KGD::Exception::NotFound( "response line" );
+
+				this->checkVersion( version );
 				// it's a response, check cseq
-				try
+				uint64_t cseq;
+				Token cseqData;
+				if ( this->getHeader( Header::Cseq, cseqData ) && cseqData.toUnsigned( cseq ) )
 				{
-					string cseqData = this->extractHeaderData( Header::Cseq, "(\\d+)" ).at(0);
-					_cseq = fromString< TCseq >( cseqData );
-					_code = fromString< uint16_t >( requestData[1] );
+					_cseq = cseq;
+					_code = code;
 				}
-				catch( KGD::Exception::NotFound )
-				{
+				else
 					throw RTSP::Exception::CSeq();
-				}
-
 			}
 
 			Error::TCode Response::getCode() const throw()
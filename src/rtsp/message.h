@@ -25,6 +25,8 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     headers past the first 32 kept instead of dropped
+ *     single pass message parser, no regular expressions
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     boosted
  *     Some cosmetics about enums and RTCP library
@@ -43,6 +45,7 @@
 #include "lib/socket.h"
 
 #include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -53,22 +56,71 @@ namespace KGD
 		//! RTSP message types and parsers
 		namespace Message
 		{
-			//! RTSP message parser
+			//! RTSP message parser: start line and headers are indexed once, in a single pass
 			class Parser
 			: public CharArray
 			{
-			protected:
-				TCseq _cseq;
-
-				Parser( const char *, size_t ) throw( );
-
-				void checkVersion( const string & version ) const throw( RTSP::Exception::ManagedError );
+			public:
+				//! a slice of a message, valid as long as the message
+				struct Token
+				{
+					const char * ptr;
+					size_t len;
+
+					Token() throw();
+					Token( const char *, size_t ) throw();
+					//! copies to a string
+					string str() const;
+					//! tells if empty
+					bool empty() const throw();
+					//! exact comparison
+					bool operator==( const char * ) const throw();
+					//! exact comparison
+					bool operator==( const string & ) const throw();
+					//! part before a separator, or all
+					Token before( char ) const throw();
+					//! part after a separator, or none
+					Token after( char ) const throw();
+					//! parses a number made of digits only
+					bool toUnsigned( uint64_t & ) const throw();
+				};
+
+				//! headers indexed without allocating
+				static const size_t MAX_HEADERS = 32;
+
+				//! finds a header value in raw header lines, ignoring name case
+				static bool findHeader( const char * bg, const char * ed, const string & name, Token & value ) throw();
 
-				pair< vector< string >, size_t > extractData( string::const_iterator bg, string::const_iterator ed, const string & rx ) const throw( KGD::Exception::NotFound );
-				vector< string > extractData( const string & rx ) const throw( KGD::Exception::NotFound );
+			protected:
+				//! a header, as offsets in the message
+				struct Field
+				{
+					size_t name, nameLen, value, valueLen;
+				};
 
-				pair< vector< string >, size_t > extractHeaderData( const string & header, size_t offset , const string & rx = "(.+?)") const throw( KGD::Exception::NotFound );
-				vector< string > extractHeaderData( const string & header, const string & rx = "(.+?)" ) const throw( KGD::Exception::NotFound );
+				TCseq _cseq;
+				//! start line offset
+				size_t _lineStart;
+				//! start line length
+				size_t _lineLen;
+				//! indexed headers
+				Field _fields[ MAX_HEADERS ];
+				//! indexed headers count
+				size_t _nFields;
+				//! headers past the first MAX_HEADERS
+				vector< Field > _moreFields;
+
+				//! copies and indexes a message; may throw bad_alloc
+				Parser( const char *, size_t );
+
+				void checkVersion( const Token & version ) const throw( RTSP::Exception::ManagedError );
+
+				//! returns the start line
+				Token getStartLine() const throw();
+				//! looks for a header value, ignoring name case
+				bool getHeader( const string &, Token & ) const throw();
+				//! returns a header value, ignoring name case
+				Token getHeader( const string & ) const throw( KGD::Exception::NotFound );
 			public:
 				TCseq getCseq() const throw();
 			};
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     rtcp-mux in SETUP reply
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     minor cleanup and more robust Range / Scale support during PLAY
  *     testing interrupted connections
@@ -330,6 +331,22 @@ namespace KGD
 				switch( rtp.type )
 				{
 				case Channel::Owned:
+					// a single port each side
+					if ( rtp.mux )
+					{
+						reply
+							<< this->getTimestamp() << EOL
+							<< "Session: " << _sessionID << EOL
+							<< "Transport: RTP/AVP;unicast;"
+							<< "source=" <<  sock.getLocalHost() << ";"
+							<< "destination=" << sock.getRemoteHost() << ";"
+							<< "client_port=" << rtp.ports.second << ";"
+							<< "server_port=" << rtp.ports.first << ";"
+							<< "rtcp-mux;"
+							<< "ssrc=" << ssrc.str() << EOL
+							<< EOL;
+						break;
+					}
 					reply
 						<< this->getTimestamp() << EOL
 						<< "Session: " << _sessionID << EOL
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     rtcp-mux switch
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     source import
@@ -131,6 +132,7 @@ namespace KGD
 
 			TPort Udp::FIRST = 30000;
 			TPort Udp::LAST = 40000;
+			bool Udp::RTCP_MUX = true;
 
 			Udp::Udp()
 			: Pool( FIRST, LAST )
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     rtcp-mux switch
  *     boosted
  *     source import
  *
@@ -101,6 +102,8 @@ namespace KGD
 				static TPort FIRST;
 				//! last UDP available port: can be reset from parameters
 				static TPort LAST;
+				//! accept RTCP on the RTP port when clients ask for it, taking a single port
+				static bool RTCP_MUX;
 
 				//! get one port, interlocked
 				virtual TPort getOne() throw( KGD::Exception::NotFound );
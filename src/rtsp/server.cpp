@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     hibernation of long paused sessions
  *     english comments; removed leak with connection serving threads
  *     removed magic numbers in favor of constants / ini parameters
  *     introduced keep alive on control socket (me dumb)
@@ -37,6 +38,7 @@
 #include "rtsp/server.h"
 #include "rtsp/connection.h"
 #include "rtsp/exceptions.h"
+#include "rtp/session.h"
 #include "lib/ini.h"
 #include "lib/common.h"
 #include "lib/log.h"
@@ -87,7 +89,17 @@ namespace KGD
 				Server::Lock lk( Server::mux() );
 				list.erase_if( ! boost::bind( &Connection::isActive, _1 ) );
 				Log::debug( "KGD: active connections %u", list.size() );
-				wakeup.timed_wait( lk, boost::get_system_time() + boost::posix_time::seconds( 10 ) );
+
+				// release what long paused sessions hold
+				long every = 10;
+				if ( RTP::Session::HIBERNATE_AFTER > 0 )
+				{
+					BOOST_FOREACH( Connection & c, list )
+						c.hibernate();
+					every = std::min( every, std::max( 1L, long( RTP::Session::HIBERNATE_AFTER ) ) );
+				}
+
+				wakeup.timed_wait( lk, boost::get_system_time() + boost::posix_time::seconds( every ) );
 			}
 			th.wait();
 		}
@@ -25,6 +25,11 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     udp tracks on shared server sockets
+ *     single udp socket with rtcp-mux
+ *     RTCP sockets read by the poller
+ *     hibernation of long paused sessions
+ *     setup requests the track frames
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     minor cleanup and more robust Range / Scale support during PLAY
  *     removed magic numbers in favor of constants / ini parameters
@@ -46,6 +51,7 @@
 #include "rtsp/connection.h"
 #include "rtp/session.h"
 #include "rtcp/receiver.h"
+#include "rtsp/egress.h"
 
 namespace KGD
 {
@@ -88,10 +94,49 @@ namespace KGD
 				Session::Lock lk( *this );
 				// setup channel
 				boost::shared_ptr< Channel::Bi > rtpChan, rtcpChan;
+				boost::shared_ptr< Egress::Peer > egress;
 				TPortPair local;
 
+				// udp through server sockets
+				if ( remote.type == Channel::Owned && Egress::Service::SOCKETS )
+				{
+					pair< boost::shared_ptr< Egress::Peer >, boost::shared_ptr< Egress::Peer > > peers =
+						Egress::Service::getInstance()->open( url.remoteHost, remote.ports, remote.mux && Port::Udp::RTCP_MUX );
+					egress = peers.second;
+					rtpChan = peers.first;
+					rtcpChan = peers.second;
+					local = make_pair( rtpChan->getDescription().ports.first, rtcpChan->getDescription().ports.first );
+					Log::debug("%s: udp through shared sockets %d / %d", getLogName(), local.first, local.second );
+				}
+				// udp, a single socket for both
+				else if ( remote.type == Channel::Owned && remote.mux && Port::Udp::RTCP_MUX )
+				{
+					TPort p = Port::Udp::getInstance()->getOne();
+					local = TPortPair( p, p );
+
+					Log::debug("%s: creating udp socket locally bound to %d, RTCP muxed", getLogName(), p );
+					boost::shared_ptr< KGD::Socket::Udp > sock;
+					try
+					{
+						sock.reset( new KGD::Socket::Udp( p, url.host ) );
+						sock->connectTo( remote.ports.first, url.remoteHost );
+					}
+					catch( const KGD::Socket::Exception & e )
+					{
+						Port::Udp::getInstance()->release( p );
+						Log::debug( "%s: socket error: %s", getLogName(), e.what() );
+						throw RTSP::Exception::ManagedError( Error::UnsupportedTransport );
+					}
+
+					sock->setWriteTimeout( KGD::Socket::WRITE_TIMEOUT );
+					// read by the poller, RTP writes are not affected
+					sock->setReadBlock( false );
+
+					rtpChan = sock;
+					rtcpChan = sock;
+				}
 				// udp
-				if ( remote.type == Channel::Owned )
+				else if ( remote.type == Channel::Owned )
 				{
 					local = Port::Udp::getInstance()->getPair();
 
@@ -115,8 +160,8 @@ namespace KGD
 
 					rtp->setWriteTimeout( KGD::Socket::WRITE_TIMEOUT );
 					rtcp->setWriteTimeout( KGD::Socket::WRITE_TIMEOUT );
-					rtcp->setReadBlock( true );
-					rtcp->setReadTimeout( RTCP::Receiver::POLL_INTERVAL );
+					// read by the poller
+					rtcp->setReadBlock( false );
 
 					rtpChan = rtp;
 					rtcpChan = rtcp;
@@ -129,17 +174,22 @@ namespace KGD
 
 					rtpChan = rtsp.getInterleave( local.first );
 					rtcpChan = rtsp.getInterleave( local.second );
-					rtcpChan->setReadTimeout( RTCP::Receiver::POLL_INTERVAL );
 				}
 
 				// get description
 				int mediumIndex = fromString< int >( url.track );
-				SDP::Medium::Base & med = _conn.getDescription( url.file ).getMedium( mediumIndex );
+				SDP::Container & desc = _conn.getDescription( url.file );
+				SDP::Medium::Base & med = desc.getMedium( mediumIndex );
+				// frames of this track are loaded from now on
+				desc.requestMedium( mediumIndex );
 
 				// create session
 				auto_ptr< RTP::Session > s( new RTP::Session( *this, url, med, rtpChan, rtcpChan, _conn.getUserAgent() ) );
 				if ( ssrc )
 					s->setSsrc( *ssrc );
+				// reports from clients moving behind a NAT are recognized by ssrc
+				if ( egress )
+					egress->setSsrc( s->getSsrc() );
 
 				// temp to return
 				RTP::Session * sPtr = s.get();
@@ -336,6 +386,14 @@ namespace KGD
 				sess->second->unpause( rq );
 		}
 
+		void Session::hibernate() throw()
+		{
+			Session::Lock lk( *this );
+
+			BOOST_FOREACH( SessionMap::iterator::reference sess, _sessions )
+				sess->second->hibernate();
+		}
+
 		ref_list< RTP::Session > Session::getSessions() throw()
 		{
 			Session::Lock lk( *this );
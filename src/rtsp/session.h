@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     hibernation of long paused sessions
  *     fixed some SSRC issues; added support for client-hinted ssrc; fixed SIGTERM shutdown when serving
  *     minor cleanup and more robust Range / Scale support during PLAY
  *     removed magic numbers in favor of constants / ini parameters
@@ -124,6 +125,8 @@ namespace KGD
 			void pause( const PlayRequest & ) throw();
 			//! aggregate unpause: invokes unpause on every RTP session
 			void unpause( const PlayRequest & ) throw();
+			//! hibernates RTP sessions paused for long
+			void hibernate() throw();
 
 			//! tells if a play has been ever issued
 			bool hasPlayed() const throw();
@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     channel timeline anchored to the play list time, channels always shared
+ *     play list items opened on demand, next one prefetched
+ *     channel play lists
+ *     load only requested tracks
+ *     media files read through the disk scheduler
+ *     media are never modified after loading
+ *     play lists concatenate items without copying frames
  *     threads terminate with wait + join
  *     english comments; removed leak with connection serving threads
  *     introduced keep alive on control socket (me dumb)
@@ -41,6 +48,7 @@
 #include "rtsp/method.h"
 #include "daemon.h"
 #include "lib/pls.h"
+#include "lib/clock.h"
 
 #include <sstream>
 #include <iomanip>
@@ -67,6 +75,7 @@ namespace KGD
 
 		Container::OwnThread::OwnThread()
 		: running( false )
+		, rewind( false )
 		{
 			
 		}
@@ -75,6 +84,11 @@ namespace KGD
 		Container::Container( const string & fileName ) throw( SDP::Exception::Generic )
 		: _fileName( fileName )
 		, _description( fileName )
+		, _channelStart( HUGE_VAL )
+		, _retainSegments( false )
+		, _unloaded( false )
+		, _fctx( 0 )
+		, _pb( 0 )
 		, _logName( "SDP " + fileName )
 		, _uuid( KGD::newUUID() )
 		{
@@ -108,6 +122,12 @@ namespace KGD
 				_th.requestMore.notify_all();
 				_th.reset();
 			}
+
+			if ( _fctx )
+			{
+				this->closeMediaContainer( _fctx );
+				_fctx = 0;
+			}
 		}
 
 		const char * Container::getLogName() const throw()
@@ -125,20 +145,60 @@ namespace KGD
 			try
 			{
 				PlayList pl( this->getFilePath() );
-				list< string > files = pl.getMediaList();
-				list< string >::const_iterator it = files.begin(), ed = files.end();
-				if ( it != ed )
+				const list< string > & files = pl.getMediaList();
+				if ( files.empty() )
+					throw SDP::Exception::Generic( "empty playlist " + _fileName );
+
+				// just the first item is opened, to describe our media; the others are scanned from their headers, then opened when played
+				_duration = 0;
+				vector< Scan > scans;
+				BOOST_FOREACH( const string & file, files )
 				{
-					Container c( *it++ );
-					this->assign( c );
+					if ( _segments.empty() )
+					{
+						_segments.push_back( new Container( file ) );
+						scans.push_back( scanMediaContainer( file ) );
+						scans.back().duration = _segments.front().getDuration();
+					}
+					else
+					{
+						_segments.push_back( 0 );
+						scans.push_back( scanMediaContainer( file ) );
+					}
+					_duration += scans.back().duration;
+					_segmentFiles.push_back( file );
 				}
-				while( it != ed )
+				_segmentUsers.assign( _segments.size(), 0 );
+				_bitRate = _segments.front()._bitRate;
+
+				// our media iterate over items' media, with no frame copy
+				ref_list< Medium::Base > firstMedia = _segments.front().getMedia();
+				BOOST_FOREACH( Medium::Base & first, firstMedia )
 				{
-					Container c( *it++ );
-					this->append( c );
+					auto_ptr< Medium::Base > newMed( first.getInfoClone() );
+					newMed->setContainer( *this );
+					newMed->setFileName( this->getFileName() );
+					newMed->setDuration( _duration );
+
+					auto_ptr< Medium::Iterator::Concat > model( new Medium::Iterator::Concat( *newMed, *this ) );
+					BOOST_FOREACH( const Scan & scan, scans )
+						model->append( scan.duration, scan.getFrames( first.getType() ) );
+					newMed->setFrameIteratorModel( model.release() );
+
+					uint8_t medIdx = first.getIndex();
+					_media.insert( medIdx, newMed );
 				}
+				Log::debug( "%s: %u items, %lf s", getLogName(), _segments.size(), _duration );
 
 				this->loop( pl.getLoops() );
+
+				// a single timeline for every viewer, running since the play list was written: reloads and separate descriptors agree on it
+				if ( pl.isChannel() )
+				{
+					time_t start = pl.getModificationTime();
+					_channelStart = ( start > 0 ? double( start ) : Clock::getSec() );
+					Log::message( "%s: channel started %.0lf s ago", getLogName(), Clock::getSec() - _channelStart );
+				}
 			}
 			catch( KGD::Exception::NotFound const & e )
 			{
@@ -211,96 +271,191 @@ namespace KGD
 		{
 			BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
 				medium.second->loop( times );
+
+			// play list items will be played again
+			if ( times != 1 )
+			{
+				KGD::Lock lk( _segmentMux );
+				_retainSegments = true;
+				for( size_t i = 0; i < _segments.size(); ++i )
+					if ( ! _segments.is_null( i ) )
+						_segments[ i ].retainFrames();
+			}
 		}
 
+		void Container::retainFrames() throw()
+		{
+			BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
+				medium.second->retainFrames();
+		}
 
-		void Container::insert( SDP::Container & other, double insertTime ) throw( KGD::Exception::OutOfBounds )
+		Medium::Base * Container::findMedium( Payload::type pt ) throw()
 		{
-			// insert mediums with correspondent payload type
-			// get media to insert
-			ref_list< Medium::Base > otherMedia = other.getMedia();
-			// for every local medium
-			BOOST_FOREACH( MediaMap::iterator::reference localIt, _media )
+			BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
+				if ( medium.second->getPayloadType() == pt )
+					return medium.second;
+
+			return 0;
+		}
+
+
+		void Container::requestMedium( size_t i ) throw( RTSP::Exception::ManagedError )
+		{
+			Medium::Base & med = this->getMedium( i );
+
+			// play list items load their own frames, starting from the first one
+			if ( ! _segments.empty() )
+			{
+				KGD::Lock lk( _segmentMux );
+				this->loadSegment( 0, med.getPayloadType() );
+				return;
+			}
+
+			OwnThread::Lock lk( _th );
+			// unloaded play list item played again
+			if ( _unloaded )
 			{
-				MediaMap::mapped_reference localMedium = *localIt->second;
-				Log::debug( "%s: media insert: look for payload type %u", getLogName(), localMedium.getPayloadType() );
-				// search correspondent medium to insert
-				bool found = false;
-				BOOST_FOREACH( Medium::Base & otherMedium, otherMedia )
+				try
 				{
-					// if same PT, insert
-					if ( localMedium.getPayloadType() == otherMedium.getPayloadType() )
-					{
-						Log::debug("%s: media insert: found payload type %u", getLogName(), otherMedium.getPayloadType() );
-						boost::scoped_ptr< Medium::Iterator::Base > frameIt( otherMedium.newFrameIterator() );
-						localMedium.insert( *frameIt, insertTime );
-						found = true;
-						break;
-					}
+					_fctx = this->openMediaContainer();
+					_unloaded = false;
 				}
-				// no correspondence found, add void
-				if ( !found )
+				catch( const SDP::Exception::Generic & e )
 				{
-					Log::debug( "%s: media insert: add void to payload type %u", getLogName(), localMedium.getPayloadType() );
-					localMedium.insert( other.getDuration(), insertTime );
+					Log::error( "%s: reloading: %s", getLogName(), e.what() );
+					return;
 				}
 			}
 
-			_duration += other.getDuration();
+			// live casts load every stream
+			if ( ! _fctx )
+				return;
+
+			if ( ! _th.requested.insert( med.getIndex() ).second )
+				return;
+
+			Log::debug( "%s: loading track %u", getLogName(), med.getIndex() );
+			// loading may have reached the end without this medium
+			med.resetFrameCount();
+
+			if ( ! _th )
+			{
+				_th.running = true;
+				_th.reset( new boost::thread( boost::bind( &Container::mediaContainerLoop, this, _fctx ) ));
+			}
+			else
+			{
+				_th.rewind = true;
+				lk.unlock();
+				_th.requestMore.notify_all();
+			}
 		}
 
-		void Container::append( SDP::Container & other ) throw()
+		Container * Container::openSegment( size_t n ) throw()
 		{
-			// insert mediums with correspondent payload type
-			// get media to insert
-			ref_list< SDP::Medium::Base > otherMedia = other.getMedia();
-			// for every local medium
-			BOOST_FOREACH( MediaMap::iterator::reference localIt, _media )
+			if ( _segments.is_null( n ) )
 			{
-				MediaMap::mapped_reference localMedium = *localIt->second;
-				Log::debug( "%s: media append: look for payload type %u", getLogName(), localMedium.getPayloadType() );
-				// search correspondent medium to insert
-				BOOST_FOREACH( Medium::Base & otherMedium, otherMedia )
+				try
 				{
-					// if same PT, insert
-					if ( localMedium.getPayloadType() == otherMedium.getPayloadType() )
-					{
-						Log::debug("%s: media append: found payload type %u", getLogName(), otherMedium.getPayloadType() );
-						boost::scoped_ptr< Medium::Iterator::Base > frameIt( otherMedium.newFrameIterator() );
-						localMedium.append( *frameIt );
-						break;
-					}
+					Log::debug( "%s: opening item %u", getLogName(), n );
+					auto_ptr< Container > c( new Container( _segmentFiles[ n ] ) );
+					if ( _retainSegments )
+						c->retainFrames();
+					_segments.replace( n, c.release() );
+				}
+				catch( const SDP::Exception::Generic & e )
+				{
+					Log::error( "%s: item %u: %s", getLogName(), n, e.what() );
+					return 0;
 				}
 			}
-			_duration += other.getDuration();
+			return &_segments[ n ];
 		}
 
-		void Container::assign( SDP::Container & other ) throw()
+		Medium::Base * Container::getSegmentMedium( size_t n, Payload::type pt ) throw()
 		{
-			this->stop();
-			_media.clear();
+			KGD::Lock lk( _segmentMux );
+
+			Medium::Base * rt = this->loadSegment( n, pt );
+			if ( rt )
+				++ _segmentUsers[ n ];
+			return rt;
+		}
 
-			ref_list< SDP::Medium::Base > otherMedia = other.getMedia();
-			BOOST_FOREACH( SDP::Medium::Base & otherMedium, otherMedia )
+		void Container::releaseSegment( size_t n ) throw()
+		{
+			KGD::Lock lk( _segmentMux );
+
+			// frames still held by RTP frames outlive the item's table, the item itself stays
+			if ( _segmentUsers[ n ] > 0 && -- _segmentUsers[ n ] == 0 && ! _segments.is_null( n ) )
+			{
+				Log::debug( "%s: unloading item %lu", getLogName(), n );
+				_segments[ n ].unload();
+			}
+		}
+
+		Medium::Base * Container::loadSegment( size_t n, Payload::type pt ) throw()
+		{
+			Medium::Base * rt = 0;
+			// the next item starts loading meanwhile, to be ready when its turn comes
+			for( size_t i = n; i < n + 2 && i < _segments.size(); ++i )
 			{
-				uint8_t medIdx = otherMedium.getIndex();
-				auto_ptr< SDP::Medium::Base > newMed( otherMedium.getInfoClone() );
-				newMed->setFileName( this->getFileName() );
-				boost::scoped_ptr< Medium::Iterator::Base > frameIt( otherMedium.newFrameIterator() );
-				newMed->append( *frameIt );
-				_media.erase( medIdx );
-				_media.insert( medIdx, newMed );
+				Container * c = this->openSegment( i );
+				Medium::Base * m = ( c ? c->findMedium( pt ) : 0 );
+				if ( m )
+					c->requestMedium( m->getIndex() );
+				if ( i == n )
+					rt = m;
 			}
+			return rt;
+		}
 
-			_duration = other._duration;
-			_bitRate = other._bitRate;
+		Container::Scan::Scan() throw()
+		: duration( 0 )
+		{
+		}
+
+		size_t Container::Scan::getFrames( MediaType::kind t ) const throw()
+		{
+			map< MediaType::kind, size_t >::const_iterator it = frames.find( t );
+			return ( it != frames.end() ? it->second : 0 );
 		}
 
 		bool Container::isLiveCast() const
 		{
 			// when seek support is not active, every description is live
 			// else lives are from video devices
-			return !RTSP::Method::SUPPORT_SEEK || _fileName.substr(0,9) == "dev.video";
+			// channels are played as lives
+			return !RTSP::Method::SUPPORT_SEEK || _fileName.substr(0,9) == "dev.video" || this->isChannel();
+		}
+
+		bool Container::isChannel() const throw()
+		{
+			return _channelStart != HUGE_VAL;
+		}
+
+		bool Container::isChannel( const string & fileName ) throw()
+		{
+			if ( fileName.size() < 4 || fileName.substr( fileName.size() - 4 ) != ".kls" )
+				return false;
+
+			try
+			{
+				return PlayList( BASE_DIR + fileName ).isChannel();
+			}
+			catch( KGD::Exception::NotFound const & )
+			{
+				return false;
+			}
+		}
+
+		double Container::getChannelTime() const throw()
+		{
+			if ( ! this->isChannel() || _duration <= 0 )
+				return 0.0;
+
+			// the schedule repeats: join at the same point of the current pass, whatever the loop count
+			return fmod( max( 0.0, Clock::getSec() - _channelStart ), _duration );
 		}
 
 		double Container::getDuration() const
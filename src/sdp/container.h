@@ -25,6 +25,13 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     play list items scanned from their headers, unloaded once played
+ *     channel timeline anchored to the play list time, channels always shared
+ *     play list items opened on demand, next one prefetched
+ *     channel play lists
+ *     load only requested tracks
+ *     media files read through the disk scheduler
+ *     media are never modified after loading
  *     introduced keep alive on control socket (me dumb)
  *     testing interrupted connections
  *     boosted
@@ -47,9 +54,11 @@
 #include "lib/urlencode.h"
 #include "lib/utils/ref.hpp"
 #include "lib/utils/ref_container.hpp"
+#include "lib/diskio.h"
 
 #include <string>
 #include <map>
+#include <set>
 #include <list>
 
 extern "C"
@@ -89,6 +98,21 @@ namespace KGD
 			//! medium list
 			MediaMap _media;
 
+			//! play list items, whose media are played one after the other; opened when first played
+			boost::ptr_vector< boost::nullable< Container > > _segments;
+			//! play list played by every viewer on the same timeline, started at this wall clock time, i.e. when the play list was written
+			double _channelStart;
+			//! play list item names
+			vector< string > _segmentFiles;
+			//! iterators over each play list item: once none is left, the item is unloaded
+			vector< size_t > _segmentUsers;
+			//! play list items keep every frame, since they will be played again
+			bool _retainSegments;
+			//! protects play list items opening
+			KGD::Mutex _segmentMux;
+			//! media container closed and frames dropped, until a medium is requested again
+			bool _unloaded;
+
 			//! load frame thread
 			class OwnThread
 			: public Safe::Thread< RMutex >
@@ -99,6 +123,10 @@ namespace KGD
 				bool running;
 				//! condition to request more frames
 				Condition requestMore;
+				//! indexes of the media whose frames are loaded
+				set< uint8_t > requested;
+				//! media have been requested since the last read start
+				bool rewind;
 			} _th;
 
 			//! constantly fetches frames from video device
@@ -107,10 +135,32 @@ namespace KGD
 			void liveCastLoop( AVFormatContext*, AVCodecContext* );
 			//! loads a kinoglaz playlist
 			void loadPlayList() throw( SDP::Exception::Generic );
+			//! returns a play list item, opening it if needed; 0 if it cannot be opened. item lock must be held
+			Container * openSegment( size_t ) throw();
+			//! starts loading the medium of a play list item with a given payload type, and prefetches the next item; returns the medium, 0 if none. item lock must be held
+			Medium::Base * loadSegment( size_t, Payload::type ) throw();
+			//! never free the frames of any medium
+			void retainFrames() throw();
+			//! returns the medium with a given payload type, if any
+			Medium::Base * findMedium( Payload::type ) throw();
 			//! loads a media container
 			void loadMediaContainer() throw( SDP::Exception::Generic );
+			//! opens the media container file and finds its streams
+			AVFormatContext * openMediaContainer() throw( SDP::Exception::Generic );
+			//! closes the media container and drops every frame; a medium requested later loads them again
+			void unload() throw();
 			//! load index thread loop
 			void mediaContainerLoop( AVFormatContext* );
+			//! media container, open until the descriptor is destroyed
+			AVFormatContext * _fctx;
+			//! discard streams of media not requested
+			void selectStreams() throw();
+			//! media container file, read through the disk scheduler
+			boost::scoped_ptr< DiskIO::File > _file;
+			//! ffmpeg io context reading from the file
+			ByteIOContext * _pb;
+			//! close a media container and its io context
+			void closeMediaContainer( AVFormatContext* ) throw();
 
 			//! log identifier
 			const string _logName;
@@ -124,6 +174,19 @@ namespace KGD
 			//! stop the thread
 			void stop();
 		public:
+			//! play list item as known before opening it
+			struct Scan
+			{
+				//! duration in seconds
+				double duration;
+				//! estimated number of frames, by media type
+				map< MediaType::kind, size_t > frames;
+
+				Scan() throw();
+				//! returns the estimated number of frames of a media type, 0 if unknown
+				size_t getFrames( MediaType::kind ) const throw();
+			};
+
 			//! loads file metadata
 			Container( const string & fileName ) throw( SDP::Exception::Generic );
 			//! dtor
@@ -136,6 +199,14 @@ namespace KGD
 			double getDuration() const;
 			//! tells if this description refers to a livecast
 			bool isLiveCast() const;
+			//! tells if this description is a channel play list
+			bool isChannel() const throw();
+			//! tells if a resource is a channel play list, without loading it
+			static bool isChannel( const string & fileName ) throw();
+			//! reads duration and frame estimates of a media container from its header, without loading it
+			static Scan scanMediaContainer( const string & fileName ) throw( SDP::Exception::Generic );
+			//! returns the current time on the channel timeline
+			double getChannelTime() const throw();
 			//! returns protocol reply using session ID as description
 			string getReply( const Url &, const RTSP::TSessionID & ) const throw();
 			//! returns protocol reply with a given description for the session; internal description is used if none given
@@ -153,6 +224,13 @@ namespace KGD
 
 			//! request more frames, i.e. wakes up the loading thread
 			void requestMoreFrames() throw();
+			//! start loading the frames of a medium, if not yet done
+			void requestMedium( size_t ) throw( RTSP::Exception::ManagedError );
+			//! returns the medium of a play list item with a given payload type, 0 if none; starts loading it and prefetches the next item
+			//! the caller uses the item until releaseSegment, if a medium is returned
+			Medium::Base * getSegmentMedium( size_t, Payload::type ) throw();
+			//! done with a play list item: once no iterator is left over it, the item is unloaded
+			void releaseSegment( size_t ) throw();
 			
 			//! get full path of source media container
 			string getFilePath() const throw();
@@ -163,12 +241,6 @@ namespace KGD
 			//! set different description
 			void setDescription( const string & ) throw();
 
-			//! insert another descriptor at specified time
-			void insert( SDP::Container & other, double insertTime ) throw( KGD::Exception::OutOfBounds );
-			//! append another descriptor to the end
-			void append( SDP::Container & other ) throw();
-			//! transfer media from the other container to this, overwriting any existent data
-			void assign( SDP::Container & other ) throw();
 			//! loop current description a number of times ( 0 = infinite )
 			void loop( uint8_t = 0 ) throw();
 
@@ -16,20 +16,138 @@ namespace KGD
 {
 	namespace SDP
 	{
-		void Container::loadMediaContainer() throw( SDP::Exception::Generic )
+		namespace
+		{
+			//! ffmpeg io buffer size
+			const int IO_BUFFER_SIZE = 32768;
+			//! bytes first used to probe the container format, doubled until recognized
+			const int PROBE_SIZE = 2048;
+			//! max bytes used to probe the container format, as ffmpeg
+			const int PROBE_MAX = 1 << 20;
+
+			//! ffmpeg read callback
+			int ioRead( void * opaque, uint8_t * buf, int size )
+			{
+				return static_cast< DiskIO::File * >( opaque )->read( buf, size );
+			}
+
+			//! ffmpeg seek callback
+			int64_t ioSeek( void * opaque, int64_t offset, int whence )
+			{
+				DiskIO::File * f = static_cast< DiskIO::File * >( opaque );
+				if ( whence & AVSEEK_SIZE )
+					return f->size();
+				else
+					return f->seek( offset, whence & ~AVSEEK_FORCE );
+			}
+
+			//! closes a media container and frees its io context
+			void closeInput( AVFormatContext * fctx, ByteIOContext * & pb ) throw()
+			{
+				if ( fctx )
+					av_close_input_stream( fctx );
+				if ( pb )
+				{
+					// ffmpeg may have reallocated the buffer
+					av_free( pb->buffer );
+					av_free( pb );
+					pb = 0;
+				}
+			}
+
+			//! opens a media container through the disk scheduler, reading its header only; 0 on failure
+			AVFormatContext * openInput( const string & path, DiskIO::File & file, ByteIOContext * & pb ) throw()
+			{
+				// probe format with growing buffers, long headers or tags may come first
+				AVInputFormat * fmt = 0;
+				{
+					vector< uint8_t > probe;
+					AVProbeData pd;
+					pd.filename = path.c_str();
+					for( int sz = PROBE_SIZE; ! fmt; sz <<= 1 )
+					{
+						probe.assign( sz + AVPROBE_PADDING_SIZE, 0 );
+						file.seek( 0, SEEK_SET );
+						pd.buf = &probe[ 0 ];
+						pd.buf_size = max( 0, file.read( &probe[ 0 ], sz ) );
+
+						// be picky on partial reads, take the best guess on the last one
+						const bool last = ( pd.buf_size < sz || sz >= PROBE_MAX );
+						int score = ( last ? 0 : AVPROBE_SCORE_MAX / 4 );
+						fmt = av_probe_input_format2( &pd, 1, &score );
+						if ( last )
+							break;
+					}
+					file.seek( 0, SEEK_SET );
+				}
+
+				unsigned char * ioBuf = reinterpret_cast< unsigned char * >( av_malloc( IO_BUFFER_SIZE ) );
+				pb = ( ioBuf ? av_alloc_put_byte( ioBuf, IO_BUFFER_SIZE, 0, &file, ioRead, 0, ioSeek ) : 0 );
+				AVFormatContext *fctx = 0;
+				if ( !fmt || !pb || av_open_input_stream( &fctx, pb, path.c_str(), fmt, NULL ) != 0 )
+				{
+					if ( !pb )
+						av_free( ioBuf );
+					closeInput( 0, pb );
+					return 0;
+				}
+				return fctx;
+			}
+
+			//! estimated number of frames of a stream, from its header
+			size_t estimateFrames( const AVStream * str, double duration ) throw()
+			{
+				if ( str->nb_frames > 0 )
+					return str->nb_frames;
+
+				if ( str->duration != int64_t( AV_NOPTS_VALUE ) )
+					duration = str->duration * av_q2d( str->time_base );
+
+				double rate = 0;
+				if ( str->codec->codec_type == CODEC_TYPE_AUDIO && str->codec->sample_rate > 0 )
+					// AAC frames carry 1024 samples
+					rate = double( str->codec->sample_rate ) / ( str->codec->frame_size > 0 ? str->codec->frame_size : 1024 );
+				else if ( str->r_frame_rate.den > 0 )
+					rate = av_q2d( str->r_frame_rate );
+
+				return size_t( max( 0.0, duration * rate ) + 0.5 );
+			}
+		}
+
+		AVFormatContext * Container::openMediaContainer() throw( SDP::Exception::Generic )
 		{
-			AVFormatContext *fctx = 0;
+			string path = this->getFilePath();
+
+			// open file through the disk scheduler
+			try
+			{
+				_file.reset( new DiskIO::File( path ) );
+			}
+			catch( const KGD::Exception::Generic & e )
+			{
+				Log::error( "%s: %s", getLogName(), e.what() );
+				throw SDP::Exception::Generic( "unable to open " + _fileName + " in " + BASE_DIR );
+			}
 
-			// ff open file
-			if ( av_open_input_file(&fctx, this->getFilePath().c_str(), NULL, 0, NULL) != 0 )
+			// ff open stream
+			AVFormatContext *fctx = openInput( path, *_file, _pb );
+			if ( !fctx )
+			{
+				_file.reset();
 				throw SDP::Exception::Generic( "unable to open " + _fileName + " in " + BASE_DIR );
+			}
 			// ff load stream info
 			if( av_find_stream_info(fctx) < 0 )
 			{
-				av_close_input_file( fctx );
+				this->closeMediaContainer( fctx );
 				throw SDP::Exception::Generic( "unable to find streams in " + _fileName );
 			}
+			return fctx;
+		}
 
+		void Container::loadMediaContainer() throw( SDP::Exception::Generic )
+		{
+			AVFormatContext *fctx = this->openMediaContainer();
 
 			// other info
 			_bitRate = fctx->bit_rate;
@@ -66,15 +184,83 @@ namespace KGD
 				{
 					Log::error( "%s: %s", getLogName(), e.what() );
 					_media.clear();
-					av_close_input_file( fctx );
+					this->closeMediaContainer( fctx );
 					throw SDP::Exception::Generic( "unsupported codec " + string(cdc->codec_name) );
 				}
 			}
 
+			// frames are loaded once some track is requested
+			_fctx = fctx;
+		}
+
+		void Container::selectStreams() throw()
+		{
+			for( size_t i = 0; i < _fctx->nb_streams; ++i )
+				_fctx->streams[i]->discard = ( _th.requested.count( i ) ? AVDISCARD_DEFAULT : AVDISCARD_ALL );
+		}
+
+		void Container::closeMediaContainer( AVFormatContext *fctx ) throw()
+		{
+			closeInput( fctx, _pb );
+			_file.reset();
+		}
+
+		Container::Scan Container::scanMediaContainer( const string & fileName ) throw( SDP::Exception::Generic )
+		{
+			string path = BASE_DIR + fileName;
+			boost::scoped_ptr< DiskIO::File > file;
+			try
+			{
+				file.reset( new DiskIO::File( path ) );
+			}
+			catch( const KGD::Exception::Generic & e )
+			{
+				Log::error( "SDP %s: %s", fileName.c_str(), e.what() );
+				throw SDP::Exception::Generic( "unable to open " + fileName + " in " + BASE_DIR );
+			}
+
+			ByteIOContext * pb = 0;
+			AVFormatContext * fctx = openInput( path, *file, pb );
+			if ( !fctx )
+				throw SDP::Exception::Generic( "unable to open " + fileName + " in " + BASE_DIR );
+
+			// formats with no duration in their header need their streams probed
+			if ( fctx->duration == int64_t( AV_NOPTS_VALUE ) && av_find_stream_info( fctx ) < 0 )
 			{
-				OwnThread::Lock lk( _th );
-				_th.running = true;
-				_th.reset( new boost::thread( boost::bind( &Container::mediaContainerLoop, this, fctx ) ));
+				closeInput( fctx, pb );
+				throw SDP::Exception::Generic( "unable to find streams in " + fileName );
+			}
+
+			Scan rt;
+			rt.duration = ( fctx->duration != int64_t( AV_NOPTS_VALUE ) ? double( fctx->duration ) / AV_TIME_BASE : 0 );
+			for( size_t i = 0; i < fctx->nb_streams; ++i )
+			{
+				const AVStream * str = fctx->streams[ i ];
+				if ( str->codec->codec_type == CODEC_TYPE_VIDEO )
+					rt.frames[ MediaType::Video ] = max( rt.frames[ MediaType::Video ], estimateFrames( str, rt.duration ) );
+				else if ( str->codec->codec_type == CODEC_TYPE_AUDIO )
+					rt.frames[ MediaType::Audio ] = max( rt.frames[ MediaType::Audio ], estimateFrames( str, rt.duration ) );
+			}
+			Log::debug( "SDP %s: scanned, %lf s", fileName.c_str(), rt.duration );
+
+			closeInput( fctx, pb );
+			return rt;
+		}
+
+		void Container::unload() throw()
+		{
+			// frames of live items may be released meanwhile by RTP frames: keep them
+			if ( _segments.empty() && ! this->isLiveCast() )
+			{
+				this->stop();
+				{
+					OwnThread::Lock lk( _th );
+					_th.requested.clear();
+					_th.rewind = false;
+					_unloaded = true;
+				}
+				BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
+					medium->second->dropFrames();
 			}
 		}
 
@@ -90,9 +276,22 @@ namespace KGD
 
 				double storedFramesDuration = 0;
 				bool live = this->isLiveCast();
-				
+				// packets read per stream since the last start: after a rewind, the first ones are already stored
+				map< int, size_t > readSinceStart;
+
+				this->selectStreams();
 				while( _th.running )
 				{
+					// media requested meanwhile need their frames from the start
+					if ( _th.rewind )
+					{
+						_th.rewind = false;
+						readSinceStart.clear();
+						this->selectStreams();
+						if ( !live && av_seek_frame( fctx, -1, 0, AVSEEK_FLAG_BACKWARD ) < 0 )
+							Log::warning( "%s: unable to rewind", getLogName() );
+					}
+
 					AVPacket pkt;
 					av_init_packet( &pkt );
 					// load frame
@@ -100,25 +299,36 @@ namespace KGD
 					// err
 					if ( rdRes < 0 )
 					{
-						// break cycle
 						if ( rdRes == AVERROR_EOF )
-							_th.running = false;
+						{
+							// finalize sizes of what was loaded: other media stay undetermined until requested
+							BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
+								if ( _th.requested.count( medium->first ) )
+									medium->second->finalizeFrameCount();
+							// wait for other media to load, or termination
+							while( _th.running && !_th.rewind )
+								_th.requestMore.wait( lk );
+						}
 						else
 							Log::warning( "%s: av_read_frame error %d", getLogName(), rdRes );
 					}
 					else
 					{
 						MediaMap::iterator medium = _media.find( pkt.stream_index );
-						if ( medium != _media.end() && pkt.size > 0 )
+						if ( medium != _media.end() && pkt.size > 0 && _th.requested.count( pkt.stream_index ) )
 						{
 							Medium::Base & m = *medium->second;
-							Frame::MediaFile * f = new Frame::MediaFile( pkt, m.getTimeBase() );
-							m.addFrame( f );
+							// after a rewind, media already loaded skip what they have, by count: timestamps may repeat
+							if ( readSinceStart[ pkt.stream_index ] ++ >= m._frame.table.size() )
+							{
+								Frame::MediaFile * f = new Frame::MediaFile( pkt, m.getTimeBase(), m._arena );
+								m.addFrame( f );
+							}
 
 							if (live)
 								storedFramesDuration = m.getStoredDuration();
 						}
-						else
+						else if ( medium == _media.end() || pkt.size <= 0 )
 							Log::warning( "%s: skipping frame stream %d sz %d", getLogName(), pkt.stream_index, pkt.size );
 					}
 					av_free_packet( &pkt );
@@ -131,12 +341,7 @@ namespace KGD
 					else
 						_th.yield( lk );
 				}
-
-				// finalize sizes
-				BOOST_FOREACH( MediaMap::iterator::reference medium, _media )
-					medium->second->finalizeFrameCount();
 			}
-			av_close_input_file( fctx );
 
 			// sync termination
 			Log::verbose( "%s: sync loop termination", getLogName() );
@@ -233,7 +233,7 @@ namespace KGD
 								// create frame
 								auto_ptr< ByteArray > rawData( encBuf.popFront( encSize ) );
 								double fTime = oCtx->coded_frame->pts * medium.getTimeBase();
-								Frame::MediaFile * f = new Frame::MediaFile( *rawData, fTime );
+								Frame::MediaFile * f = new Frame::MediaFile( *rawData, fTime, medium._arena );
 								if ( oCtx->coded_frame->key_frame )
 									f->setKey();
 
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     single-flight loading, failed loads cache
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     source import
@@ -37,6 +38,7 @@
 #include "rtsp/common.h"
 #include "daemon.h"
 #include "lib/log.h"
+#include "lib/clock.h"
 #include "lib/utils/virtual.hpp"
 
 #include <sstream>
@@ -54,6 +56,8 @@ namespace KGD
 
 	namespace SDP
 	{
+		double Descriptions::FAILURE_TTL = 2.0;
+
 		Descriptions::Descriptions()
 		{
 		}
@@ -65,32 +69,75 @@ namespace KGD
 
 		SDP::Container & Descriptions::loadDescription( const string & file ) throw( SDP::Exception::Generic )
 		{
-			Descriptions::Lock lk( Descriptions::mux() );
+			KGD::Lock lk( _mux );
 			Log::debug("SDP Pool: loading description for %s", file.c_str() );
+			for(;;)
+			{
+				ContainerMap::iterator it = _descriptions.find( file );
+				if ( it != _descriptions.end() )
+				{
+					++ _count[ file ];
+					Log::debug("SDP Pool: %s exists, reference count to %llu", file.c_str(), _count[ file ] );
+					return *( it->second );
+				}
+				// someone else is loading it: wait the result
+				if ( _loading.count( file ) )
+				{
+					Log::debug("SDP Pool: %s being loaded, waiting", file.c_str() );
+					_loaded.wait( lk );
+					continue;
+				}
+
+				map< string, Failure >::iterator fail = _failed.find( file );
+				if ( fail != _failed.end() )
+				{
+					if ( Clock::getSec() < fail->second.until )
+						throw SDP::Exception::Generic( fail->second.what );
+					_failed.erase( fail );
+				}
+				break;
+			}
+
+			Log::debug("SDP Pool: %s not existent", file.c_str() );
+			_loading.insert( file );
+			auto_ptr< Container > ctr;
 			try
 			{
-				SDP::Container & rt = _descriptions.at( file );
-				++ _count[ file ];
-				Log::debug("SDP Pool: %s exists, reference count to %llu", file.c_str(), _count[ file ] );
-				return rt;
-				
+				// probing may be slow, let other media go
+				Safe::UnLock ulk( lk );
+				ctr.reset( new SDP::Container( file ) );
 			}
-			catch( boost::bad_ptr_container_operation )
+			catch( const SDP::Exception::Generic & e )
 			{
-				Log::debug("SDP Pool: %s not existent", file.c_str() );
-				auto_ptr< Container > ctr( new SDP::Container( file ) );
-				{
-					string fTemp( file );
-					_descriptions.insert( fTemp, ctr );
-				}
-				_count.insert( make_pair( file, 1 ) );
-				return *ctr;
+				Failure & f = _failed[ file ];
+				f.until = Clock::getSec() + FAILURE_TTL;
+				f.what = e.what();
+				_loading.erase( file );
+				_loaded.notify_all();
+				throw;
+			}
+			catch( ... )
+			{
+				// no failure to cache, but waiters must not hang
+				_loading.erase( file );
+				_loaded.notify_all();
+				throw;
+			}
+
+			Container & rt = *ctr;
+			{
+				string fTemp( file );
+				_descriptions.insert( fTemp, ctr );
 			}
+			_count[ file ] = 1;
+			_loading.erase( file );
+			_loaded.notify_all();
+			return rt;
 		}
 
 		SDP::Container & Descriptions::getDescription( const string & file ) throw( KGD::Exception::NotFound )
 		{
-			Descriptions::Lock lk( Descriptions::mux() );
+			KGD::Lock lk( _mux );
 			Log::verbose("SDP Pool: getting description for %s", file.c_str() );
 			ContainerMap::iterator it = _descriptions.find( file );
 			if ( it == _descriptions.end() )
@@ -101,7 +148,7 @@ namespace KGD
 
 		void Descriptions::releaseDescription( const string & file ) throw( )
 		{
-			Descriptions::Lock lk( Descriptions::mux() );
+			KGD::Lock lk( _mux );
 			ContainerMap::iterator it = _descriptions.find( file );
 			if ( it == _descriptions.end() )
 				Log::debug( "SDP Pool: releasing unmanaged description for %s", file.c_str() );
@@ -25,6 +25,7 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     single-flight loading, failed loads cache
  *     boosted
  *     source import
  *
@@ -41,6 +42,7 @@
 
 #include <string>
 #include <map>
+#include <set>
 
 using namespace std;
 
@@ -52,12 +54,31 @@ namespace KGD
 		class Descriptions
 		: public Singleton::Class< Descriptions >
 		{
+		public:
+			//! seconds a failed load is remembered
+			static double FAILURE_TTL;
 		private:
 			typedef boost::ptr_map< string, Container > ContainerMap;
+			//! a failed load
+			struct Failure
+			{
+				//! time the failure expires at
+				double until;
+				//! error message
+				string what;
+			};
+			//! guards the maps below, not held while loading
+			KGD::Mutex _mux;
+			//! signals a load has completed
+			Condition _loaded;
 			//! loaded media container descriptors
 			ContainerMap _descriptions;
 			//! reference count for every described media
 			map< string, int64_t > _count;
+			//! media being loaded
+			set< string > _loading;
+			//! recently failed loads
+			map< string, Failure > _failed;
 			//! ctor
 			Descriptions();
 			friend class Singleton::Class< Descriptions >;
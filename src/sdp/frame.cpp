@@ -25,6 +25,12 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     live rings overwrite their oldest block, lagging iterators resync
+ *     ring frame table for live media
+ *     lock-free reads on frame table
+ *     frames know their medium, play lists
+ *     compact frame table, payloads in arena
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     Some cosmetics about enums and RTCP library
@@ -35,8 +41,13 @@
 
 
 #include "sdp/frame.h"
+#include "sdp/medium.h"
 #include "lib/array.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace KGD
 {
 	namespace SDP
@@ -53,14 +64,18 @@ namespace KGD
 			Base::Base( const AVPacket & pkt, double timebase )
 			: _time( pkt.dts * timebase )
 // 			, _displace( 0 )
-			, _released( 0 )
+			, _medium( 0 )
+			, _mediumPos( 0 )
+			, _refs( 1 )
 			{
 			}
 				
 			Base::Base( double t )
 			: _time( t )
 // 			, _displace( 0 )
-			, _released( 0 )
+			, _medium( 0 )
+			, _mediumPos( 0 )
+			, _refs( 1 )
 			{
 			}
 
@@ -68,14 +83,10 @@ namespace KGD
 			: _time( b._time )
 // 			, _displace( 0 )
 			, _pt( b._pt )
+			, _medium( b._medium )
 			, _mediumPos( b._mediumPos )
-			, _released( 0 )
-			{
-			}
-
-			size_t Base::release()
+			, _refs( 1 )
 			{
-				return ++ _released;
 			}
 
 			void Base::addTime( double delta )
@@ -118,29 +129,48 @@ namespace KGD
 				return _mediumPos;
 			}
 
+			void Base::setMedium( Medium::Base & m )
+			{
+				_medium = &m;
+			}
+
+			void Base::release() const
+			{
+				if ( _medium )
+					_medium->releaseFrame( _mediumPos );
+			}
+
+			void Base::addRef() const throw()
+			{
+				Safe::Atomic::add( _refs, uint32_t( 1 ) );
+			}
+
+			void Base::unRef( const Base * f ) throw()
+			{
+				if ( f && Safe::Atomic::add( f->_refs, uint32_t( -1 ) ) == 0 )
+					delete f;
+			}
+
 			// ***********************************************************************************************
 
-			MediaFile::MediaFile( const AVPacket & pkt, double timebase )
+			MediaFile::MediaFile( const AVPacket & pkt, double timebase, Arena & a )
 			: Base( pkt, timebase )
-			, _size( pkt.size )
 			, _isKey( pkt.flags & PKT_FLAG_KEY )
 			, _pos( pkt.pos )
-			, data( pkt.data, pkt.size )
+			, data( a.store( pkt.data, pkt.size ) )
 			{
 			}
 
-			MediaFile::MediaFile( const ByteArray & pkt, double t )
+			MediaFile::MediaFile( const ByteArray & pkt, double t, Arena & a )
 			: Base( t )
-			, _size( pkt.size() )
 			, _isKey( false )
 			, _pos( 0 )
-			, data( pkt )
+			, data( a.store( pkt.get(), pkt.size() ) )
 			{
 			}
 
 			MediaFile::MediaFile( const MediaFile & m )
 			: Base( m )
-			, _size( m._size )
 			, _isKey( m._isKey )
 			, _pos( m._pos )
 			, data( m.data )
@@ -154,7 +184,7 @@ namespace KGD
 			
 			int MediaFile::getSize() const
 			{
-				return _size;
+				return data.size();
 			}
 			uint64_t MediaFile::getFilePos() const
 			{
@@ -168,6 +198,230 @@ namespace KGD
 			{
 				return _isKey;
 			}
+
+			// ***********************************************************************************************
+
+			Table::Table()
+			: _timeBase( 1e-6 )
+			, _dir( BLOCKS, static_cast< Block * >( 0 ) )
+			, _size( 0 )
+			, _ring( 0 )
+			{
+			}
+
+			Table::~Table()
+			{
+				this->clear();
+			}
+
+			void Table::setTimeBase( double tb ) throw()
+			{
+				BOOST_ASSERT( _size == 0 );
+				if ( tb > 0 )
+					_timeBase = tb;
+			}
+
+			void Table::setRing( double seconds ) throw()
+			{
+				BOOST_ASSERT( _size == 0 );
+				// one more block for the one being filled
+				size_t blocks = size_t( ceil( seconds * MAX_RATE / BLOCK ) ) + 1;
+				_ring = min( BLOCKS, max( size_t( 2 ), blocks ) );
+			}
+
+			bool Table::setLinear() throw()
+			{
+				// positions map to the same blocks until the ring wraps
+				if ( _ring && this->size() > _ring * BLOCK )
+					return false;
+
+				_ring = 0;
+				return true;
+			}
+
+			size_t Table::size() const throw()
+			{
+				return Safe::Atomic::loadAcquire( _size );
+			}
+
+			size_t Table::first() const throw()
+			{
+				if ( ! _ring )
+					return 0;
+
+				size_t blocks = ( this->size() + BLOCK - 1 ) / BLOCK;
+				return ( blocks > _ring ? ( blocks - _ring ) * BLOCK : 0 );
+			}
+
+			void Table::clear() throw()
+			{
+				BOOST_FOREACH( Block * & b, _dir )
+				{
+					if ( b )
+					{
+						for( size_t i = 0; i < BLOCK; ++i )
+							Base::unRef( b->frame[ i ] );
+						delete b;
+						b = 0;
+					}
+				}
+				_size = 0;
+			}
+
+			size_t Table::getIndex( size_t pos ) const throw()
+			{
+				return ( _ring ? ( pos / BLOCK ) % _ring : pos / BLOCK );
+			}
+
+			Table::Block * Table::getBlock( size_t pos ) const throw()
+			{
+				// published with the entries, see size
+				Block * b = _dir[ this->getIndex( pos ) ];
+				return ( b && Safe::Atomic::loadAcquire( b->base ) == pos - pos % BLOCK ? b : 0 );
+			}
+
+			bool Table::holds( const Block * b, size_t pos ) const throw()
+			{
+				// field reads are done before the base is read again
+				Safe::Atomic::fenceAcquire();
+				return Safe::Atomic::loadRelaxed( b->base ) == pos - pos % BLOCK;
+			}
+
+			bool Table::push_back( Base * f, vector< Base * > & evicted ) throw()
+			{
+				size_t pos = _size;
+				if ( ! _ring && pos >= BLOCK * BLOCKS )
+				{
+					Base::unRef( f );
+					return false;
+				}
+
+				Block * & b = _dir[ this->getIndex( pos ) ];
+				if ( ! b )
+				{
+					b = new Block();
+					b->base = pos - pos % BLOCK;
+				}
+				else if ( b->base != pos - pos % BLOCK )
+				{
+					// ring wrapped: readers see the block changed before any entry is overwritten
+					Safe::Atomic::storeRelaxed( b->base, pos );
+					Safe::Atomic::fenceRelease();
+					// frames not retired yet are lagging behind the window, the caller reclaims them
+					for( size_t i = 0; i < BLOCK; ++i )
+					{
+						Base * volatile & slot = b->frame[ i ];
+						Base * old = Safe::Atomic::load( slot );
+						if ( old && Safe::Atomic::cas( slot, old, static_cast< Base * >( 0 ) ) == old )
+							evicted.push_back( old );
+					}
+				}
+
+				const MediaFile * mf = f->asPtrUnsafe< MediaFile >();
+				size_t i = pos % BLOCK;
+
+				Safe::Atomic::storeRelaxed( b->ticks[ i ], int64_t( llround( f->getTime() / _timeBase ) ) );
+				Safe::Atomic::storeRelaxed( b->length[ i ], uint32_t( mf ? mf->data.size() : 0 ) );
+				Safe::Atomic::storeRelaxed( b->key[ i ], uint8_t( mf && mf->isKey() ) );
+				Safe::Atomic::storeRelaxed( b->released[ i ], uint32_t( 0 ) );
+				Safe::Atomic::storeRelaxed( b->frame[ i ], f );
+
+				// entry is complete before readers can see it
+				Safe::Atomic::storeRelease( _size, pos + 1 );
+				return true;
+			}
+
+			Base * Table::get( size_t pos ) const throw()
+			{
+				Block * b = this->getBlock( pos );
+				if ( ! b )
+					return 0;
+
+				Base * f = Safe::Atomic::loadAcquire( b->frame[ pos % BLOCK ] );
+				// block may have been recycled meanwhile
+				return ( this->holds( b, pos ) ? f : 0 );
+			}
+
+			int64_t Table::getTicks( size_t pos ) const throw()
+			{
+				Block * b = this->getBlock( pos );
+				if ( ! b )
+					return numeric_limits< int64_t >::min();
+
+				int64_t rt = Safe::Atomic::loadRelaxed( b->ticks[ pos % BLOCK ] );
+				return ( this->holds( b, pos ) ? rt : numeric_limits< int64_t >::min() );
+			}
+
+			double Table::getTime( size_t pos ) const throw()
+			{
+				int64_t ticks = this->getTicks( pos );
+				return ( ticks == numeric_limits< int64_t >::min() ? -HUGE_VAL : ticks * _timeBase );
+			}
+
+			size_t Table::getLength( size_t pos ) const throw()
+			{
+				Block * b = this->getBlock( pos );
+				if ( ! b )
+					return 0;
+
+				size_t rt = Safe::Atomic::loadRelaxed( b->length[ pos % BLOCK ] );
+				return ( this->holds( b, pos ) ? rt : 0 );
+			}
+
+			bool Table::isKey( size_t pos ) const throw()
+			{
+				Block * b = this->getBlock( pos );
+				if ( ! b )
+					return false;
+
+				bool rt = Safe::Atomic::loadRelaxed( b->key[ pos % BLOCK ] ) != 0;
+				return rt && this->holds( b, pos );
+			}
+
+			size_t Table::release( size_t pos ) throw()
+			{
+				Block * b = this->getBlock( pos );
+				return ( b ? Safe::Atomic::add( b->released[ pos % BLOCK ], uint32_t( 1 ) ) : 0 );
+			}
+
+			Base * Table::retire( size_t pos ) throw()
+			{
+				Block * b = this->getBlock( pos );
+				if ( ! b )
+					return 0;
+
+				Base * volatile & slot = b->frame[ pos % BLOCK ];
+				Base * f = Safe::Atomic::loadAcquire( slot );
+				if ( f
+					&& this->holds( b, pos )
+					&& Safe::Atomic::cas( slot, f, static_cast< Base * >( 0 ) ) == f )
+					return f;
+				else
+					return 0;
+			}
+
+			size_t Table::lowerBound( double t ) const throw()
+			{
+				size_t sz = this->size();
+				double ticks = t / _timeBase;
+				if ( ticks <= -9e18 )
+					return this->first();
+				else if ( ticks >= 9e18 )
+					return sz;
+
+				// ticks are sorted since frames are added in time order; entries recycled meanwhile read as lowest
+				int64_t tTicks = int64_t( ceil( ticks - 1e-6 ) );
+				size_t lo = this->first(), hi = sz;
+				while( lo < hi )
+				{
+					size_t mid = lo + ( hi - lo ) / 2;
+					if ( this->getTicks( mid ) < tTicks )
+						lo = mid + 1;
+					else
+						hi = mid;
+				}
+				return lo;
+			}
 		}
 	}
 }
@@ -25,6 +25,12 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     live rings overwrite their oldest block, lagging iterators resync
+ *     ring frame table for live media
+ *     lock-free reads on frame table
+ *     frames know their medium, play lists
+ *     compact frame table, payloads in arena
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
  *     Some cosmetics about enums and RTCP library
@@ -40,6 +46,8 @@
 #include "lib/utils/virtual.hpp"
 #include "lib/utils/ref.hpp"
 #include "lib/array.h"
+#include "lib/arena.h"
+#include "lib/utils/safe.hpp"
 
 #include <string>
 #include <functional>
@@ -56,6 +64,11 @@ namespace KGD
 {
 	namespace SDP
 	{
+		namespace Medium
+		{
+			class Base;
+		}
+
 		//! frame data and metadata
 		namespace Frame
 		{
@@ -70,10 +83,12 @@ namespace KGD
 // 				mutable double _displace;
 				//! RTP payload type for this frame
 				Payload::type _pt;
+				//! medium owning this frame
+				Medium::Base * _medium;
 				//! array index in medium
 				size_t _mediumPos;
-				//! number of release issued for this frame
-				size_t _released;
+				//! references held by the medium table, iterators and RTP frames
+				mutable uint32_t volatile _refs;
 			public:
 				//! build from a ffmpeg packet and timebase to guess time
 				Base( const AVPacket &, double timebase );
@@ -86,6 +101,14 @@ namespace KGD
 				void setMediumPos( size_t );
 				//! get position in medium container
 				size_t getMediumPos() const;
+				//! set medium owning this frame
+				void setMedium( Medium::Base & );
+				//! tell the owning medium this frame has been sent
+				void release() const;
+				//! take a reference, keeping the frame alive once retired from its medium
+				void addRef() const throw();
+				//! drop a reference, deleting the frame with the last one
+				static void unRef( const Base * ) throw();
 
 				//! permanently shifts time by delta seconds
 				void addTime( double delta );
@@ -99,8 +122,6 @@ namespace KGD
 				//! force different RTP payload type
 				void setPayloadType( Payload::type );
 
-				//! release and return release count
-				size_t release();
 				//! get fresh copy
 				virtual Base* getClone() const;
 			};
@@ -113,19 +134,17 @@ namespace KGD
 			: public Base
 			{
 			protected:
-				//! frame size
-				int _size;
 				//! key frame indicator (for video media)
 				bool _isKey;
 				//! frame position into media container
 				uint64_t _pos;
 			public:
-				//! frame data
-				ByteArray data;
-				//! build from a ffmpeg packet
-				MediaFile( const AVPacket &, double timebase );
-				//! build from raw data
-				MediaFile( const ByteArray &, double t );
+				//! frame data, living into the medium arena
+				Arena::Slice data;
+				//! build from a ffmpeg packet, storing data into an arena
+				MediaFile( const AVPacket &, double timebase, Arena & );
+				//! build from raw data, storing it into an arena
+				MediaFile( const ByteArray &, double t, Arena & );
 				//! copy
 				MediaFile( const MediaFile & );
 				//! return frame size
@@ -139,6 +158,97 @@ namespace KGD
 				//! get fresh copy
 				virtual MediaFile* getClone() const;
 			};
+
+			//! frames of a medium and their compact metadata, stored as struct of arrays to keep scans on contiguous memory
+			//! append-only with a single writer; readers need no lock, blocks never move once allocated
+			//! live media use a ring of blocks indexed by frame sequence number, overwriting the oldest block when the ring wraps
+			//!
+			//! the writer fills an entry, then publishes it storing size with release; readers load size with acquire and never go past it
+			//! a block base works as a seqlock sequence: on wrap the writer stores the new base, then a release fence, then rewrites entries;
+			//! readers load the base with acquire, read the entry fields, then an acquire fence and the base again: a changed base discards the read
+			class Table
+			: public boost::noncopyable
+			{
+			public:
+				//! entries per block
+				static const size_t BLOCK = 4096;
+				//! max number of blocks
+				static const size_t BLOCKS = 4096;
+				//! frames per second a ring is sized for, more than any track we serve
+				static const size_t MAX_RATE = 200;
+			protected:
+				//! a fixed size slice of the table
+				struct Block
+				{
+					//! sequence number of first entry, the seqlock sequence of the entries
+					size_t volatile base;
+					//! frame times in ticks, accessed atomically
+					int64_t ticks[ BLOCK ];
+					//! payload sizes, accessed atomically
+					uint32_t length[ BLOCK ];
+					//! key frame indicators, accessed atomically
+					uint8_t key[ BLOCK ];
+					//! number of release issued for each frame
+					uint32_t volatile released[ BLOCK ];
+					//! frames, 0 once retired
+					Base * volatile frame[ BLOCK ];
+				};
+
+				//! seconds per tick
+				double _timeBase;
+				//! block directory, sized once
+				vector< Block * > _dir;
+				//! published number of entries, i.e. next sequence number
+				size_t volatile _size;
+				//! number of blocks in the ring, 0 if not a ring
+				size_t _ring;
+
+				//! get block holding an entry, 0 if not allocated or recycled
+				Block * getBlock( size_t ) const throw();
+				//! tells if a block still holds an entry whose fields have just been read
+				bool holds( const Block *, size_t ) const throw();
+				//! get directory index of the block holding an entry
+				size_t getIndex( size_t ) const throw();
+				//! get time in ticks, lowest value if the entry is not stored anymore
+				int64_t getTicks( size_t ) const throw();
+			public:
+				//! build empty
+				Table();
+				//! free every frame
+				~Table();
+				//! set seconds per tick; must be called while empty
+				void setTimeBase( double ) throw();
+				//! make this a ring holding at least the given seconds of frames; must be called while empty
+				void setRing( double ) throw();
+				//! stop recycling blocks, keeping every frame from now on; false if the ring already wrapped
+				bool setLinear() throw();
+				//! returns number of published entries, i.e. next sequence number
+				size_t size() const throw();
+				//! returns sequence number of the oldest entry still stored
+				size_t first() const throw();
+				//! remove all entries; no reader must be active
+				void clear() throw();
+
+				//! append a frame taking over its first reference, then publish it; false if full and the frame has been dropped
+				//! a ring never gets full: when it wraps, frames of the oldest block not yet retired are detached and appended to the evicted ones
+				bool push_back( Base *, vector< Base * > & evicted ) throw();
+
+				//! get frame, 0 if retired or no more stored
+				Base * get( size_t ) const throw();
+				//! get frame time in seconds, -HUGE_VAL if not stored anymore
+				double getTime( size_t ) const throw();
+				//! get payload size, 0 if not stored anymore
+				size_t getLength( size_t ) const throw();
+				//! tells if frame is key, false if not stored anymore
+				bool isKey( size_t ) const throw();
+				//! release and return release count
+				size_t release( size_t ) throw();
+				//! detach a frame from the table; returns it once to a single caller, with the table reference, 0 otherwise
+				Base * retire( size_t ) throw();
+
+				//! returns the position of the first frame at or after a time in seconds, or size if none
+				size_t lowerBound( double ) const throw();
+			};
 		}
 	}
 }
@@ -25,6 +25,14 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     play list items opened on demand, next one prefetched
+ *     frames are reference counted, iterators pin what they return
+ *     live rings overwrite their oldest block, lagging iterators resync
+ *     key frame trick play
+ *     end of frames without exceptions
+ *     frame batches
+ *     per session edit list instead of mutating the medium
+ *     concatenating iterator for play lists
  *     Lockables in timers and medium; refactorized iterator release
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
@@ -36,6 +44,9 @@
 
 
 #include "sdp/frameiterator.h"
+#include "sdp/container.h"
+
+#include <algorithm>
 
 namespace KGD
 {
@@ -49,10 +60,62 @@ namespace KGD
 				{
 				}
 
-				void Base::insert( Medium::Base & m, double t ) throw( KGD::Exception::OutOfBounds )
+				void Base::unpin() throw()
+				{
+				}
+
+				bool Base::tryNext( const SDP::Frame::Base * & f ) throw( KGD::Exception::NullPointer )
+				{
+					Batch one;
+					if ( ! this->nextBatch( 1, one ) )
+						return false;
+
+					f = one.front();
+					return true;
+				}
+
+				const SDP::Frame::Base & Base::seekKey( double t, bool forward ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
+				{
+					// time seeks land on the first key frame at or after the time
+					if ( forward )
+						return this->seek( t );
+
+					// going backward, seek earlier and earlier until a key frame not after t is found
+					for( double back = 0.0; ; back = max( 2 * back, 0.5 ) )
+					{
+						double from = max( 0.0, t - back );
+						const SDP::Frame::Base & f = this->seek( from );
+						if ( f.getTime() + this->getTimeShift() <= t )
+							return f;
+						else if ( from == 0.0 )
+							throw KGD::Exception::OutOfBounds( t, 0, this->duration() );
+					}
+				}
+
+				size_t Base::loadedSize() const throw()
+				{
+					return this->size();
+				}
+
+				size_t Base::range( size_t from, size_t to, Batch & out ) const throw()
 				{
-					boost::scoped_ptr< Iterator::Base > otherFrames( m.newFrameIterator() );
-					this->insert( *otherFrames, t );
+					size_t rt = 0;
+					for( ; from < to; ++ from )
+					{
+						try
+						{
+							out.push_back( &this->at( from ) );
+							++ rt;
+						}
+						catch( const KGD::Exception::NullPointer & )
+						{
+						}
+						catch( const KGD::Exception::OutOfBounds & )
+						{
+							break;
+						}
+					}
+					return rt;
 				}
 
 				// ***************************************************************************************************
@@ -72,9 +135,23 @@ namespace KGD
 
 				Default::~Default( )
 				{
+					this->unpin();
 					_med.releaseIterator( *this );
 				}
 
+				const SDP::Frame::Base & Default::pin( const SDP::Frame::Base & f ) const throw()
+				{
+					_pinned.push_back( &f );
+					return f;
+				}
+
+				void Default::unpin() throw()
+				{
+					BOOST_FOREACH( const SDP::Frame::Base * f, _pinned )
+						SDP::Frame::Base::unRef( f );
+					_pinned.clear();
+				}
+
 				Default * Default::getClone() const throw()
 				{
 					return new Default( *this );
@@ -82,31 +159,75 @@ namespace KGD
 
 				const SDP::Frame::Base & Default::at( size_t pos ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
-					return _med.getFrame( pos );
+					return this->pin( _med.getFrame( pos ) );
 				}
 				const SDP::Frame::Base & Default::curr() const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
-					return _med.getFrame( _pos );
+					return this->pin( _med.getFrame( max( _pos, _med.getFirstFramePos() ) ) );
 				}
 				const SDP::Frame::Base & Default::next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
-					return _med.getFrame( _pos ++ );
+					// lagging behind a live ring: resync to the oldest frame stored
+					_pos = max( _pos, _med.getFirstFramePos() );
+					return this->pin( _med.getFrame( _pos ++ ) );
 				}
 				const SDP::Frame::Base & Default::prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
 					if ( _pos == -1 )
 						throw KGD::Exception::OutOfBounds( -1, 0, _med.getFrameCount() );
-					return _med.getFrame( _pos -- );
+					return this->pin( _med.getFrame( _pos -- ) );
+				}
+				size_t Default::nextBatch( size_t n, Batch & out ) throw( KGD::Exception::NullPointer )
+				{
+					size_t before = out.size();
+					if ( n == 0 )
+						return 0;
+
+					// released frames are skipped until something is found
+					while( out.size() == before && _med.getFrameRange( _pos, size_t( -1 ), n, out ) )
+						;
+					_pinned.insert( _pinned.end(), out.begin() + before, out.end() );
+					return out.size() - before;
+				}
+				bool Default::tryPrev( const SDP::Frame::Base * & f ) throw( KGD::Exception::NullPointer )
+				{
+					// released frames are skipped until something is found
+					while( _pos != size_t( -1 ) && _pos >= _med.getFirstFramePos() )
+					{
+						size_t p = _pos --;
+						Batch one;
+						if ( ! _med.getFrameRange( p, p + 1, 1, one ) )
+							return false;
+						if ( ! one.empty() )
+						{
+							_pinned.push_back( f = one.front() );
+							return true;
+						}
+					}
+					return false;
+				}
+				void Default::rewind( bool forward ) throw()
+				{
+					// an empty medium is left before its beginning
+					_pos = ( forward ? 0 : _med.getFrameCount() - 1 );
+				}
+				size_t Default::range( size_t from, size_t to, Batch & out ) const throw()
+				{
+					size_t before = out.size();
+					if ( from < to )
+						_med.getFrameRange( from, to, to - from, out );
+					_pinned.insert( _pinned.end(), out.begin() + before, out.end() );
+					return out.size() - before;
 				}
 				const SDP::Frame::Base & Default::seek( double t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
 					_pos = _med.getFramePos( t );
-					return _med.getFrame( _pos );
+					return this->pin( _med.getFrame( _pos ) );
 				}
 
 				const SDP::Frame::Base & Default::seek( size_t p ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 				{
-					return _med.getFrame( _pos = p );
+					return this->pin( _med.getFrame( _pos = p ) );
 				}
 
 				size_t Default::pos( ) const throw( )
@@ -119,6 +240,11 @@ namespace KGD
 					return _med.getFrameCount();
 				}
 
+				size_t Default::loadedSize( ) const throw( )
+				{
+					return _med.getLoadedFrameCount();
+				}
+
 				double Default::duration() const throw()
 				{
 					return _med.getDuration();
@@ -129,16 +255,6 @@ namespace KGD
 					return 0;
 				}
 
-				void Default::insert( Iterator::Base & it, double t ) throw( KGD::Exception::OutOfBounds )
-				{
-					_med.insert( it, t );
-				}
-
-				void Default::insert( double duration, double t ) throw( KGD::Exception::OutOfBounds )
-				{
-					_med.insert( duration, t );
-				}
-
 				Medium::Base & Default::getMedium() throw()
 				{
 					return _med;
@@ -173,12 +289,21 @@ namespace KGD
 
 				size_t Loop::seekPos( size_t pos ) throw( KGD::Exception::OutOfBounds )
 				{
+					// frames already loaded belong to the first iteration, no need to wait for the others
+					if ( pos < _it->loadedSize() )
+					{
+						_cur = 0;
+						return pos;
+					}
 					_cur = pos / _it->size();
 					return this->normalizePos( pos );
 				}
 
 				size_t Loop::normalizePos( size_t pos ) const throw( KGD::Exception::OutOfBounds )
 				{
+					if ( pos < _it->loadedSize() )
+						return pos;
+
 					size_t sz = _it->size();
 					if ( _times == 0 || pos < sz * _times )
 						return pos % sz;
@@ -196,11 +321,7 @@ namespace KGD
 				{
 					double duration = _it->duration();
 					if ( _times == 0 || t < duration * _times )
-					{
-						while( t >= duration )
-							t -= duration;
-						return t;
-					}
+						return ( t < duration ? t : fmod( t, duration ) );
 					else
 						throw KGD::Exception::OutOfBounds( t, 0, duration * _times );
 				}
@@ -221,37 +342,78 @@ namespace KGD
 				}
 				const SDP::Frame::Base & Loop::next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
 				{
-					try
-					{
-						return _it->next();
-					}
-					catch( KGD::Exception::OutOfBounds )
-					{
-						++ _cur;
-
-						Log::debug("Loop: next %lu of %u", _cur, _times );
-						if ( _times == 0 || _cur < _times )
-						{
-							Log::debug("Loop: reset next", _cur, _times );
-							_it->seek( size_t(0) );
-							return this->next();
-						}
-						else
-							throw;
-					}
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryNext( rt ) )
+						throw KGD::Exception::OutOfBounds( this->pos(), 0, this->size() );
+					return *rt;
 				}
 				const SDP::Frame::Base & Loop::prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
 				{
-					try
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryPrev( rt ) )
+						throw KGD::Exception::OutOfBounds( -1, 0, this->size() );
+					return *rt;
+				}
+				size_t Loop::nextBatch( size_t n, Batch & out ) throw( KGD::Exception::NullPointer )
+				{
+					if ( n == 0 )
+						return 0;
+
+					// a batch ends with the iteration, since time shift changes
+					for(;;)
 					{
-						return _it->prev();
+						if ( size_t rt = _it->nextBatch( n, out ) )
+							return rt;
+
+						// an empty iteration would loop forever
+						if ( _it->size() == 0 || ( _times != 0 && _cur + 1 >= _times ) )
+							return 0;
+
+						++ _cur;
+						Log::debug("Loop: reset batch %lu of %u", _cur, _times );
+						_it->rewind( true );
 					}
-					catch( KGD::Exception::OutOfBounds )
+				}
+				bool Loop::tryPrev( const SDP::Frame::Base * & f ) throw( KGD::Exception::NullPointer )
+				{
+					if ( _it->tryPrev( f ) )
+						return true;
+
+					// an infinite loop goes back for ever
+					if ( _it->size() == 0 || ( _times != 0 && _cur == 0 ) )
+						return false;
+
+					if ( _cur > 0 )
+						-- _cur;
+					Log::debug("Loop: reset prev %lu of %u", _cur, _times );
+					_it->rewind( false );
+					return _it->tryPrev( f );
+				}
+				void Loop::rewind( bool forward ) throw()
+				{
+					_cur = ( forward || _times == 0 ? 0 : _times - 1 );
+					_it->rewind( forward );
+				}
+				size_t Loop::range( size_t from, size_t to, Batch & out ) const throw()
+				{
+					size_t rt = 0, sz = _it->size();
+					while( from < to && sz > 0 )
 					{
-						Log::debug("Loop: reset prev");
-						_it->seek( _it->size() - 1 );
-						return this->prev();
+						size_t local;
+						try
+						{
+							local = this->normalizePos( from );
+						}
+						catch( const KGD::Exception::OutOfBounds & )
+						{
+							break;
+						}
+						// up to the end of this iteration
+						size_t len = min( to - from, sz - local );
+						rt += _it->range( local, local + len, out );
+						from += len;
 					}
+					return rt;
 				}
 				const SDP::Frame::Base & Loop::seek( double t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
 				{
@@ -265,7 +427,8 @@ namespace KGD
 
 				size_t Loop::pos( ) const throw( )
 				{
-					return _it->pos() + (_it->size() * _cur);
+					// the first iteration needs no size, which may not be known yet
+					return ( _cur == 0 ? _it->pos() : _it->pos() + (_it->size() * _cur) );
 				}
 
 				size_t Loop::size( ) const throw( )
@@ -273,23 +436,716 @@ namespace KGD
 					return _it->size();
 				}
 
+				size_t Loop::loadedSize( ) const throw( )
+				{
+					return _it->loadedSize();
+				}
+
 				double Loop::duration() const throw()
 				{
 					return ( _times > 0 ? _it->duration() * _times : HUGE_VAL );
 				}
 
-				void Loop::insert( Iterator::Base & otherFrames, double t ) throw( KGD::Exception::OutOfBounds )
+				
+				void Loop::unpin() throw()
 				{
-					_it->insert( otherFrames, this->seekTime( t ) );
+					_it->unpin();
 				}
 
-				void Loop::insert( double duration, double t ) throw( KGD::Exception::OutOfBounds )
+				Medium::Base & Loop::getMedium() throw()
 				{
-					_it->insert( duration, this->seekTime( t ) );
+					return _it->getMedium();
 				}
 
-				
-				Medium::Base & Loop::getMedium() throw()
+				// ***************************************************************************************************
+
+				Concat::Concat( Medium::Base & m, SDP::Container & pl ) throw()
+				: _med( m )
+				, _list( pl )
+				, _duration( 0 )
+				, _cur( 0 )
+				{
+				}
+
+				Concat::Concat( const Concat & it ) throw()
+				: _med( it._med )
+				, _list( it._list )
+				, _offsets( it._offsets )
+				, _spans( it._spans )
+				, _duration( it._duration )
+				, _open( it._offsets.size(), false )
+				, _cur( 0 )
+				{
+					for( size_t i = 0; i < _offsets.size(); ++i )
+						_seg.push_back( 0 );
+				}
+
+				Concat::~Concat( )
+				{
+					for( size_t i = 0; i < _open.size(); ++i )
+						if ( _open[ i ] && ! _seg.is_null( i ) )
+						{
+							_seg.replace( i, 0 );
+							_list.releaseSegment( i );
+						}
+					_med.releaseIterator( *this );
+				}
+
+				Concat * Concat::getClone() const throw()
+				{
+					return new Concat( *this );
+				}
+
+				void Concat::append( double d, size_t frames ) throw()
+				{
+					_offsets.push_back( _duration );
+					_spans.push_back( frames );
+					_duration += d;
+				}
+
+				Iterator::Base * Concat::getSegment( size_t n ) const throw()
+				{
+					if ( ! _open[ n ] )
+					{
+						// the item is opened, and the next one prefetched, when first needed
+						if ( Medium::Base * m = _list.getSegmentMedium( n, _med.getPayloadType() ) )
+							_seg.replace( n, m->newFrameIterator() );
+						_open[ n ] = true;
+					}
+					return ( _seg.is_null( n ) ? 0 : &_seg[ n ] );
+				}
+
+				size_t Concat::getSpan( size_t n ) const throw()
+				{
+					// grows with the frames loaded, so positions already played keep their meaning, until the count is known
+					if ( n < _open.size() && _open[ n ] )
+					{
+						if ( _seg.is_null( n ) )
+							_spans[ n ] = 0;
+						else
+						{
+							const Medium::Base & m = _seg[ n ].getMedium();
+							_spans[ n ] = ( m.isFrameCountKnown() ? m.getFrameCount() : max( _spans[ n ], m.getLoadedFrameCount() ) );
+						}
+					}
+					return _spans[ n ];
+				}
+
+				void Concat::leaveSegments() throw()
+				{
+					for( size_t i = 0; i < _open.size(); ++i )
+					{
+						if ( i == _cur || ! _open[ i ] )
+							continue;
+
+						// keeps the last span known
+						this->getSpan( i );
+						Log::debug( "Concat: leave segment %lu", i );
+						bool used = ! _seg.is_null( i );
+						_seg.replace( i, 0 );
+						_open[ i ] = false;
+						if ( used )
+							_list.releaseSegment( i );
+					}
+				}
+
+				size_t Concat::getSegmentStart( size_t n ) const throw()
+				{
+					size_t rt = 0;
+					for( size_t i = 0; i < n && i < _spans.size(); ++i )
+						rt += this->getSpan( i );
+					return rt;
+				}
+
+				size_t Concat::locatePos( size_t & pos ) const throw( KGD::Exception::OutOfBounds )
+				{
+					size_t start = 0;
+					for( size_t i = 0; i < _seg.size(); ++i )
+					{
+						size_t sz = this->getSpan( i );
+						if ( pos < start + sz )
+						{
+							pos -= start;
+							return i;
+						}
+						start += sz;
+					}
+					throw KGD::Exception::OutOfBounds( pos, 0, start );
+				}
+
+				size_t Concat::locateTime( double & t ) const throw( KGD::Exception::OutOfBounds )
+				{
+					if ( t < 0 || t >= _duration || _seg.empty() )
+						throw KGD::Exception::OutOfBounds( t, 0, _duration );
+
+					size_t rt = upper_bound( _offsets.begin(), _offsets.end(), t ) - _offsets.begin() - 1;
+					t -= _offsets[ rt ];
+					return rt;
+				}
+
+				void Concat::enterSegment( size_t n, bool forward ) throw()
+				{
+					Log::debug( "Concat: %s segment %lu", ( forward ? "enter" : "back to" ), n );
+					_cur = n;
+					if ( Iterator::Base * s = this->getSegment( n ) )
+						s->rewind( forward );
+				}
+
+				const SDP::Frame::Base & Concat::at( size_t pos ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					size_t n = this->locatePos( pos );
+					if ( Iterator::Base * s = this->getSegment( n ) )
+						return s->at( pos );
+					else
+						throw KGD::Exception::NullPointer( "void segment " + KGD::toString( n ) );
+				}
+
+				const SDP::Frame::Base & Concat::curr() const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					if ( _cur >= _seg.size() )
+						throw KGD::Exception::OutOfBounds( _cur, 0, _seg.size() );
+					else if ( Iterator::Base * s = this->getSegment( _cur ) )
+						return s->curr();
+					else
+						throw KGD::Exception::NullPointer( "void segment " + KGD::toString( _cur ) );
+				}
+
+				const SDP::Frame::Base & Concat::next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryNext( rt ) )
+						throw KGD::Exception::OutOfBounds( _cur + 1, 0, _seg.size() );
+					return *rt;
+				}
+
+				const SDP::Frame::Base & Concat::prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryPrev( rt ) )
+						throw KGD::Exception::OutOfBounds( -1, 0, _seg.size() );
+					return *rt;
+				}
+
+				size_t Concat::nextBatch( size_t n, Batch & out ) throw( KGD::Exception::NullPointer )
+				{
+					if ( n == 0 )
+						return 0;
+
+					// a batch ends with the segment, since time shift changes
+					for( ; _cur < _seg.size(); this->enterSegment( _cur + 1, true ) )
+					{
+						if ( Iterator::Base * s = this->getSegment( _cur ) )
+							if ( size_t rt = s->nextBatch( n, out ) )
+								return rt;
+
+						if ( _cur + 1 >= _seg.size() )
+							break;
+					}
+					return 0;
+				}
+
+				bool Concat::tryPrev( const SDP::Frame::Base * & f ) throw( KGD::Exception::NullPointer )
+				{
+					for( ; _cur < _seg.size(); this->enterSegment( _cur - 1, false ) )
+					{
+						if ( Iterator::Base * s = this->getSegment( _cur ) )
+							if ( s->tryPrev( f ) )
+								return true;
+
+						if ( _cur == 0 )
+							break;
+					}
+					return false;
+				}
+
+				void Concat::rewind( bool forward ) throw()
+				{
+					if ( ! _seg.empty() )
+						this->enterSegment( forward ? 0 : _seg.size() - 1, forward );
+				}
+
+				const SDP::Frame::Base & Concat::seek( double t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					double local = t;
+					_cur = this->locateTime( local );
+					if ( Iterator::Base * s = this->getSegment( _cur ) )
+					{
+						try
+						{
+							return s->seek( local );
+						}
+						catch( const KGD::Exception::OutOfBounds & )
+						{
+						}
+					}
+
+					// nothing to play in that segment after t: start from the next one
+					return this->startNextSegment();
+				}
+
+				const SDP::Frame::Base & Concat::seek( size_t p ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					size_t local = p;
+					_cur = this->locatePos( local );
+					if ( Iterator::Base * s = this->getSegment( _cur ) )
+					{
+						try
+						{
+							return s->seek( local );
+						}
+						catch( const KGD::Exception::OutOfBounds & )
+						{
+						}
+					}
+
+					// the estimate spans past the frames of that segment: start from the next one
+					return this->startNextSegment();
+				}
+
+				const SDP::Frame::Base & Concat::startNextSegment() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
+				{
+					for(;;)
+					{
+						if ( _cur + 1 >= _seg.size() )
+							throw KGD::Exception::OutOfBounds( _cur + 1, 0, _seg.size() );
+
+						this->enterSegment( _cur + 1, true );
+						if ( Iterator::Base * s = this->getSegment( _cur ) )
+							return s->curr();
+					}
+				}
+
+				size_t Concat::pos( ) const throw( )
+				{
+					if ( _cur >= _seg.size() )
+						return 0;
+
+					Iterator::Base * s = this->getSegment( _cur );
+					return this->getSegmentStart( _cur ) + ( s ? s->pos() : 0 );
+				}
+
+				size_t Concat::size( ) const throw( )
+				{
+					return this->getSegmentStart( _seg.size() );
+				}
+
+				double Concat::duration() const throw()
+				{
+					return _duration;
+				}
+
+				double Concat::getTimeShift( ) const throw()
+				{
+					return ( _cur < _offsets.size() ? _offsets[ _cur ] : 0 );
+				}
+
+				void Concat::unpin() throw()
+				{
+					for( size_t i = 0; i < _seg.size(); ++i )
+						if ( ! _seg.is_null( i ) )
+							_seg[ i ].unpin();
+
+					// no frame of theirs is pinned anymore
+					this->leaveSegments();
+				}
+
+				Medium::Base & Concat::getMedium() throw()
+				{
+					return _med;
+				}
+
+				// ***************************************************************************************************
+
+				const size_t Edit::NONE = size_t( -1 );
+
+				Edit::Cut::Cut( size_t p, double t, double d, size_t sz ) throw()
+				: pos( p )
+				, time( t )
+				, duration( d )
+				, size( sz )
+				, shift( 0 )
+				, count( 0 )
+				{
+				}
+
+				Edit::Edit( Iterator::Base * it ) throw()
+				: _it( it )
+				, _cur( NONE )
+				, _next( 0 )
+				{
+				}
+
+				Edit::Edit( const Edit & it ) throw()
+				: _it( it._it->getClone() )
+				, _cuts( it._cuts )
+				, _cur( NONE )
+				, _next( 0 )
+				{
+					for( size_t i = 0; i < it._ins.size(); ++i )
+						_ins.push_back( it._ins.is_null( i ) ? 0 : const_cast< Iterator::Base & >( it._ins[ i ] ).getMedium().newFrameIterator() );
+				}
+
+				Edit::~Edit( )
+				{
+					_it->getMedium().releaseIterator( *this );
+				}
+
+				Edit * Edit::getClone() const throw()
+				{
+					return new Edit( *this );
+				}
+
+				double Edit::getShift( size_t n ) const throw()
+				{
+					if ( n < _cuts.size() )
+						return _cuts[ n ].shift;
+					else if ( _cuts.empty() )
+						return 0;
+					else
+						return _cuts.back().shift + _cuts.back().duration;
+				}
+
+				size_t Edit::getSize( size_t n ) const throw()
+				{
+					return _cuts[ n ].size;
+				}
+
+				size_t Edit::getCount( size_t n ) const throw()
+				{
+					if ( n < _cuts.size() )
+						return _cuts[ n ].count;
+					else if ( _cuts.empty() )
+						return 0;
+					else
+						return _cuts.back().count + _cuts.back().size;
+				}
+
+				size_t Edit::findCut( size_t pos ) const throw()
+				{
+					// cuts start at pos + count in the edited iteration, never decreasing
+					size_t lo = 0, hi = _cuts.size();
+					while( lo < hi )
+					{
+						size_t mid = ( lo + hi ) / 2;
+						if ( _cuts[ mid ].pos + _cuts[ mid ].count > pos )
+							hi = mid;
+						else
+							lo = mid + 1;
+					}
+					return lo;
+				}
+
+				size_t Edit::findCut( double t ) const throw()
+				{
+					// cuts start at time + shift in the edited iteration, never decreasing
+					size_t lo = 0, hi = _cuts.size();
+					while( lo < hi )
+					{
+						size_t mid = ( lo + hi ) / 2;
+						if ( _cuts[ mid ].time + _cuts[ mid ].shift > t )
+							hi = mid;
+						else
+							lo = mid + 1;
+					}
+					return lo;
+				}
+
+				void Edit::sumCuts( size_t from ) throw()
+				{
+					for( size_t i = from; i < _cuts.size(); ++i )
+					{
+						_cuts[ i ].shift = ( i == 0 ? 0 : _cuts[ i - 1 ].shift + _cuts[ i - 1 ].duration );
+						_cuts[ i ].count = ( i == 0 ? 0 : _cuts[ i - 1 ].count + _cuts[ i - 1 ].size );
+					}
+				}
+
+				size_t Edit::locatePos( size_t & pos, size_t & following ) const throw()
+				{
+					// only the last cut starting at or before pos may hold it
+					size_t i = this->findCut( pos );
+					following = i;
+					if ( i > 0 && pos < _cuts[ i - 1 ].pos + _cuts[ i - 1 ].count + _cuts[ i - 1 ].size )
+					{
+						pos -= _cuts[ i - 1 ].pos + _cuts[ i - 1 ].count;
+						return i - 1;
+					}
+					pos -= this->getCount( i );
+					return NONE;
+				}
+
+				void Edit::enterCut( size_t n, bool forward ) throw()
+				{
+					Log::debug( "Edit: %s cut %lu", ( forward ? "enter" : "back to" ), n );
+					_cur = n;
+					if ( ! _ins.is_null( n ) )
+						_ins[ n ].rewind( forward );
+				}
+
+				void Edit::rewindBase( size_t p ) throw()
+				{
+					try
+					{
+						_it->seek( p );
+					}
+					catch( const KGD::Exception::Generic & e )
+					{
+						Log::debug( "Edit: base position %lu: %s", p, e.what() );
+					}
+				}
+
+				const SDP::Frame::Base & Edit::at( size_t pos ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					size_t following;
+					size_t n = this->locatePos( pos, following );
+					if ( n == NONE )
+						return _it->at( pos );
+					else
+						return _ins[ n ].at( pos );
+				}
+
+				const SDP::Frame::Base & Edit::curr() const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					if ( _cur == NONE )
+						return _it->curr();
+					else if ( _ins.is_null( _cur ) )
+						throw KGD::Exception::NullPointer( "void cut " + KGD::toString( _cur ) );
+					else
+						return _ins[ _cur ].curr();
+				}
+
+				const SDP::Frame::Base & Edit::next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryNext( rt ) )
+						throw KGD::Exception::OutOfBounds( this->pos(), 0, this->size() );
+					return *rt;
+				}
+
+				const SDP::Frame::Base & Edit::prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					const SDP::Frame::Base * rt;
+					if ( ! this->tryPrev( rt ) )
+						throw KGD::Exception::OutOfBounds( -1, 0, this->size() );
+					return *rt;
+				}
+
+				size_t Edit::nextBatch( size_t n, Batch & out ) throw( KGD::Exception::NullPointer )
+				{
+					if ( n == 0 )
+						return 0;
+
+					for(;;)
+					{
+						if ( _cur != NONE )
+						{
+							if ( ! _ins.is_null( _cur ) )
+								if ( size_t rt = _ins[ _cur ].nextBatch( n, out ) )
+									return rt;
+
+							// back to base
+							_next = _cur + 1;
+							_cur = NONE;
+						}
+						else if ( _next < _cuts.size() && _it->pos() >= _cuts[ _next ].pos )
+							this->enterCut( _next, true );
+						else
+						{
+							// stop before next cut
+							size_t limit = ( _next < _cuts.size() ? min( n, _cuts[ _next ].pos - _it->pos() ) : n );
+							if ( size_t rt = _it->nextBatch( limit, out ) )
+								return rt;
+							else if ( _next >= _cuts.size() )
+								return 0;
+
+							this->enterCut( _next, true );
+						}
+					}
+				}
+
+				bool Edit::tryPrev( const SDP::Frame::Base * & f ) throw( KGD::Exception::NullPointer )
+				{
+					for(;;)
+					{
+						if ( _cur != NONE )
+						{
+							if ( ! _ins.is_null( _cur ) && _ins[ _cur ].tryPrev( f ) )
+								return true;
+
+							// back to base
+							_next = _cur;
+							_cur = NONE;
+						}
+						else if ( _next > 0 && _it->pos() < _cuts[ _next - 1 ].pos )
+							this->enterCut( _next - 1, false );
+						else if ( _it->tryPrev( f ) )
+							return true;
+						else if ( _next == 0 )
+							return false;
+						else
+							this->enterCut( _next - 1, false );
+					}
+				}
+
+				void Edit::rewind( bool forward ) throw()
+				{
+					// cuts at the edges are entered by the next fetch
+					_cur = NONE;
+					_next = ( forward ? 0 : _cuts.size() );
+					_it->rewind( forward );
+				}
+
+				const SDP::Frame::Base & Edit::seek( double t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					// only the last cut starting at or before t may hold it
+					size_t i = this->findCut( t );
+					if ( i > 0 )
+					{
+						double start = _cuts[ i - 1 ].time + _cuts[ i - 1 ].shift;
+						if ( t < start + _cuts[ i - 1 ].duration )
+						{
+							if ( ! _ins.is_null( i - 1 ) )
+							{
+								try
+								{
+									const SDP::Frame::Base & rt = _ins[ i - 1 ].seek( t - start );
+									_cur = i - 1;
+									return rt;
+								}
+								catch( const KGD::Exception::OutOfBounds & )
+								{
+								}
+							}
+							// nothing to play in that cut after t: resume base
+							_cur = NONE;
+							_next = i;
+							return _it->seek( _cuts[ i - 1 ].pos );
+						}
+					}
+
+					_cur = NONE;
+					_next = i;
+					return _it->seek( t - this->getShift( i ) );
+				}
+
+				const SDP::Frame::Base & Edit::seek( size_t p ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  )
+				{
+					size_t following;
+					size_t n = this->locatePos( p, following );
+					if ( n == NONE )
+					{
+						_cur = NONE;
+						_next = following;
+						return _it->seek( p );
+					}
+					else
+					{
+						_cur = n;
+						return _ins[ n ].seek( p );
+					}
+				}
+
+				size_t Edit::pos( ) const throw( )
+				{
+					if ( _cur == NONE )
+						return _it->pos() + this->getCount( _next );
+					else
+						return _cuts[ _cur ].pos + this->getCount( _cur ) + ( _ins.is_null( _cur ) ? 0 : _ins[ _cur ].pos() );
+				}
+
+				size_t Edit::size( ) const throw( )
+				{
+					return _it->size() + this->getCount( _cuts.size() );
+				}
+
+				double Edit::duration() const throw()
+				{
+					return _it->duration() + this->getShift( _cuts.size() );
+				}
+
+				double Edit::getTimeShift( ) const throw()
+				{
+					if ( _cur == NONE )
+						return _it->getTimeShift() + this->getShift( _next );
+					else if ( _ins.is_null( _cur ) )
+						return _cuts[ _cur ].time + this->getShift( _cur );
+					else
+						return _cuts[ _cur ].time + this->getShift( _cur ) + _ins[ _cur ].getTimeShift();
+				}
+
+				void Edit::addCut( Iterator::Base * ins, double d, double t ) throw( KGD::Exception::OutOfBounds )
+				{
+					std::auto_ptr< Iterator::Base > owned( ins );
+
+					// find the base position the cut has to be played before
+					size_t i = this->findCut( t );
+					double shift = this->getShift( i );
+					// no nesting: a time inside a cut means right after it
+					bool inside = ( i > 0 && t < _cuts[ i - 1 ].time + shift );
+
+					size_t p;
+					double baseT;
+					if ( inside )
+					{
+						p = _cuts[ i - 1 ].pos;
+						baseT = _cuts[ i - 1 ].time;
+					}
+					else
+					{
+						// dry seek on the base iteration
+						size_t saved = _it->pos();
+						try
+						{
+							const SDP::Frame::Base & f = _it->seek( t - shift );
+							p = _it->pos();
+							baseT = f.getTime() + _it->getTimeShift();
+						}
+						catch( ... )
+						{
+							this->rewindBase( saved );
+							throw;
+						}
+						this->rewindBase( saved );
+					}
+
+					Log::debug( "Edit: cut %lu of %lf s at base position %lu, time %lf", i, d, p, baseT );
+
+					// rewind if the cut falls before what we're going to play
+					bool rewind = ( _cur != NONE ? i <= _cur : ( _next > i || ( _next == i && _it->pos() > p ) ) );
+
+					_cuts.insert( _cuts.begin() + i, Cut( p, baseT, d, ( owned.get() ? owned->size() : 0 ) ) );
+					_ins.insert( _ins.begin() + i, owned.release() );
+					this->sumCuts( i );
+
+					if ( rewind )
+					{
+						_cur = NONE;
+						_next = i;
+						this->rewindBase( p );
+					}
+					else if ( _cur == NONE && _next > i )
+						++ _next;
+				}
+
+				void Edit::insert( Medium::Base & m, double t ) throw( KGD::Exception::OutOfBounds )
+				{
+					Iterator::Base * ins = m.newFrameIterator();
+					this->addCut( ins, ins->duration(), t );
+				}
+
+				void Edit::insert( double d, double t ) throw( KGD::Exception::OutOfBounds )
+				{
+					this->addCut( 0, d, t );
+				}
+
+				void Edit::unpin() throw()
+				{
+					_it->unpin();
+					for( size_t i = 0; i < _ins.size(); ++i )
+						if ( ! _ins.is_null( i ) )
+							_ins[ i ].unpin();
+				}
+
+				Medium::Base & Edit::getMedium() throw()
 				{
 					return _it->getMedium();
 				}
@@ -25,6 +25,14 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     native backward fetch and rewind, no exception at segment, cut or loop boundaries
+ *     play list items opened on demand, next one prefetched
+ *     frames are reference counted, iterators pin what they return
+ *     key frame trick play
+ *     end of frames without exceptions
+ *     frame batches
+ *     per session edit list instead of mutating the medium
+ *     concatenating iterator for play lists
  *     Lockables in timers and medium; refactorized iterator release
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
@@ -51,6 +59,11 @@ namespace KGD
 				class Base;
 				class Default;
 				class Loop;
+				class Concat;
+				class Edit;
+
+				//! frames fetched at once
+				typedef Medium::Base::FrameBatch Batch;
 
 				
 				//! Medium frame iterator interface
@@ -71,28 +84,37 @@ namespace KGD
 					virtual const SDP::Frame::Base & next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  ) = 0;
 					//! returns frame at current position then backwards position by 1
 					virtual const SDP::Frame::Base & prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer ) = 0;
+					//! appends up to n next frames sharing the same time shift; returns how many, 0 at the end
+					virtual size_t nextBatch( size_t n, Batch & ) throw( KGD::Exception::NullPointer ) = 0;
+					//! appends the valid frames between two positions; does not change current position
+					virtual size_t range( size_t from, size_t to, Batch & ) const throw();
+					//! gets next frame; false at the end
+					bool tryNext( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer );
+					//! gets frame at current position then backwards position by 1; false at the beginning
+					virtual bool tryPrev( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer ) = 0;
+					//! positions on the first frame going forward, on the last one going backward, without fetching it
+					virtual void rewind( bool forward ) throw() = 0;
+					//! frames returned so far stay alive until this is called, even if their medium reclaims them
+					virtual void unpin() throw();
 
 					//! seeks first frame at specified time. changes current position
 					virtual const SDP::Frame::Base & seek( double ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  ) = 0;
 					//! seeks to a position
 					virtual const SDP::Frame::Base & seek( size_t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer  ) = 0;
+					//! seeks the key frame nearest to a time, at or after it going forward, at or before it going backward. changes current position
+					virtual const SDP::Frame::Base & seekKey( double, bool forward ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
 
 					//! returns current position
 					virtual size_t pos() const throw() = 0;
 					//! returns number of frames this iterator referers to
 					virtual size_t size() const throw() = 0;
+					//! returns a lower bound of size, without waiting for frames to be loaded
+					virtual size_t loadedSize() const throw();
 					//! returns duration of this iteration in seconds
 					virtual double duration() const throw() = 0;
 					//! returns time shift to be applied to RTP frames
 					virtual double getTimeShift() const throw() = 0;
 
-					//! inserts another iterator
-					virtual void insert( Iterator::Base &, double t ) throw( KGD::Exception::OutOfBounds ) = 0;
-					//! inserts another medium
-					void insert( Medium::Base &, double t ) throw( KGD::Exception::OutOfBounds );
-					//! inserts a void space
-					virtual void insert( double duration, double t ) throw( KGD::Exception::OutOfBounds ) = 0;
-
 					//! get medium this iterator works on
 					virtual Medium::Base & getMedium() throw() = 0;
 				};
@@ -106,9 +128,13 @@ namespace KGD
 					Medium::Base & _med;
 					//! current position in the frame vector
 					size_t _pos;
+					//! frames returned and still referenced
+					mutable vector< const SDP::Frame::Base * > _pinned;
 
 					//! copy another iterator
 					Default( const Default & ) throw();
+					//! holds the reference taken by the medium on a returned frame until unpin
+					const SDP::Frame::Base & pin( const SDP::Frame::Base & ) const throw();
 				public:
 					//! construct from an abstract medium
 					Default( Medium::Base & ) throw();
@@ -124,22 +150,30 @@ namespace KGD
 					virtual const SDP::Frame::Base & next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
 					//! returns frame at current position then backwards position by 1
 					virtual const SDP::Frame::Base & prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! appends up to n next frames
+					virtual size_t nextBatch( size_t n, Batch & ) throw( KGD::Exception::NullPointer );
+					//! gets previous frame, skipping released ones
+					virtual bool tryPrev( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer );
+					//! positions on first or last frame
+					virtual void rewind( bool forward ) throw();
+					//! appends the valid frames between two positions
+					virtual size_t range( size_t from, size_t to, Batch & ) const throw();
 					//! seeks first frame at specified time. changes current position
 					virtual const SDP::Frame::Base & seek( double ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
 					//! seeks to a position
 					virtual const SDP::Frame::Base & seek( size_t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! drops references to frames returned so far
+					virtual void unpin() throw();
 					//! returns current position
 					virtual size_t pos() const throw();
 					//! returns number of effective frames in this medium
 					virtual size_t size() const throw();
+					//! returns number of frames loaded so far
+					virtual size_t loadedSize() const throw();
 					//! returns duration of this iteration in seconds
 					virtual double duration() const throw();
 					//! no time shift
 					virtual double getTimeShift() const throw();
-					//! inserts another medium
-					virtual void insert( Iterator::Base &, double t ) throw( KGD::Exception::OutOfBounds );
-					//! inserts a void space
-					virtual void insert( double duration, double t ) throw( KGD::Exception::OutOfBounds );
 
 					//! get medium this iterator works on
 					virtual Medium::Base & getMedium() throw();
@@ -183,22 +217,220 @@ namespace KGD
 					virtual const SDP::Frame::Base & next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
 					//! returns frame at current position then backwards position by 1
 					virtual const SDP::Frame::Base & prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! appends up to n next frames
+					virtual size_t nextBatch( size_t n, Batch & ) throw( KGD::Exception::NullPointer );
+					//! gets previous frame, wrapping to the end of the iteration before
+					virtual bool tryPrev( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer );
+					//! positions on first frame of the first iteration, or on last frame of the last one
+					virtual void rewind( bool forward ) throw();
+					//! appends the valid frames between two positions
+					virtual size_t range( size_t from, size_t to, Batch & ) const throw();
 					//! seeks first frame at specified time. changes current position
 					virtual const SDP::Frame::Base & seek( double ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
 					//! seeks to a position
 					virtual const SDP::Frame::Base & seek( size_t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! drops references to frames returned so far
+					virtual void unpin() throw();
 					//! returns current position
 					virtual size_t pos() const throw();
 					//! returns number of effective frames in this medium
 					virtual size_t size() const throw();
+					//! returns frames loaded so far in one iteration
+					virtual size_t loadedSize() const throw();
 					//! returns duration of this iteration in seconds
 					virtual double duration() const throw();
 					//! time shift is duration * every performed iteration
 					virtual double getTimeShift() const throw();
-					//! inserts another medium
-					virtual void insert( Iterator::Base &, double t ) throw( KGD::Exception::OutOfBounds );
-					//! inserts a void space
-					virtual void insert( double duration, double t ) throw( KGD::Exception::OutOfBounds );
+
+					//! get medium this iterator works on
+					virtual Medium::Base & getMedium() throw();
+				};
+
+				//! Plays the media of play list items one after the other, without copying their frames
+				class Concat
+				: public Base
+				{
+				protected:
+					//! medium this iteration is presented as
+					Medium::Base & _med;
+					//! play list whose items are the segments
+					SDP::Container & _list;
+					//! start time of each segment
+					vector< double > _offsets;
+					//! positions each segment spans: estimated from the play list scan, then the frames loaded, then the actual count
+					mutable vector< size_t > _spans;
+					//! total duration
+					double _duration;
+					//! segment iterators, built when a segment is first needed; 0 for a void segment, empty in the model
+					mutable boost::ptr_vector< boost::nullable< Iterator::Base > > _seg;
+					//! segments whose item has been looked up
+					mutable vector< bool > _open;
+					//! current segment
+					size_t _cur;
+
+					//! copy another iterator; segment iterators are built lazily
+					Concat( const Concat & ) throw();
+
+					//! returns the iterator of a segment, opening its play list item if needed; 0 if void
+					Iterator::Base * getSegment( size_t ) const throw();
+					//! returns the positions a segment spans, without opening it nor waiting for its frames
+					size_t getSpan( size_t ) const throw();
+					//! closes the segments other than the current one, letting the play list unload their items
+					void leaveSegments() throw();
+					//! enters the first segment after the current one with something to play
+					const SDP::Frame::Base & startNextSegment() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+
+					//! returns the index of the segment spanning a position; position is made local
+					size_t locatePos( size_t & ) const throw( KGD::Exception::OutOfBounds );
+					//! returns the index of the segment holding a time; time is made local
+					size_t locateTime( double & ) const throw( KGD::Exception::OutOfBounds );
+					//! returns the number of frames before a segment
+					size_t getSegmentStart( size_t ) const throw();
+					//! moves to a segment, rewinding it when going forward or winding it to the end when going backward
+					void enterSegment( size_t, bool forward ) throw();
+				public:
+					//! construct empty on a medium, over the items of a play list
+					Concat( Medium::Base &, SDP::Container & ) throw();
+					//! get clone of this iterator
+					virtual Concat* getClone() const throw();
+					//! dtor
+					virtual ~Concat();
+					//! append the next play list item, with its estimated number of frames
+					void append( double duration, size_t frames ) throw();
+					//! returns frame at position. does not change current position
+					virtual const SDP::Frame::Base & at( size_t ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position
+					virtual const SDP::Frame::Base & curr() const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position then advances position by 1
+					virtual const SDP::Frame::Base & next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position then backwards position by 1
+					virtual const SDP::Frame::Base & prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! appends up to n next frames, not crossing a segment
+					virtual size_t nextBatch( size_t n, Batch & ) throw( KGD::Exception::NullPointer );
+					//! gets previous frame, going back to the segment before
+					virtual bool tryPrev( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer );
+					//! positions on first frame of the first segment, or on last frame of the last one
+					virtual void rewind( bool forward ) throw();
+					//! seeks first frame at specified time. changes current position
+					virtual const SDP::Frame::Base & seek( double ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! seeks to a position
+					virtual const SDP::Frame::Base & seek( size_t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! drops references to frames returned so far, then closes the segments played past
+					virtual void unpin() throw();
+					//! returns current position
+					virtual size_t pos() const throw();
+					//! returns the positions every segment spans; segments not loaded yet count their estimated frames
+					virtual size_t size() const throw();
+					//! returns duration of every segment
+					virtual double duration() const throw();
+					//! time shift is the start time of current segment
+					virtual double getTimeShift() const throw();
+
+					//! get medium this iterator works on
+					virtual Medium::Base & getMedium() throw();
+				};
+
+				//! Plays another iterator with insertions and delays applied on top of it; the medium is never modified
+				class Edit
+				: public Base
+				{
+				protected:
+					//! an insertion before a base frame
+					struct Cut
+					{
+						//! base position the insertion is played before
+						size_t pos;
+						//! base time of that position
+						double time;
+						//! inserted duration
+						double duration;
+						//! inserted frames
+						size_t size;
+						//! inserted duration of the cuts before
+						double shift;
+						//! inserted frames of the cuts before
+						size_t count;
+
+						Cut( size_t, double, double, size_t ) throw();
+					};
+
+					//! iterator we're editing
+					boost::scoped_ptr< Iterator::Base > _it;
+					//! insertions, sorted by base position, hence by edited position and time
+					vector< Cut > _cuts;
+					//! inserted iterators, one for each cut; 0 for a delay
+					boost::ptr_vector< boost::nullable< Iterator::Base > > _ins;
+					//! cut being played, NONE when playing the base iterator
+					size_t _cur;
+					//! first cut not yet played
+					size_t _next;
+
+					//! no cut
+					static const size_t NONE;
+
+					//! copy another iterator, getting new iterators from the inserted media
+					Edit( const Edit & ) throw();
+
+					//! returns the sum of the durations of the cuts before the given one
+					double getShift( size_t ) const throw();
+					//! returns the sum of the sizes of the cuts before the given one
+					size_t getCount( size_t ) const throw();
+					//! returns the number of frames in a cut
+					size_t getSize( size_t ) const throw();
+					//! returns the first cut starting after an edited position
+					size_t findCut( size_t ) const throw();
+					//! returns the first cut starting after an edited time
+					size_t findCut( double ) const throw();
+					//! updates shift and count of the cuts from the given one on
+					void sumCuts( size_t ) throw();
+					//! returns the cut holding a position, NONE if in base; position is made local, the following cut is returned in the last param
+					size_t locatePos( size_t &, size_t & ) const throw();
+					//! moves to a cut, rewinding it when going forward or winding it to the end when going backward
+					void enterCut( size_t, bool forward ) throw();
+					//! moves base iterator to a position, ignoring errors
+					void rewindBase( size_t ) throw();
+					//! adds a cut at a given presentation time
+					void addCut( Iterator::Base *, double duration, double t ) throw( KGD::Exception::OutOfBounds );
+				public:
+					//! construct over another iterator, taking its ownership
+					Edit( Iterator::Base * ) throw();
+					//! get clone of this iterator
+					virtual Edit* getClone() const throw();
+					//! dtor
+					virtual ~Edit();
+					//! returns frame at position. does not change current position
+					virtual const SDP::Frame::Base & at( size_t ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position
+					virtual const SDP::Frame::Base & curr() const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position then advances position by 1
+					virtual const SDP::Frame::Base & next() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! returns frame at current position then backwards position by 1
+					virtual const SDP::Frame::Base & prev() throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! appends up to n next frames, not crossing a cut
+					virtual size_t nextBatch( size_t n, Batch & ) throw( KGD::Exception::NullPointer );
+					//! gets previous frame, going back through the cuts
+					virtual bool tryPrev( const SDP::Frame::Base * & ) throw( KGD::Exception::NullPointer );
+					//! positions on first or last frame, cuts included
+					virtual void rewind( bool forward ) throw();
+					//! seeks first frame at specified time. changes current position
+					virtual const SDP::Frame::Base & seek( double ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! seeks to a position
+					virtual const SDP::Frame::Base & seek( size_t ) throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+					//! drops references to frames returned so far
+					virtual void unpin() throw();
+					//! returns current position
+					virtual size_t pos() const throw();
+					//! returns number of frames of base and insertions
+					virtual size_t size() const throw();
+					//! returns duration of base and insertions
+					virtual double duration() const throw();
+					//! time shift of base or of current insertion
+					virtual double getTimeShift() const throw();
+
+					//! inserts another medium at a given presentation time
+					void insert( Medium::Base &, double t ) throw( KGD::Exception::OutOfBounds );
+					//! inserts a void space at a given presentation time
+					void insert( double duration, double t ) throw( KGD::Exception::OutOfBounds );
 
 					//! get medium this iterator works on
 					virtual Medium::Base & getMedium() throw();
@@ -25,6 +25,17 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     live rings overwrite their oldest block, lagging iterators resync
+ *     channel play lists
+ *     frames loaded on request
+ *     end of frames without exceptions
+ *     frame batches
+ *     ring frame table for live media
+ *     lock-free frame readers, deferred reclamation
+ *     frame store is never modified after loading
+ *     frames know their medium, play lists
+ *     compact frame table, payloads in arena
  *     introduced keep alive on control socket (me dumb)
  *     testing interrupted connections
  *     Lockables in timers and medium; refactorized iterator release
@@ -65,13 +76,36 @@ namespace KGD
 
 			Base::FrameData::FrameData( int64_t n )
 			: count( n )
-			, timeShift( 0 )
 			, timeFirst( 0 )
 			, timeLast( 0 )
-			{}
-			
+			, retain( false )
+			, epoch( 0 )
+			{
+				readers[ 0 ] = readers[ 1 ] = 0;
+			}
+
+			Base::FrameData::Reader::Reader( const FrameData & d ) throw()
+			: _data( d )
+			{
+				for(;;)
+				{
+					uint32_t e = Safe::Atomic::load( d.epoch );
+					_parity = e & 1;
+					Safe::Atomic::add( d.readers[ _parity ], uint32_t( 1 ) );
+					// epoch may have moved before we were accounted
+					if ( Safe::Atomic::load( d.epoch ) == e )
+						break;
+					Safe::Atomic::add( d.readers[ _parity ], uint32_t( -1 ) );
+				}
+			}
+
+			Base::FrameData::Reader::~Reader() throw()
+			{
+				Safe::Atomic::add( _data.readers[ _parity ], uint32_t( -1 ) );
+			}
+
 			Base::It::It( )
-// 			: count( 0 )
+			: count( 0 )
 			{}
 
 			Base::Base( MediaType::kind mt, Payload::type pt )
@@ -100,6 +134,7 @@ namespace KGD
 			, _extraData( b._extraData )
 			, _frame( 0 )
 			{
+				_frame.table.setTimeBase( _timeBase );
 				_it.model.reset( new Iterator::Default( *this ) );
 			}
 
@@ -115,7 +150,9 @@ namespace KGD
 					_it.released.wait( lk );
 				}
 
-				_frame.list.clear();
+				_frame.table.clear();
+				this->clearLimbo( 0 );
+				this->clearLimbo( 1 );
 			}
 
 			Iterator::Base * Base::newFrameIterator() throw()
@@ -123,6 +160,7 @@ namespace KGD
 				It::Lock lk( _it );
 				Iterator::Base * rt = _it.model->getClone();
 				_it.instances.push_back( rt );
+				++ _it.count;
 				Log::verbose( "%s: new iterator %p", getLogName(), rt );
 				return rt;
 			}
@@ -136,6 +174,7 @@ namespace KGD
 				{
 					Log::verbose( "%s: iterator %p found", getLogName(), &i );
 					_it.instances.erase( toRemove );
+					-- _it.count;
 
 					if ( _it.instances.empty() )
 					{
@@ -164,6 +203,18 @@ namespace KGD
 				return _container->isLiveCast();
 			}
 
+			bool Base::isChannel() const throw()
+			{
+				BOOST_ASSERT( _container );
+				return _container->isChannel();
+			}
+
+			double Base::getChannelTime() const throw()
+			{
+				BOOST_ASSERT( _container );
+				return _container->getChannelTime();
+			}
+
 			double Base::getIterationDuration() const throw()
 			{
 				It::Lock lk( _it );
@@ -253,6 +304,10 @@ namespace KGD
 			{
 				_timeBase = x;
 				_freqBase = 1 / x;
+				{
+					FrameData::Lock lk( _frame );
+					_frame.table.setTimeBase( x );
+				}
 				Log::debug( "%s: Tbase %lf Fbase %lf", getLogName(), _timeBase, _freqBase );
 			}
 
@@ -260,26 +315,49 @@ namespace KGD
 			{
 				{
 					FrameData::Lock lk( _frame );
-					_frame.count = _frame.list.size();
+					Safe::Atomic::store( _frame.count, int64_t( _frame.table.size() ) );
 					Log::debug("%s: %lld frames", getLogName(), _frame.count );
 				}
 				_frame.available.notify_all();
 			}
 
+			void Base::resetFrameCount( ) throw()
+			{
+				FrameData::Lock lk( _frame );
+				if ( _frame.table.size() == 0 )
+					Safe::Atomic::store( _frame.count, int64_t( -1 ) );
+			}
+
 			void Base::cacheFrame( Frame::Base * f ) throw()
 			{
 				FrameData::Lock lk( _frame );
 				f->setPayloadType( _pt );
-				f->addTime( _frame.timeShift );
-				f->setMediumPos( _frame.list.size() );
-				BOOST_ASSERT( _frame.list.empty() || f->getTime() > _frame.list.back().getTime() );
+				f->setMedium( *this );
+				f->setMediumPos( _frame.table.size() );
+				BOOST_ASSERT( _frame.table.size() == 0 || f->getTime() >= _frame.table.getTime( _frame.table.size() - 1 ) );
 
-				if (_frame.list.empty() )
+				if ( _frame.table.size() == 0 )
+				{
+					// live frames are consumed: keep a bounded window of them
+					if ( _container && this->isLiveCast() && ! _frame.retain )
+						_frame.table.setRing( Container::SIZE_FULL );
 					_frame.timeFirst = f->getTime();
+				}
 				else
 					_frame.timeLast = f->getTime();
 
-				_frame.list.push_back( f );
+				vector< Frame::Base * > evicted;
+				if ( ! _frame.table.push_back( f, evicted ) )
+					Log::error( "%s: frame table full, dropping frame at %lf", getLogName(), _frame.timeLast );
+				else if ( ! evicted.empty() )
+				{
+					// ring wrapped over frames some iterator still lags behind: they resync to the oldest one stored
+					Log::warning( "%s: ring wrapped, evicting %u frames not yet sent", getLogName(), evicted.size() );
+					BOOST_FOREACH( Frame::Base * e, evicted )
+						_frame.limbo[ _frame.epoch & 1 ].push_back( e );
+					this->reclaimFrames();
+					_frame.timeFirst = _frame.table.getTime( _frame.table.first() );
+				}
 			}
 
 			void Base::addFrame( Frame::Base * f ) throw()
@@ -290,6 +368,10 @@ namespace KGD
 
 			size_t Base::getFrameCount( ) const throw( )
 			{
+				int64_t n = Safe::Atomic::load( _frame.count );
+				if ( n >= 0 )
+					return n;
+
 				FrameData::Lock lk( _frame );
 				while( _frame.count < 0 )
 					_frame.available.wait( lk );
@@ -297,6 +379,17 @@ namespace KGD
 				return _frame.count;
 			}
 
+			size_t Base::getLoadedFrameCount( ) const throw( )
+			{
+				int64_t n = Safe::Atomic::load( _frame.count );
+				return ( n >= 0 ? size_t( n ) : _frame.table.size() );
+			}
+
+			bool Base::isFrameCountKnown( ) const throw( )
+			{
+				return Safe::Atomic::load( _frame.count ) >= 0;
+			}
+
 			double Base::getStoredDuration( ) const throw( )
 			{
 				FrameData::Lock lk( _frame );
@@ -338,11 +431,12 @@ namespace KGD
 				// copy
 				FrameList rt;
 				rt.reserve( toPos - fromPos + 1 );
+				FrameData::Reader rd( _frame );
 				for( size_t i = fromPos; i <= toPos; ++i )
 				{
-					if ( ! _frame.list.is_null( i ) )
+					if ( const Frame::Base * src = _frame.table.get( i ) )
 					{
-						auto_ptr< Frame::Base > f( _frame.list[i].getClone() );
+						auto_ptr< Frame::Base > f( src->getClone() );
 						f->addTime( -from );
 						rt.push_back( f );
 					}
@@ -354,162 +448,169 @@ namespace KGD
 
 			void Base::releaseFrame( size_t pos ) throw()
 			{
-				FrameData::Lock lk( _frame );
-				It::Lock ilk( _it );
 				// we won't release frames on non-live casts
 				// since we may want to seek back
-				size_t frameListSz = _frame.list.size();
-				if ( _container->isLiveCast()
-					&& pos < frameListSz
-					&& ! _frame.list.is_null( pos )
-					&& ! _it.model->hasType< Medium::Iterator::Loop >() )
+				if ( ! _container->isLiveCast()
+					|| Safe::Atomic::load( _frame.retain )
+					|| pos >= _frame.table.size() )
+					return;
+
+				// effectively release when every iterator has released the frame
+				if ( _frame.table.release( pos ) < size_t( long( _it.count ) ) )
+					return;
+
+				Frame::Base * f = _frame.table.retire( pos );
+				if ( ! f )
+					return;
+
+				FrameData::Lock lk( _frame );
+				_frame.limbo[ _frame.epoch & 1 ].push_back( f );
+				this->reclaimFrames();
+
+				// update time of first frame
+				if ( ++ pos >= _frame.table.size() )
+					_frame.timeFirst = _frame.timeLast;
+				else
+					_frame.timeFirst = _frame.table.getTime( pos );
+
+				// request more if buffer is low
+				if ( this->getStoredDuration() <= Container::SIZE_LOW )
+					_container->requestMoreFrames();
+			}
+
+			void Base::reclaimFrames() throw()
+			{
+				// readers of the previous epoch may still see frames retired back then
+				uint32_t prev = ( _frame.epoch + 1 ) & 1;
+				// readers only take references, so they leave soon: rather wait for them than let limbo grow unbounded
+				if ( _frame.limbo[ _frame.epoch & 1 ].size() >= FrameData::LIMBO_MAX )
+					while( Safe::Atomic::load( _frame.readers[ prev ] ) != 0 )
+						boost::this_thread::yield();
+
+				if ( Safe::Atomic::load( _frame.readers[ prev ] ) == 0 )
 				{
-					// effectively release when every iterator has released the frame
-					if ( _frame.list[ pos ].release() >= _it.instances.size() )
-					{
-						_frame.list.replace( pos, 0 );
-						// update time of first frame
-						if ( ++ pos >= frameListSz )
-							_frame.timeFirst = _frame.timeLast;
-						else
-						{
-							for( ; pos < frameListSz; ++ pos )
-								if ( ! _frame.list.is_null( pos ) )
-								{
-									_frame.timeFirst = _frame.list[ pos ].getTime();
-									break;
-								}
-						}
-						// request more if buffer is low
-						if ( this->getStoredDuration() <= Container::SIZE_LOW )
-							_container->requestMoreFrames();
-					}
-						
-/*					{
-						_frame.list.erase( _frame.list.begin() + pos );
-						for_each( _it.instances.begin(), _it.instances.end(), boost::bind( &Iterator::Base::frameRemoved, _1, pos ) );
-					}*/
+					this->clearLimbo( prev );
+					Safe::Atomic::store( _frame.epoch, _frame.epoch + 1 );
 				}
 			}
 
-			const Frame::Base & Base::getFrame( size_t pos ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
+			void Base::clearLimbo( uint32_t parity ) throw()
+			{
+				// frames still referenced by iterators or RTP frames are deleted by the last of them
+				BOOST_FOREACH( Frame::Base * f, _frame.limbo[ parity ] )
+					Frame::Base::unRef( f );
+				_frame.limbo[ parity ].clear();
+			}
+
+			void Base::dropFrames() throw()
 			{
 				FrameData::Lock lk( _frame );
-				while ( pos >= _frame.list.size() )
-				{
-					if ( _frame.count < 0 )
-						_frame.available.wait( lk );
-					else
-						throw KGD::Exception::OutOfBounds( pos, 0, _frame.list.size() );
-				}
+				BOOST_ASSERT( long( _it.count ) == 0 );
 
-				if ( ! _frame.list.is_null( pos ) )
-					return _frame.list[ pos ];
-				else
-					throw KGD::Exception::NullPointer( "Frame at position " + KGD::toString( pos ) + " out of " + KGD::toString( _frame.list.size() ) );
+				// frames referenced elsewhere are deleted by the last of them
+				_frame.table.clear();
+				this->clearLimbo( 0 );
+				this->clearLimbo( 1 );
+				Safe::Atomic::store( _frame.count, int64_t( -1 ) );
+				_frame.timeFirst = _frame.timeLast = 0;
 			}
 
-			size_t Base::getFramePos( double t ) const throw( KGD::Exception::OutOfBounds )
+			void Base::retainFrames() throw()
 			{
 				FrameData::Lock lk( _frame );
-				size_t pos = 0;
-				for( ; ; )
-				{
-					// wait for more frames if needed
-					if( pos >= _frame.list.size() )
-					{
-						if ( _frame.count < 0 )
-							_frame.available.wait( lk );
-						else
-							throw KGD::Exception::OutOfBounds( pos, 0, _frame.list.size() );
-					}
-					// frame time >= searched time
-					// if video frame, must be key
-					else if (
-						! _frame.list.is_null( pos )
-						&& _frame.list[pos].getTime() >= t
-						&& ( (_type == SDP::MediaType::Video && _frame.list[pos].asPtrUnsafe< Frame::MediaFile >()->isKey() )
-							|| _type != SDP::MediaType::Video ) )
-						return pos;
-					else
-						++ pos;
-				}
+				Safe::Atomic::store( _frame.retain, true );
+				if ( ! _frame.table.setLinear() )
+					Log::warning( "%s: live frames already recycled, cannot keep all of them", getLogName() );
 			}
 
-			void Base::insert( Iterator::Base & otherFrames, double start ) throw( KGD::Exception::OutOfBounds )
+			bool Base::tryWaitFrame( size_t pos ) const throw()
 			{
 				FrameData::Lock lk( _frame );
-				double otherDuration = otherFrames.duration();
-				// guess pos
-				size_t pos = this->getFramePos( start );
-				Log::debug( "%s: media insert: found insert position %lu for time %lf, shifting next frames by %lf", getLogName(), pos, start, otherDuration );
-				// shift successive frames by new medium duration
-				FrameList::iterator insIt = _frame.list.begin() + pos;
-				Log::debug( "%s: media insert: first frame to shift at time %lf (previous at %lf)", getLogName(), insIt->getTime(), (insIt - 1)->getTime() );
+				while ( pos >= _frame.table.size() )
 				{
-					FrameList::iterator it = insIt, ed = _frame.list.end();
-					for( ; it != ed; ++it )
-						it->addTime( otherDuration );
+					if ( _frame.count < 0 )
+						_frame.available.wait( lk );
+					else
+						return false;
 				}
+				return true;
+			}
 
-				this->insert( insIt, start, otherDuration, otherFrames );
+			void Base::waitFrame( size_t pos ) const throw( KGD::Exception::OutOfBounds )
+			{
+				if ( ! this->tryWaitFrame( pos ) )
+					throw KGD::Exception::OutOfBounds( pos, 0, _frame.table.size() );
 			}
 
-			void Base::append( Iterator::Base & otherFrames ) throw( )
+			const Frame::Base & Base::getFrame( size_t pos ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer )
 			{
-				FrameData::Lock lk( _frame );
-				// we have to wait full fill
-				while( _frame.count < 0 )
-					_frame.available.wait( lk );
+				if ( pos >= _frame.table.size() )
+					this->waitFrame( pos );
 
-				this->insert( _frame.list.end(), _duration, 0, otherFrames );
+				// the reference outlives the reader, so the frame survives its reclamation
+				FrameData::Reader rd( _frame );
+				if ( const Frame::Base * f = _frame.table.get( pos ) )
+				{
+					f->addRef();
+					return *f;
+				}
+				else
+					throw KGD::Exception::NullPointer( "Frame at position " + KGD::toString( pos ) + " out of " + KGD::toString( _frame.table.size() ) );
 			}
 
-			void Base::insert( FrameList::iterator at, double offset, double shift, Iterator::Base & otherFrames )
+			bool Base::getFrameRange( size_t & pos, size_t to, size_t max, FrameBatch & out ) const throw()
 			{
-				FrameList toInsert;
-				try
-				{
-					// clone and shift by offset time
-					for(;;)
+				if ( pos >= _frame.table.size() && ! this->tryWaitFrame( pos ) )
+					return false;
+
+				// lagging behind a ring: resync to the oldest frame stored
+				if ( pos < _frame.table.first() )
+					pos = _frame.table.first();
+
+				// what has been published so far
+				to = min( to, _frame.table.size() );
+				FrameData::Reader rd( _frame );
+				for( ; pos < to && max > 0; ++ pos )
+					if ( const Frame::Base * f = _frame.table.get( pos ) )
 					{
-						auto_ptr< Frame::Base > newFrame( otherFrames.next().getClone() );
-						newFrame->addTime( offset );
-						toInsert.push_back( newFrame );
+						f->addRef();
+						out.push_back( f );
+						-- max;
 					}
-				}
-				catch( KGD::Exception::OutOfBounds )
-				{
-					// insert and adjust internal state
-					Log::debug( "%s: media append: append %lu new frames", getLogName(), toInsert.size() );
-					_frame.list.insert( at, toInsert.begin(), toInsert.end() );
-					_frame.count += toInsert.size();
-					_duration += otherFrames.duration();
-					_frame.timeShift += shift;
-				}
+
+				return true;
 			}
 
-			void Base::insert( double duration, double start ) throw( KGD::Exception::OutOfBounds )
+			size_t Base::getFirstFramePos( ) const throw()
 			{
-				FrameData::Lock lk( _frame );
-				// guess pos
-				size_t pos = this->getFramePos( start );
-				Log::debug( "%s: media insert: found insert position %lu", getLogName(), pos );
-				// shift successive frames by new medium duration
-				FrameList::iterator insIt = _frame.list.begin() + pos;
+				return _frame.table.first();
+			}
+
+			size_t Base::getFramePos( double t ) const throw( KGD::Exception::OutOfBounds )
+			{
+				// jump to first frame at or after t, then look for a valid one
+				size_t pos = _frame.table.lowerBound( t );
+				for( ; ; )
 				{
-					FrameList::iterator it = insIt, ed = _frame.list.end();
-					for( ; it != ed; ++it )
-						it->addTime( duration );
+					// wait for more frames if needed
+					if( pos >= _frame.table.size() )
+						this->waitFrame( pos );
+					// if video frame, must be key
+					else if (
+						_frame.table.get( pos )
+						&& ( _type != SDP::MediaType::Video || _frame.table.isKey( pos ) ) )
+						return pos;
+					else
+						++ pos;
 				}
-				_duration += duration;
-				_frame.timeShift += duration;
 			}
 
 			void Base::loop( uint8_t times ) throw()
 			{
 				It::Lock lk( _it );
 				_it.model.reset( new Iterator::Loop( _it.model.release(), times ) );
+				// looped frames will be played again
+				this->retainFrames();
 			}
 		}
 	}
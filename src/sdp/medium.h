@@ -25,6 +25,16 @@
  *     Emiliano Leporati <emiliano.leporati@gmail.com>
  *
  * Last changes :
+ *     frames are reference counted, iterators pin what they return
+ *     live rings overwrite their oldest block, lagging iterators resync
+ *     channel play lists
+ *     frames loaded on request
+ *     end of frames without exceptions
+ *     frame batches
+ *     lock-free frame readers, deferred reclamation
+ *     frame store is never modified after loading
+ *     frames know their medium, play lists
+ *     compact frame table, payloads in arena
  *     Lockables in timers and medium; refactorized iterator release
  *     boosted
  *     removed deadlock issue in RTCP receiver; unloading sent frames from memory when appliable
@@ -79,6 +89,7 @@ namespace KGD
 			public:
 				typedef boost::ptr_vector< boost::nullable< Frame::Base > > FrameList;
 				typedef vector< Iterator::Base * > IteratorList;
+				typedef vector< const Frame::Base * > FrameBatch;
 				friend class SDP::Container;
 			protected:
 				//! ref to container
@@ -105,23 +116,48 @@ namespace KGD
 				//! extra informations
 				ByteArray _extraData;
 
-				//! frame stuff in medium descriptor
+				//! frame payloads storage
+				Arena _arena;
+
+				//! frame stuff in medium descriptor; the lock is for the writer and for waiting readers only
+				//! retired frames are reclaimed by epochs: a reader enters the parity of the current epoch, and frames retired
+				//! during an epoch are released once the epoch is over and no reader is left in its parity
 				struct FrameData
 				: public Safe::LockableBase< RMutex >
 				{
+					//! retired frames of an epoch beyond which the writer waits for the readers of the previous one, rather than deferring
+					static const size_t LIMBO_MAX = 1024;
+
 					FrameData( int64_t );
 					//! number of frames; -1 means no effective value has been determined
-					int64_t count;
-					//! frame list
-					FrameList list;
+					int64_t volatile count;
+					//! frames and their metadata
+					Frame::Table table;
 					//! condition for iterators to wait for more frames
 					mutable Condition available;
-					//! time shift to add to new added frames if insertions were made
-					double timeShift;
 					//! time of first valid frame
 					double timeFirst;
 					//! time of last valid frame
 					double timeLast;
+					//! frames must be kept even if live, since they will be played again
+					bool volatile retain;
+					//! reclamation epoch
+					uint32_t volatile epoch;
+					//! readers inside the table, by epoch parity
+					mutable uint32_t volatile readers[ 2 ];
+					//! retired frames waiting for the readers of their epoch to leave, holding the table reference
+					vector< Frame::Base * > limbo[ 2 ];
+
+					//! scope of a lock-free reader, delaying the reclamation of frames retired meanwhile; short, never locks
+					class Reader
+					: public boost::noncopyable
+					{
+						const FrameData & _data;
+						uint32_t _parity;
+					public:
+						Reader( const FrameData & ) throw();
+						~Reader() throw();
+					};
 				} _frame;
 
 				//! iterator stuff in medium descriptor
@@ -131,7 +167,8 @@ namespace KGD
 					It( );
 					//! instance references
 					IteratorList instances;
-// 					mutable boost::detail::atomic_count count;
+					//! number of instances, readable without lock
+					boost::detail::atomic_count count;
 					//! frame iterator model
 					auto_ptr< Iterator::Base > model;
 					//! condition for dtor to wait for no more iterator instances
@@ -149,12 +186,27 @@ namespace KGD
 				Base( const Base & );
 				//! set frame count to determined, actual, effective value
 				virtual void finalizeFrameCount( ) throw();
+				//! set frame count back to undetermined if no frame has been loaded yet
+				void resetFrameCount( ) throw();
 				//! adds a frame
 				virtual void cacheFrame( Frame::Base * ) throw();
 				//! adds a frame and notifies waiting threads
 				virtual void addFrame( Frame::Base * ) throw();
-				//! retrieves a frame at a given position
+				//! waits for a frame to be published at a given position; false if there won't be any
+				bool tryWaitFrame( size_t ) const throw();
+				//! waits for a frame to be published at a given position
+				void waitFrame( size_t ) const throw( KGD::Exception::OutOfBounds );
+				//! drops the table reference of retired frames no reader can see anymore; frame lock must be held
+				void reclaimFrames() throw();
+				//! drops the table reference of every frame in limbo; frame lock must be held
+				void clearLimbo( uint32_t parity ) throw();
+				//! retrieves a frame at a given position, taking a reference the caller must drop
 				const Frame::Base & getFrame( size_t ) const throw( KGD::Exception::OutOfBounds, KGD::Exception::NullPointer );
+				//! appends up to max valid frames from a position to another, waiting for the first one, and moves the position after the last one scanned; false if past the end
+				//! a reference is taken to each frame appended, the caller must drop it
+				bool getFrameRange( size_t & pos, size_t to, size_t max, FrameBatch & ) const throw();
+				//! returns the position of the oldest frame stored, non zero once a live ring has wrapped
+				size_t getFirstFramePos( ) const throw();
 				//! tells the position of the first valid frame at or immediately after the given time in seconds - this means a key frame for video media
 				size_t getFramePos( double ) const throw( KGD::Exception::OutOfBounds );
 
@@ -200,6 +252,10 @@ namespace KGD
 
 				//! is this medium referred to a live cast ?
 				bool isLiveCast() const throw();
+				//! is this medium part of a channel play list ?
+				bool isChannel() const throw();
+				//! returns the current time on the channel timeline
+				double getChannelTime() const throw();
 
 				//! set a new iterator model
 				void setFrameIteratorModel( Iterator::Base * ) throw();
@@ -213,25 +269,23 @@ namespace KGD
 				double getStoredDuration( ) const throw();
 				//! returns effective frame count, waiting until one has been determined
 				size_t getFrameCount( ) const throw( );
+				//! returns effective frame count if determined, else the number of frames loaded so far
+				size_t getLoadedFrameCount( ) const throw( );
+				//! tells if the effective frame count has been determined
+				bool isFrameCountKnown( ) const throw( );
 				//! returns a cloned portion of all frames based on time; limits are cropped if out of bounds
 				FrameList getFrames( double from, double to = HUGE_VAL ) const throw( );
 				
 				//! frees the memory of a frame at given position
 				void releaseFrame( size_t pos ) throw();
+				//! never free frames, e.g. when playing in a loop
+				void retainFrames() throw();
+				//! drops every frame, which will be loaded again; no iterator must exist
+				void dropFrames() throw();
 
-				//! insert other frames for a total duration at a defined time position
-				void insert( Iterator::Base & otherFrames, double start ) throw( KGD::Exception::OutOfBounds );
-				//! insert a void, silence duration at a defined time position
-				void insert( double duration, double start ) throw( KGD::Exception::OutOfBounds );
-				//! append frames to the end
-				void append( Iterator::Base & otherFrames ) throw();
 				//! loop current frames a number of times ( 0 = infinite )
 				void loop( uint8_t = 0 ) throw();
 
-			private:
-				//! internal insert utility
-				void insert( FrameList::iterator at, double offset, double shift, Iterator::Base & otherFrames );
-
 				friend class Iterator::Default;
 			};
 		}